@@ -19,7 +19,10 @@
  *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
-#include <elm/avl/Map.h>
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <vector>
 #include <otawa/hard/Cache.h>
 #include <otawa/hard/Memory.h>
 #include <otawa/proc/ProcessorPlugin.h>
@@ -96,12 +99,18 @@ namespace otawa { namespace dcache {
  * @li @ref NONE -- invalid action (only for convenience),
  * @li @ref READ -- read of cache,
  * @li @ref WRITE -- write of cache,
- * @li @ref PURGE -- target block are purged (possibly written back to memory).
+ * @li @ref PURGE -- target block are purged (possibly written back to memory),
+ * @li @ref DIRECT_LOAD, @ref DIRECT_STORE -- access bypassing the cache,
+ * @li @ref HIT_LOAD, @ref HIT_STORE -- access to a block that is always a hit
+ * because of a previous access of the same basic block (see @ref COALESCE);
+ * it does not change the cache state.
  *
  * Possible kinds of data accesses include:
  * @li ANY		Most imprecised access: one memory accessed is performed but the address is unknown.
  * @li BLOCK	A single block is accessed (given by @ref block() method).
  * @li RANGE	A range of block may be accessed (between @ref first() and @ref last() methods addresses).
+ * @li ENUM		One block of a strided sequence is accessed (given by @ref base(), @ref stride()
+ * 				and @ref blockCount() methods).
  * 
  * @ingroup dcache
  */
@@ -111,11 +120,16 @@ namespace otawa { namespace dcache {
  */
 Access::Access():
 	_inst(nullptr),
+	_fst(0),
+	_lst(0),
+	_stride(0),
+	_cnt(0),
 	_kind(ANY),
 	_action(NO_ACCESS),
 	_type(sem::NO_TYPE),
-	_index(-1)
-	{ }
+	_index(-1),
+	_id(-1)
+	{ data.blk = nullptr; }
 
 /**
  * Build a block access of type ANY.
@@ -125,9 +139,20 @@ Access::Access():
  * @param index			Access index for multiple memory access instruction
  * 						(optional).
  */
-Access::Access(Inst *instruction, action_t action, sem::type_t type, int index)
-: _inst(instruction), _kind(ANY), _action(action), _type(type), _index(index) {
+Access::Access(Inst *instruction, action_t action, sem::type_t type, int index):
+	_inst(instruction),
+	_fst(0),
+	_lst(0),
+	_stride(0),
+	_cnt(0),
+	_kind(ANY),
+	_action(action),
+	_type(type),
+	_index(index),
+	_id(-1)
+{
 	ASSERT(instruction != nullptr);
+	data.blk = nullptr;
 }
 
 
@@ -146,19 +171,30 @@ Access::Access(
 	const CacheBlock *block,
 	sem::type_t type,
 	int index
-): _inst(instruction), _kind(BLOCK), _action(action), _type(type), _index(index)
+):
+	_inst(instruction),
+	_fst(block->set()),
+	_lst(block->set()),
+	_stride(0),
+	_cnt(0),
+	_kind(BLOCK),
+	_action(action),
+	_type(type),
+	_index(index),
+	_id(-1)
 {
 	ASSERT(instruction != nullptr);
 	data.blk = block;
 }
 
 /**
- * Build a block access of type range. Notice the address of first block may be
- * greater than the address of the second block, meaning that the accessed addresses
- * ranges across the address modulo by 0.
+ * Build a block access of type range. Notice the first set may be greater
+ * than the last set, meaning that the accessed addresses ranges across
+ * the address modulo by 0.
  * @param instruction	Instruction performing the access.
  * @param action		Type of action.
- * @param blocks		List of accessed blocks.
+ * @param fst			First accessed set.
+ * @param lst			Last accessed set.
  * @param type			Type of accessed data (optional).
  * @param index			Access index for multiple memory access instruction
  * 						(optional).
@@ -166,82 +202,85 @@ Access::Access(
 Access::Access(
 	Inst *instruction,
 	action_t action,
-	const Vector<const CacheBlock *>& blocks,
+	int fst,
+	int lst,
 	sem::type_t type,
 	int index
-): _inst(instruction), _kind(ENUM), _action(action), _type(type), _index(index) {
+):
+	_inst(instruction),
+	_fst(fst),
+	_lst(lst),
+	_stride(0),
+	_cnt(0),
+	_kind(RANGE),
+	_action(action),
+	_type(type),
+	_index(index),
+	_id(-1)
+{
 	ASSERT(instruction != nullptr);
-	data.enm = new enum_t;
-	data.enm->fst = blocks.first()->set();
-	data.enm->lst = blocks.last()->set();
-	data.enm->bs = blocks;
+	data.blk = nullptr;
 }
 
-
 /**
- * Clone a block access.
- * @param b		Cloned block access.
+ * Build a block access of type enumeration: the accessed blocks are
+ * the count blocks starting at base and separated by stride blocks. All
+ * these blocks must be recorded in the set collection and must span
+ * less blocks than the number of sets (so that a set contains at most one
+ * accessed block).
+ * @param instruction	Instruction performing the access.
+ * @param action		Type of action.
+ * @param coll			Set collection containing the blocks.
+ * @param base			Address of the first accessed block.
+ * @param stride		Distance between accessed blocks (in blocks).
+ * @param count			Number of accessed blocks.
+ * @param type			Type of accessed data (optional).
+ * @param index			Access index for multiple memory access instruction
+ * 						(optional).
  */
-Access::Access(const Access& b) {
-	set(b);
-	
-}
-
-///
-void Access::clear() {
-	switch(_kind) {
-	case RANGE:
-		delete data.range;
-		break;
-	case ENUM:
-		delete data.enm;
-		break;
-	default:
-		break;
-	}	
-}
-
-///
-void Access::set(const Access& a) {
-	_inst = a._inst;
-	_kind = a._kind;
-	_action = a._action;
-	switch(_kind) {
-	case ANY:
-		break;
-	case BLOCK:	
-		data.blk = a.data.blk;
-		break;
-	case RANGE:
-		data.range = new range_t;
-		*data.range = *a.data.range;
-		break;
-	case ENUM:
-		data.enm = new enum_t();
-		*data.enm = *a.data.enm;
-		break;
-	}
-}
-
-
-///
-Access::~Access() {
-	clear();
+Access::Access(
+	Inst *instruction,
+	action_t action,
+	SetCollection& coll,
+	Address base,
+	int stride,
+	int count,
+	sem::type_t type,
+	int index
+):
+	_inst(instruction),
+	_base(coll.cache().round(base)),
+	_stride(stride),
+	_cnt(count),
+	_kind(ENUM),
+	_action(action),
+	_type(type),
+	_index(index),
+	_id(-1)
+{
+	ASSERT(instruction != nullptr);
+	ASSERT(stride >= 1 && count >= 1);
+	ASSERT((count - 1) * stride < coll.setCount());
+	data.coll = &coll;
+	_fst = coll.cache().set(_base);
+	_lst = (_fst + (count - 1) * stride) % coll.setCount();
 }
 
 
 /**
- * Block access assignement.
- * @param acc	Assigned access.
- * @return		Current block.
+ * @fn int Access::id() const;
+ * Get the identifier of the access. The identifiers are assigned by the
+ * access builder and range in [0, @ref SetCollection::accessCount()[:
+ * they can be used to index side tables about the accesses
+ * (like @ref Categories).
+ * @return	Access identifier (-1 if not assigned).
  */
-Access& Access::operator=(const Access& a) {
-	clear();
-	set(a);
-	return *this;
-}
-
 
+/**
+ * @fn void Access::setID(int id);
+ * Set the identifier of the access (only for the access builders).
+ * @param id	Access identifier.
+ */
 
 
 /**
@@ -263,6 +302,13 @@ Access& Access::operator=(const Access& a) {
  * @return	Performed action.
  */
 
+/**
+ * @fn bool Access::isHit() const;
+ * Test if the access is known to be a hit without any analysis
+ * (@ref HIT_LOAD or @ref HIT_STORE action).
+ * @return	True if the access is a coalesced hit, false else.
+ */
+
 /**
  * @fn const Block *Access::block() const;
  * Only for kind BLOCK, get the accessed block.
@@ -307,8 +353,8 @@ void Access::print(io::Output& out) const {
 		break;
 	case ENUM:
 		out << "{";
-		for(auto b: data.enm->bs)
-			out << " " << *b;
+		for(int i = 0; i < blockCount(); i++)
+			out << " " << *blockAt(i);
 		out << " }";
 		break;
 	default:
@@ -319,25 +365,11 @@ void Access::print(io::Output& out) const {
 
 
 /**
+ * @fn bool Access::access(int set) const;
  * Test if the given set concerns the range access.
  * @param set	Set to test for.
  * @return		True if the set contains a block of the range, false else.
  */
-bool Access::access(int set) const {
-	switch(_kind) {
-	case ANY:
-		return true;
-	case BLOCK:
-		return data.blk->set() == set;
-	default:
-		auto f = first(), l = last();
-		if(f < l)
-			return f <= set && set <= l;
-		else
-			return f <= set || set <= l;
-		break;
-	}
-}
 
 
 /**
@@ -351,9 +383,11 @@ bool Access::access(const CacheBlock *block) const {
 		return true;
 	case BLOCK:
 		return data.blk == block;
-	case ENUM:
-		return data.enm->bs.contains(block);
-		break;
+	case ENUM: {
+			auto o = t::uint32(data.coll->address(block).offset() - _base.offset())
+				>> data.coll->cache().blockBits();
+			return o % _stride == 0 && o / _stride < _cnt;
+		}
 	case RANGE:
 		return access(block->set());
 	default:
@@ -363,29 +397,58 @@ bool Access::access(const CacheBlock *block) const {
 }
 
 /**
- * @fn const Vector<block_t>& Access::getBlocks(void) const;
- * Get the list of accessed blocks.
- * @warning This function is only valid for a RANGE access.
- * @return	Accessed blocks.
+ * @fn Address Access::base() const;
+ * Only for the ENUM kind, get the address of the first accessed block.
+ * @return	First accessed block address.
  */
 
+/**
+ * @fn int Access::stride() const;
+ * Only for the ENUM kind, get the distance, in blocks, between two
+ * consecutive accessed blocks.
+ * @return	Stride in blocks.
+ */
+
+/**
+ * @fn int Access::blockCount() const;
+ * Only for the ENUM kind, get the number of accessed blocks.
+ * @return	Number of accessed blocks.
+ */
+
+/**
+ * Get the i-th block of an ENUM access.
+ * @param i		Index of the block (in [0, blockCount()[).
+ * @return		Corresponding block.
+ */
+const CacheBlock *Access::blockAt(int i) const {
+	ASSERT(_kind == ENUM);
+	ASSERT(0 <= i && i < _cnt);
+	return data.coll->at(_base + (i * _stride) * data.coll->cache().blockSize());
+}
+
+///
+int Access::offsetOf(int set) const {
+	int d = set - _fst;
+	if(d < 0)
+		d += data.coll->setCount();
+	if(d % _stride != 0 || d / _stride >= _cnt)
+		return -1;
+	else
+		return d / _stride;
+}
+
 /**
  * Get the block corresponding to the given set.
- * @warning This function is only valid for a RANGE access.
+ * @warning This function is only valid for a ENUM access.
  * @return	Corresponding block or null pointer.
  */
 const CacheBlock *Access::blockIn(int set) const {
 	ASSERT(_kind == ENUM);
-	if(access(set)) {
-		auto f = first(), l = last();
-		auto bs = blocks();
-		if(f <= l || set >= f)
-			return bs[set - f];
-		else
-			return bs[bs.length() - l + set - 1];
-	}
-	else
+	auto i = offsetOf(set);
+	if(i < 0)
 		return nullptr;
+	else
+		return blockAt(i);
 }
 
 
@@ -397,13 +460,48 @@ io::Output& operator<<(io::Output& out, action_t action) {
 		"store",		// WRITE = 2
 		"purge",		// PURGE = 3
 		"direct-load",	// DIRECT_LOAD = 4,
-		"direct-store"	// DIRECT_STORE = 5
+		"direct-store",	// DIRECT_STORE = 5
+		"hit-load",		// HIT_LOAD = 6
+		"hit-store"		// HIT_STORE = 7
 	};
 	out << action_names[action];
 	return out;
 }
 
 
+/**
+ * Configuration of the analyses and of the category and event builders
+ * selecting the streaming mode. When set to a positive value n, the analyses
+ * are lazy (see @ref LAZY) and the builders process the sets by groups of n:
+ * the fixpoints of a group of sets are computed, the blocks of these sets are
+ * classified and the results of the group are freed before the next group
+ * is processed. The peak memory is then bound by the states of n sets instead
+ * of the states of the whole cache, the results being the same.
+ *
+ * Default value: 0 (no streaming).
+ *
+ * @ingroup dcache
+ */
+p::id<int> STREAM("otawa::dcache::STREAM", 0);
+
+
+/**
+ * Configuration of the category builder (@ref CATEGORY_FEATURE) asking
+ * categories for an associativity smaller than the one of the analyzed
+ * cache (the number of sets and the block size being the same). This
+ * property may be given several times to explore several associativities
+ * in one pass: the ages are only computed for the actual cache and are then
+ * projected on each smaller associativity (see @ref AgeInfo::ageFor()).
+ * The resulting categories are recorded as additional layers of
+ * @ref Categories, the layer 0 being the actual cache. Associativities
+ * bigger or equal to the actual one are ignored, as well as the ones
+ * given for a non-LRU cache.
+ *
+ * @ingroup dcache
+ */
+p::id<int> ASSOCIATIVITY("otawa::dcache::ASSOCIATIVITY", 0);
+
+
 /**
  * Property providing the list of data accesses to the mempory for a BB.
  * 
@@ -415,12 +513,247 @@ io::Output& operator<<(io::Output& out, action_t action) {
 p::id<AccessList> ACCESSES("otawa::dcache::ACCESSES");
 
 
+/**
+ * @class SetAccesses
+ * Projection of the accesses of a BB on the cache sets: for each set touched
+ * by the BB, it provides the list of accesses concerning this set, in program
+ * order. It lets the per-set analyses skip the accesses (and the BBs) that
+ * are transparent for their set without testing each access. The coalesced
+ * hits (@ref HIT_LOAD and @ref HIT_STORE accesses) are not listed as they do
+ * not change the states.
+ *
+ * The @ref BLOCK and @ref ENUM accesses are projected on the sets of their
+ * blocks. The @ref ANY and @ref RANGE accesses, that may concern all sets,
+ * are not projected but kept in a single list of wide accesses that is
+ * merged, in program order, with the projected accesses of a set when the
+ * accesses of this set are looked.
+ *
+ * @ingroup dcache
+ */
+
+/**
+ * @class SetAccesses::Accesses
+ * Accesses of a set for a BB, in program order: a collection of
+ * const Access * usable with the C++ for loop.
+ */
+
+/**
+ * Build the accesses of a set.
+ * @param accs	Accesses of the BB.
+ * @param set	Concerned set.
+ * @param idx	Indexes in accs of the accesses projected on the set.
+ * @param n		Number of projected accesses.
+ * @param widx	Indexes in accs of the wide accesses.
+ * @param m		Number of wide accesses.
+ */
+SetAccesses::Accesses::Accesses(const AccessList& accs, int set, const int *idx, int n, const int *widx, int m):
+	_accs(&accs), _set(set), _idx(idx), _n(n), _widx(widx), _m(m), _cnt(n)
+{
+	for(int i = 0; i < m; i++)
+		if(accs[widx[i]].access(set))
+			_cnt++;
+}
+
+/**
+ * @fn int SetAccesses::Accesses::count() const;
+ * Get the number of accesses of the set.
+ * @return	Number of accesses.
+ */
+
+/**
+ * Build the projection of the given accesses.
+ * @param accesses	Accesses of a BB.
+ * @param set_count	Number of sets in the cache.
+ */
+SetAccesses::SetAccesses(const AccessList& accesses, int set_count):
+	_accs(accesses), _n(0), _m(0), _sets(nullptr), _offs(nullptr), _idx(nullptr), _widx(nullptr)
+{
+
+	// collect the (set, access) pairs and the wide accesses
+	std::vector<std::pair<int, int> > ps;
+	std::vector<int> ws;
+	for(int i = 0; i < accesses.count(); i++) {
+		const auto& a = accesses[i];
+		if(a.isHit())
+			continue;
+		switch(a.kind()) {
+		case ANY:
+		case RANGE:
+			ws.push_back(i);
+			break;
+		case BLOCK:
+			ps.push_back(std::make_pair(a.block()->set(), i));
+			break;
+		case ENUM:
+			for(int j = 0; j < a.blockCount(); j++)
+				ps.push_back(std::make_pair((a.first() + j * a.stride()) % set_count, i));
+			break;
+		}
+	}
+	if(!ws.empty()) {
+		_m = ws.size();
+		_widx = new int[_m];
+		std::copy(ws.begin(), ws.end(), _widx);
+	}
+	if(ps.empty())
+		return;
+	std::sort(ps.begin(), ps.end());
+
+	// build the tables
+	_n = 1;
+	for(int i = 1; i < int(ps.size()); i++)
+		if(ps[i].first != ps[i - 1].first)
+			_n++;
+	_sets = new int[_n];
+	_offs = new int[_n + 1];
+	_idx = new int[ps.size()];
+	int j = -1;
+	for(int i = 0; i < int(ps.size()); i++) {
+		if(i == 0 || ps[i].first != ps[i - 1].first) {
+			j++;
+			_sets[j] = ps[i].first;
+			_offs[j] = i;
+		}
+		_idx[i] = ps[i].second;
+	}
+	_offs[_n] = ps.size();
+}
+
+///
+SetAccesses::~SetAccesses() {
+	delete [] _sets;
+	delete [] _offs;
+	delete [] _idx;
+	delete [] _widx;
+}
+
+/**
+ * @fn int SetAccesses::count() const;
+ * Get the number of sets the BB accesses are projected on (the sets
+ * only concerned by wide accesses are not counted).
+ * @return	Number of sets with projected accesses.
+ */
+
+/**
+ * @fn int SetAccesses::set(int i) const;
+ * Get the i-th set with projected accesses (in increasing order).
+ * @param i		Index of the set (in [0, count()[).
+ * @return		Corresponding set.
+ */
+
+/**
+ * @fn int SetAccesses::wideCount() const;
+ * Get the number of wide accesses (@ref ANY and @ref RANGE) of the BB.
+ * @return	Number of wide accesses.
+ */
+
+/**
+ * @fn const Access& SetAccesses::wide(int i) const;
+ * Get the i-th wide access (in program order).
+ * @param i		Index of the wide access (in [0, wideCount()[).
+ * @return		Corresponding access.
+ */
+
+/**
+ * Find the index of the given set in the sets with projected accesses.
+ * @param set	Looked set.
+ * @return		Index of the set or -1 if it is not touched.
+ */
+int SetAccesses::find(int set) const {
+	int l = 0, h = _n - 1;
+	while(l <= h) {
+		int m = (l + h) / 2;
+		if(_sets[m] == set)
+			return m;
+		else if(_sets[m] < set)
+			l = m + 1;
+		else
+			h = m - 1;
+	}
+	return -1;
+}
+
+/**
+ * Test if the given set is touched by the BB.
+ * @param set	Tested set.
+ * @return		True if the set is touched, false else.
+ */
+bool SetAccesses::touches(int set) const {
+	if(find(set) >= 0)
+		return true;
+	for(int i = 0; i < _m; i++)
+		if(wide(i).access(set))
+			return true;
+	return false;
+}
+
+/**
+ * Test if one of the sets in [f, l[ is touched by the BB.
+ * @param f		First set.
+ * @param l		Set after the last one.
+ * @return		True if a set of [f, l[ is touched, false else.
+ */
+bool SetAccesses::touches(int f, int l) const {
+	for(int i = 0; i < _n; i++)
+		if(f <= _sets[i] && _sets[i] < l)
+			return true;
+	for(int i = 0; i < _m; i++) {
+		if(wide(i).isAny())
+			return true;
+		for(int s = f; s < l; s++)
+			if(wide(i).access(s))
+				return true;
+	}
+	return false;
+}
+
+/**
+ * Get the accesses concerning the given set.
+ * @param set	Looked set.
+ * @return		Accesses of the set in program order (possibly empty).
+ */
+SetAccesses::Accesses SetAccesses::accesses(int set) const {
+	int i = find(set);
+	if(i < 0)
+		return Accesses(_accs, set, nullptr, 0, _widx, _m);
+	else
+		return Accesses(_accs, set, _idx + _offs[i], _offs[i + 1] - _offs[i], _widx, _m);
+}
+
+/**
+ * Get the accesses of a block concerning the given set.
+ * @param v		Looked block.
+ * @param set	Looked set.
+ * @return		Accesses of the set in program order (possibly empty).
+ */
+SetAccesses::Accesses SetAccesses::of(otawa::Block *v, int set) {
+	auto sa = SET_ACCESSES(v);
+	if(sa == nullptr)
+		return Accesses();
+	else
+		return sa->accesses(set);
+}
+
+
+/**
+ * Property providing, for a BB, the projection of its accesses on the cache
+ * sets.
+ *
+ * Feature:
+ * * @ref otawa::dcache::ACCESS_FEATURE
+ *
+ * @ingroup dcache
+ */
+p::id<SetAccesses *> SET_ACCESSES("otawa::dcache::SET_ACCESSES", nullptr);
+
+
 /**
  * Feature ensuring that a BB has been scanned in order to extract data accesses
  * to the memory.
  * 
  * Properties:
  * * @ref otawa::dcache::ACCESSES
+ * * @ref otawa::dcache::SET_ACCESSES
  * 
  * Processors:
  * * @ref otawa::dcache::CLPAccessBuilder
@@ -433,17 +766,19 @@ p::interfaced_feature<const SetCollection> ACCESS_FEATURE(
 );
 
 
-///
+// Blocks of a set: the blocks are placed contiguously in fixed-size chunks
+// of raw storage (their address never changes) and indexed by tag in a flat
+// open-addressing table (linear probing).
 class BlockCollection {
 public:
-	typedef avl::Map<int, CacheBlock *> map_t;
-	
+
 	inline BlockCollection(const hard::Cache& cache, int set)
-		: _cache(cache), _set(set), _cnt(0), _nccnt(0) { }
-	
+		: _cache(cache), _set(set), _cnt(0), _used(0), _cap(0), _tab(nullptr) { }
+
 	~BlockCollection() {
-		for(auto b: _map)
-			delete b;
+		delete [] _tab;
+		for(auto c: _chunks)
+			::operator delete(c);
 	}
 
 	inline const hard::Cache& cache() const { return _cache; }
@@ -451,45 +786,97 @@ public:
 
 	inline Address address(const CacheBlock *block) const {
 		ASSERT(block->set() == _set);
-		return block->tag() << (_set + _cache.blockBits());
+		return (Address::offset_t(block->tag()) << (_cache.setBits() + _cache.blockBits()))
+			| (Address::offset_t(_set) << _cache.blockBits());
 	}
-	
+
 	const CacheBlock *at(Address a) const {
 		if(int(_cache.set(a)) != _set)
 			return nullptr;
-		return _map.get(_cache.tag(a), nullptr);		
+		return find(_cache.tag(a));
 	}
-	
+
 	const CacheBlock *add(int tag, const hard::Bank *bank) {
-		CacheBlock *b;
-		
-		// cached block
-		if(bank->isCached()) {
-			int id = _cnt++;
-			b = new CacheBlock(tag, _set, id, bank);
-			if(_nccnt == blks.length())
-				blks.add(b);
-			else
-				blks.add(blks[id]);
-			_nccnt++;
-		}
-		
-		// non-cached block
-		else
-			b = new CacheBlock(tag, _set, -1, bank);
-		_map.put(tag, b);
+		if(2 * (_used + 1) > _cap)
+			grow();
+		int id = bank->isCached() ? _cnt++ : -1;
+		if((_used & (CHUNK_SIZE - 1)) == 0)
+			_chunks.add(static_cast<CacheBlock *>(::operator new(CHUNK_SIZE * sizeof(CacheBlock))));
+		auto b = new(_chunks[_chunks.length() - 1] + (_used & (CHUNK_SIZE - 1))) CacheBlock(tag, _set, id, bank);
+		if(id >= 0)
+			blks.add(b);
+		put(b);
+		_used++;
 		return b;
 	}
-	
+
 	const CacheBlock *block(int id) const {
 		return blks[id];
 	}
-	
+
+	inline std::mutex& mutex() { return _mutex; }
+
+	void renumber() {
+		if(blks.length() <= 1)
+			return;
+		std::sort(&blks[0], &blks[0] + blks.length(),
+			[](const CacheBlock *b1, const CacheBlock *b2) { return b1->tag() < b2->tag(); });
+		for(int i = 0; i < blks.length(); i++)
+			blks[i]->_id = i;
+	}
+
+	void shrink() {
+		int c = 1;
+		while(c < 2 * _used)
+			c *= 2;
+		if(c < _cap)
+			rehash(c);
+	}
+
 private:
+	static const int CHUNK_SIZE = 64;
+
+	static inline t::uint32 hash(int tag)
+		{ return t::uint32(tag) * 0x9e3779b1U; }
+
+	const CacheBlock *find(int tag) const {
+		if(_cap == 0)
+			return nullptr;
+		for(t::uint32 i = hash(tag) & (_cap - 1); _tab[i] != nullptr; i = (i + 1) & (_cap - 1))
+			if(_tab[i]->tag() == tag)
+				return _tab[i];
+		return nullptr;
+	}
+
+	void put(const CacheBlock *b) {
+		t::uint32 i = hash(b->tag()) & (_cap - 1);
+		while(_tab[i] != nullptr)
+			i = (i + 1) & (_cap - 1);
+		_tab[i] = b;
+	}
+
+	void grow() {
+		rehash(_cap == 0 ? 16 : 2 * _cap);
+	}
+
+	void rehash(int cap) {
+		auto old = _tab;
+		int oc = _cap;
+		_cap = cap;
+		_tab = new const CacheBlock *[_cap];
+		array::set(_tab, _cap, static_cast<const CacheBlock *>(nullptr));
+		for(int i = 0; i < oc; i++)
+			if(old[i] != nullptr)
+				put(old[i]);
+		delete [] old;
+	}
+
 	Vector<CacheBlock *> blks;
+	Vector<CacheBlock *> _chunks;
 	const hard::Cache& _cache;
-	int _set, _cnt, _nccnt;
-	map_t _map;
+	int _set, _cnt, _used, _cap;
+	const CacheBlock **_tab;
+	std::mutex _mutex;
 };
 
 
@@ -505,7 +892,7 @@ private:
  * Build a set collection.
  */
 SetCollection::SetCollection(const hard::Cache& cache, const hard::Memory& mem)
-: _cache(cache), _mem(mem), _sets(new BlockCollection *[cache.setCount()]) {
+: _cache(cache), _mem(mem), _sets(new BlockCollection *[cache.setCount()]), _frozen(false), _acc_cnt(0) {
 	for(int i = 0; i < cache.setCount(); i++)
 		_sets[i] = new BlockCollection(cache, i);
 }
@@ -526,7 +913,8 @@ const CacheBlock *SetCollection::at(Address a) {
 }
 
 /**
- * Add a new block corresponding to the given address.
+ * Add a new block corresponding to the given address. Until the collection
+ * is frozen, this function can be called concurrently by several threads.
  * @param a		Address of access to get block for.
  * @return		Block for the address.
  */
@@ -534,11 +922,15 @@ const CacheBlock *SetCollection::add(Address a) {
 	
 	// already recorded
 	int s = _cache.set(a);
+	std::unique_lock<std::mutex> lock(_sets[s]->mutex(), std::defer_lock);
+	if(!_frozen)
+		lock.lock();
 	auto b = _sets[s]->at(a);
 	if(b != nullptr)
 		return b;
 	
 	// determine bank and identifier
+	ASSERTP(!_frozen, "adding block " << a << " to a frozen set collection");
 	const hard::Bank *bank = _mem.get(a);
 	if(bank == nullptr)
 		return nullptr;
@@ -547,6 +939,47 @@ const CacheBlock *SetCollection::add(Address a) {
 	return _sets[s]->add(_cache.tag(a), bank);
 }
 
+/**
+ * Freeze the collection: no more block can be added (add() can only be used
+ * to find existing blocks) and the lookup tables are shrunk. Once frozen,
+ * the collection is read-only and can be used concurrently by several threads.
+ */
+void SetCollection::freeze() {
+	for(int i = 0; i < _cache.setCount(); i++)
+		_sets[i]->shrink();
+	_frozen = true;
+}
+
+/**
+ * Renumber the cached blocks of each set by increasing tag. This makes the
+ * block identifiers independent of the order the blocks have been added in
+ * (typically when the collection is built by several threads). Must be
+ * called before the blocks are used by the analyses.
+ */
+void SetCollection::renumber() {
+	for(int i = 0; i < _cache.setCount(); i++)
+		_sets[i]->renumber();
+}
+
+/**
+ * @fn int SetCollection::accessCount() const;
+ * Get the number of accesses built by the access builder: the access
+ * identifiers (@ref Access::id()) range in [0, accessCount()[.
+ * @return	Number of accesses.
+ */
+
+/**
+ * @fn void SetCollection::setAccessCount(int count);
+ * Set the number of accesses (only for the access builders).
+ * @param count	Number of accesses.
+ */
+
+/**
+ * @fn bool SetCollection::isFrozen() const;
+ * Test if the collection is frozen.
+ * @return	True if it is frozen, false else.
+ */
+
 /**
  * Get the count of sets.
  * @return	Count of sets.
@@ -612,12 +1045,120 @@ public:
 AgeInfo::~AgeInfo() {
 }
 
+/**
+ * Free the results of the given set when they are no more needed. This is
+ * only effective if the analysis is lazy (see @ref LAZY): the results
+ * will be computed again if the set is queried again. The default
+ * implementation does nothing.
+ * @param set	Dropped set.
+ */
+void AgeInfo::drop(int set) {
+}
+
+/**
+ * @fn int AgeInfo::ageFor(int age, int ways);
+ * Project an age computed for the cache associativity on a cache with less
+ * ways, but the same number of sets, and LRU policy. As the content of a
+ * LRU cache is included in the content of a LRU cache with more ways, the
+ * projected age is min(age, ways): for MUST and MAY analyses, this is the
+ * age the analysis would compute with the given number of ways; for the
+ * persistence analysis, this is a sound but possibly less precise age.
+ * @param age	Age computed for the cache.
+ * @param ways	Number of ways of the projected cache.
+ * @return		Projected age (ways meaning the block is out of the cache).
+ */
+
 
 /**
  * @fn int AgeInfo::wayCount();
  * Get the number of ways of the cache.
  */
 
+/**
+ * @fn AgeInfo::Cursor *AgeInfo::cursor(otawa::Block *v);
+ * Get a cursor on the accesses of block v starting from the state before v.
+ * The cursor has to be deleted once used.
+ * @param v		Walked block.
+ * @return		Cursor on the first access of v.
+ */
+
+/**
+ * @fn AgeInfo::Cursor *AgeInfo::cursor(Edge *e);
+ * Get a cursor on the accesses of the sink of e starting from the state before e.
+ * The cursor has to be deleted once used.
+ * @param e		Edge leading to the walked block.
+ * @return		Cursor on the first access of the sink of e.
+ */
+
+///
+static void walkAges(AgeInfo::Cursor *c, const AccessList& as, AgeInfo::age_fun_t f) {
+	for(const auto& a: as) {
+		switch(a.kind()) {
+		case BLOCK:
+			if(a.block()->id() >= 0)
+				f(a, a.block(), c->age(a.block()));
+			break;
+		case ENUM:
+			for(int i = 0; i < a.blockCount(); i++) {
+				auto b = a.blockAt(i);
+				if(b->id() >= 0)
+					f(a, b, c->age(b));
+			}
+			break;
+		default:
+			break;
+		}
+		c->next();
+	}
+	delete c;
+}
+
+/**
+ * Call the given function for each cached block of each access of v with the
+ * age of the block before the access. The accesses are walked in order and
+ * only once.
+ * @param v		Walked block.
+ * @param f		Function to call.
+ */
+void AgeInfo::ages(otawa::Block *v, age_fun_t f) {
+	walkAges(cursor(v), *ACCESSES(v), f);
+}
+
+/**
+ * Call the given function for each cached block of each access of the sink
+ * of e with the age of the block before the access along e. The accesses
+ * are walked in order and only once.
+ * @param e		Edge leading to the walked block.
+ * @param f		Function to call.
+ */
+void AgeInfo::ages(Edge *e, age_fun_t f) {
+	walkAges(cursor(e), *ACCESSES(e->sink()), f);
+}
+
+
+/**
+ * @class AgeInfo::Cursor
+ * A cursor walks along the accesses of a block and provides the ages of
+ * cache blocks before each access. As each access is applied only once,
+ * walking the accesses of a block is linear in the number of accesses.
+ */
+
+///
+AgeInfo::Cursor::~Cursor() {
+}
+
+/**
+ * @fn int AgeInfo::Cursor::age(const CacheBlock *b);
+ * Get the age of cache block b before the current access.
+ * @param b		Looked cache block.
+ * @return		Age of b.
+ */
+
+/**
+ * @fn void AgeInfo::Cursor::next();
+ * Move to the next access.
+ */
+
 /**
  * @fn  int AgeInfo::age(otawa::Block *b, const Access& a);
  * Get the age of the accessed block.
@@ -673,19 +1214,44 @@ ACS *AgeInfo::acsBefore(Edge *e, int s) {
  * Class denoting a state that can be garbage collected: it provides a virtual
  * mark() function allowing to mark the object as alive depending on its
  * actual class.
+ *
+ * A state also records the set it belongs to: this lets Analysis find the
+ * analyzer of a state to release without any lookup. In the same way, it
+ * records its uses by the solver of its set (see WTOSolver::use()) so that
+ * releasing it needs no lookup.
  * @ingroup dcache
  */
 
+/**
+ * @fn GCState::GCState(int set);
+ * Build a state.
+ * @param set	Set the state belongs to.
+ */
+
 ///
 GCState::~GCState() {
 }
 
+/**
+ * @fn int GCState::set() const;
+ * Get the set the state belongs to.
+ * @return	State set.
+ */
+
 /**
  * @fn void GCState::mark(ListGC& gc);
  * Must be overloaded to provide custom marking of the actual class.
+ * The size passed to the garbage collector must be the actual allocated
+ * size of the state.
  * @param gc	Current garbage collector.
  */
 
+/**
+ * @fn t::size GCState::size() const;
+ * Get the allocated size of the state (used by the statistics of Analysis).
+ * @return	State size in bytes.
+ */
+
 
 /**
  * Compute the actual computable associativity for a cache according to:
@@ -724,12 +1290,61 @@ int actualAssoc(const hard::Cache& cache) {
 MultiAgeInfo::~MultiAgeInfo() {
 }
 
+/**
+ * Free the results of the given set when they are no more needed. This is
+ * only effective if the analysis is lazy (see @ref LAZY): the results
+ * will be computed again if the set is queried again. The default
+ * implementation does nothing.
+ * @param set	Dropped set.
+ */
+void MultiAgeInfo::drop(int set) {
+}
+
 /**
  * @fn int MultiAgeInfo::wayCount();
  * Get the number of ways in the cache.
  * @return	Number of ways.
  */
 
+/**
+ * @fn MultiAgeInfo::Cursor *MultiAgeInfo::cursor(otawa::Block *v);
+ * Get a cursor on the accesses of block v starting from the state before v.
+ * The cursor has to be deleted once used.
+ * @param v		Walked block.
+ * @return		Cursor on the first access of v.
+ */
+
+/**
+ * @fn MultiAgeInfo::Cursor *MultiAgeInfo::cursor(Edge *e);
+ * Get a cursor on the accesses of the sink of e starting from the state before e.
+ * The cursor has to be deleted once used.
+ * @param e		Edge leading to the walked block.
+ * @return		Cursor on the first access of the sink of e.
+ */
+
+
+/**
+ * @class MultiAgeInfo::Cursor
+ * A cursor walks along the accesses of a block and provides the persistence
+ * level of cache blocks before each access.
+ */
+
+///
+MultiAgeInfo::Cursor::~Cursor() {
+}
+
+/**
+ * @fn int MultiAgeInfo::Cursor::level(const CacheBlock *b);
+ * Get the persistence level of cache block b before the current access.
+ * @param b		Looked cache block.
+ * @return		Persistence level of b.
+ */
+
+/**
+ * @fn void MultiAgeInfo::Cursor::next();
+ * Move to the next access.
+ */
+
 /**
  * @fn int MultiAgeInfo::age(Block *b, const Access& a);
  * Get the age of the given access in the loop containing the access.
@@ -791,6 +1406,71 @@ MultiAgeInfo::~MultiAgeInfo() {
  */
 
 
+
+/**
+ * @class ProductInfo
+ * Interface provided by the product of the MUST, MAY and PERS analyses:
+ * the three ages of a cache block are obtained with a single state lookup.
+ * The product also provides the AgeInfo interfaces of
+ * @ref MUST_FEATURE, @ref MAY_FEATURE and @ref PERS_FEATURE.
+ * @ingroup dcache
+ */
+
+///
+ProductInfo::~ProductInfo() {
+}
+
+/**
+ * Free the results of the given set when they are no more needed. This is
+ * only effective if the analysis is lazy (see @ref LAZY): the results
+ * will be computed again if the set is queried again. The default
+ * implementation does nothing.
+ * @param set	Dropped set.
+ */
+void ProductInfo::drop(int set) {
+}
+
+/**
+ * @fn ProductInfo::Cursor *ProductInfo::cursor(otawa::Block *v);
+ * Get a cursor on the accesses of block v starting from the state before v.
+ * The cursor has to be deleted once used.
+ * @param v		Walked block.
+ * @return		Cursor on the first access of v.
+ */
+
+/**
+ * @fn ProductInfo::Cursor *ProductInfo::cursor(Edge *e);
+ * Get a cursor on the accesses of the sink of e starting from the state before e.
+ * The cursor has to be deleted once used.
+ * @param e		Edge leading to the walked block.
+ * @return		Cursor on the first access of the sink of e.
+ */
+
+
+/**
+ * @class ProductInfo::Cursor
+ * A cursor walks along the accesses of a block and provides, through its
+ * views, the MUST, MAY and PERS ages of cache blocks before each access.
+ */
+
+///
+ProductInfo::Cursor::~Cursor() {
+}
+
+/**
+ * @fn AgeInfo::Cursor *ProductInfo::Cursor::view(comp_t c);
+ * Get a view of the cursor for one component of the product. The view
+ * is owned by the cursor (it must not be deleted) and moves with it:
+ * calling next() on the view has no effect.
+ * @param c		Looked component (one of MUST_AGE, MAY_AGE or PERS_AGE).
+ * @return		View on the component.
+ */
+
+/**
+ * @fn void ProductInfo::Cursor::next();
+ * Move to the next access.
+ */
+
 } } // otawa::dcache
 
 otawa::dcache::Plugin otawa_dcache;
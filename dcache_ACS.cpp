@@ -19,6 +19,7 @@
  *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <cstdint>
 #include "otawa/dcache/ACS.h"
 
 namespace otawa { namespace dcache {
@@ -26,18 +27,33 @@ namespace otawa { namespace dcache {
 /**
  * @class ACS
  * Represents an abstract cache state.
+ *
+ * The age array is padded up to a multiple of kernel::WIDTH with BOT ages
+ * so that the kernels of @ref kernels.h can process it by whole vectors.
+ *
+ * The ages are stored inline, after the ACS header: an ACS for N blocks
+ * must be allocated with a size of ACS::size(N) bytes.
  * @ingroup dcache
  */
 
 /**
- * @fn ACS::ACS(int N);
- * Build a non-initialized ACS.
+ * @fn t::size ACS::size(int N);
+ * Get the size in bytes of an ACS for N blocks.
+ * @param N		Cache block count.
+ * @return		ACS size in bytes.
+ */
+
+/**
+ * @fn ACS::ACS(int set, int N);
+ * Build a non-initialized ACS (only the padding is initialized).
+ * @param set	Set of the ACS.
  * @param N		Cache block count.
  */
 
 /**
- * @fn ACS::ACS(int N, age_t a);
+ * @fn ACS::ACS(int set, int N, age_t a);
  * Build an ACS initialized with the given age.
+ * @param set	Set of the ACS.
  * @param N		Cache block count.
  * @param a		Initialization age.
  */
@@ -98,35 +114,259 @@ void ACS::load(int N, io::InStream *in) {
  * @return	0 for equality, <0 if current ACS is less than the given, >0 else.
  */
 bool ACS::equals(int N, ACS *a) {
-	return array::equals(age, a->age, N);
+	return kernel::equals(age, a->age, N);
 }
 
 
 ///
 void ACS::mark(AbstractGC& gc) {
-	gc.mark(this, sizeof(ACS));
+	gc.mark(this, size(n));
 }
 
 
+/**
+ * @class ACSCursor
+ * Implements AgeInfo::Cursor for analyses whose states are ACS.
+ * @ingroup dcache
+ */
+
+
+/**
+ * Hash-consing table of an ACSDomain. The shared ACS are stored in an open
+ * addressing table (linear probing) with their hash. The table is weak:
+ * the ACS are removed when they are freed by the garbage collector.
+ *
+ * The table also contains the memo of the access transfer function: a
+ * direct-mapped cache associating (ACS, access) to the resulting ACS. As it
+ * does not keep its states alive, it is flushed at each collection.
+ */
+class ACSDomain::Table {
+public:
+	static const int MEMO_SIZE = 1024;
+
+	Table(int N): n(N), cnt(0), cap(64) {
+		ents = new entry_t[cap]();
+		flush();
+	}
+
+	~Table() { delete [] ents; }
+
+	ACS *get(ACS *a, t::uint32 h) const {
+		for(int i = h & (cap - 1); ents[i].a != nullptr; i = (i + 1) & (cap - 1))
+			if(ents[i].h == h && kernel::equals(ents[i].a->age, a->age, n))
+				return ents[i].a;
+		return nullptr;
+	}
+
+	void add(ACS *a, t::uint32 h) {
+		if(2 * (cnt + 1) > cap)
+			grow();
+		put(a, h);
+		cnt++;
+	}
+
+	void remove(ACS *a) {
+		int i = kernel::hash(a->age, n) & (cap - 1);
+		while(ents[i].a != a) {
+			if(ents[i].a == nullptr)
+				return;
+			i = (i + 1) & (cap - 1);
+		}
+		// backward shift deletion
+		for(int j = (i + 1) & (cap - 1); ents[j].a != nullptr; j = (j + 1) & (cap - 1)) {
+			int k = ents[j].h & (cap - 1);
+			if(((j - k) & (cap - 1)) >= ((j - i) & (cap - 1))) {
+				ents[i] = ents[j];
+				i = j;
+			}
+		}
+		ents[i].a = nullptr;
+		cnt--;
+	}
+
+	ACS *lookup(const Access& a, ACS *s, int k) const {
+		const auto& m = memos[index(a, s)];
+		return m.s == s && m.a == &a && m.k == k ? m.r : nullptr;
+	}
+
+	void record(const Access& a, ACS *s, ACS *r, int k) {
+		auto& m = memos[index(a, s)];
+		m.s = s;
+		m.a = &a;
+		m.r = r;
+		m.k = k;
+	}
+
+	void flush() {
+		for(int i = 0; i < MEMO_SIZE; i++)
+			memos[i].s = nullptr;
+	}
+
+private:
+	typedef struct entry_t {
+		ACS *a;
+		t::uint32 h;
+	} entry_t;
+
+	typedef struct memo_t {
+		ACS *s;
+		const Access *a;
+		ACS *r;
+		int k;
+	} memo_t;
+
+	inline int index(const Access& a, ACS *s) const {
+		auto k = (t::uint64(reinterpret_cast<std::uintptr_t>(s))
+			^ (t::uint64(reinterpret_cast<std::uintptr_t>(&a)) << 7)) * 0x9e3779b97f4a7c15ULL;
+		return int(k >> 54) & (MEMO_SIZE - 1);
+	}
+
+	void put(ACS *a, t::uint32 h) {
+		int i = h & (cap - 1);
+		while(ents[i].a != nullptr)
+			i = (i + 1) & (cap - 1);
+		ents[i].a = a;
+		ents[i].h = h;
+	}
+
+	void grow() {
+		auto old = ents;
+		int oc = cap;
+		cap *= 2;
+		ents = new entry_t[cap]();
+		for(int i = 0; i < oc; i++)
+			if(old[i].a != nullptr)
+				put(old[i].a, old[i].h);
+		delete [] old;
+	}
+
+	int n, cnt, cap;
+	entry_t *ents;
+	memo_t memos[MEMO_SIZE];
+};
+
+
 /**
  * @class ACSDomain
  * A domain providing basic services to manage ACS.
+ *
+ * If sharing is enabled, the ACS are hash-consed: each distinct ACS is stored
+ * only once and the comparison of states is a pointer comparison. The
+ * sub-classes have to build their results with alloc(), copy() or make()
+ * and to pass them to share() before returning them. In this mode, alloc()
+ * returns a scratch ACS and only the ACS not found in the table are
+ * actually allocated.
+ *
  * @ingroup dcache
  */
 
-///
-ACSDomain::ACSDomain(const SetCollection& collection, int set, int assoc, int top, ListGC& gc_):
+/**
+ * Build an ACS domain.
+ * @param collection	Set collection.
+ * @param set			Set to work on.
+ * @param assoc			Cache associativity.
+ * @param top			Age used to initialize the top state.
+ * @param gc_			Garbage collector to allocate states with.
+ * @param sharing		True to enable hash-consing of ACS.
+ */
+ACSDomain::ACSDomain(const SetCollection& collection, int set, int assoc, int top, ListGC& gc_, bool sharing):
 	Domain(set),
 	coll(collection),
 	gc(gc_),
 	N(coll.blockCount(set)),
 	A(assoc),
 	sumA(assoc * collection.blockCount(set)),
-	BOT(make(ACS::BOT)),
-	TOP(make(top)),
-	os(nullptr)
+	BOT(nullptr),
+	TOP(nullptr),
+	os(nullptr),
+	in(nullptr),
+	table(nullptr),
+	scratch(nullptr)
 {
 	ASSERT(A > 0);
+	BOT = make(ACS::BOT);
+	TOP = make(top);
+	if(sharing) {
+		table = new Table(N);
+		scratch = new(new char[ACS::size(N)]) ACS(S, N);
+		TOP = share(TOP);
+	}
+}
+
+///
+ACSDomain::~ACSDomain() {
+	if(table != nullptr) {
+		delete table;
+		scratch->~ACS();
+		delete [] reinterpret_cast<char *>(scratch);
+	}
+}
+
+/**
+ * @fn bool ACSDomain::isSharing() const;
+ * Test if the hash-consing of ACS is enabled.
+ * @return	True if hash-consing is enabled, false else.
+ */
+
+/**
+ * @fn bool ACSDomain::agesAll(const Access& a);
+ * Test if the given access ages all blocks of the set, that is, if it is
+ * a load or a store to an unknown block (@ref ANY or @ref RANGE access).
+ * A sequence of such accesses is equivalent to a single aging by the length
+ * of the sequence.
+ * @param a		Tested access.
+ * @return		True if a ages all blocks, false else.
+ */
+
+/**
+ * Get the shared ACS equal to the given one. If there is no such ACS,
+ * the given one is recorded as shared (and copied if it is the scratch ACS).
+ * If sharing is disabled, return the given ACS.
+ * @param a		ACS to share.
+ * @return		Shared ACS equal to a.
+ */
+ACS *ACSDomain::share(ACS *a) const {
+	if(table == nullptr || a == BOT)
+		return a;
+	auto h = kernel::hash(a->age, N);
+	auto r = table->get(a, h);
+	if(r != nullptr)
+		return r;
+	if(a == scratch)
+		a = new(gc.allocate(ACS::size(N))) ACS(N, *scratch);
+	table->add(a, h);
+	return a;
+}
+
+/**
+ * Look for a memoized result of the transfer of access a on ACS s.
+ * @param a		Performed access.
+ * @param s		Input ACS.
+ * @param k		Number of accesses of the transfer: more than 1 for a run
+ * 				of accesses to unknown blocks starting with a (see agesAll()).
+ * @return		Memoized result or null.
+ */
+ACS *ACSDomain::memo(const Access& a, ACS *s, int k) const {
+	if(table == nullptr)
+		return nullptr;
+	return table->lookup(a, s, k);
+}
+
+/**
+ * Memoize the result of the transfer of access a on ACS s. As s is the key
+ * of the memo, it must be kept alive, by recording it in in, during the
+ * transfer: else a collection triggered by the transfer could free it and
+ * the memo would record a dangling key.
+ * @param a		Performed access.
+ * @param s		Input ACS.
+ * @param r		Resulting ACS (must be shared).
+ * @param k		Number of accesses of the transfer (see memo()).
+ * @return		r.
+ */
+ACS *ACSDomain::memo(const Access& a, ACS *s, ACS *r, int k) const {
+	if(table != nullptr)
+		table->record(a, s, r, k);
+	return r;
 }
 
 
@@ -148,7 +388,7 @@ ai::State *ACSDomain::entry() {
 ///
 bool ACSDomain::equals(ai::State *_1, ai::State *_2) {
 	auto s1 = acs(_1), s2 = acs(_2);
-	if(s1 == BOT || s2 == BOT)
+	if(s1 == BOT || s2 == BOT || table != nullptr)
 		return s1 == s2;
 	else
 		return s1->equals(N, s2);
@@ -181,21 +421,47 @@ bool ACSDomain::implementsIO() {
 
 ///
 void ACSDomain::save(ai::State *s, io::OutStream *out) {
-	acs(s)->save(N, out);
+	// BOT and TOP are saved as a tag to retain their identity
+	t::uint8 tag = s == BOT ? 0 : s == TOP ? 1 : 2;
+	if(out->write(reinterpret_cast<const char *>(&tag), sizeof(tag)) != sizeof(tag))
+		throw io::IOException(out->lastErrorMessage());
+	if(tag == 2)
+		acs(s)->save(N, out);
 }
 
+///
 ai::State *ACSDomain::load(io::InStream *in) {
-	auto s = new(gc.alloc<ACS>()) ACS(N);
+	t::uint8 tag;
+	if(in->read(&tag, sizeof(tag)) != sizeof(tag))
+		throw io::IOException(in->lastErrorMessage());
+	if(tag == 0)
+		return BOT;
+	else if(tag == 1)
+		return TOP;
+	auto s = alloc();
 	s->load(N, in);
-	return s;
+	return share(s);
 }
 
 ///
 void ACSDomain::collect(ai::state_collector_t f) {
-	if(os != nullptr)
+	if(os != nullptr && os != scratch)
 		f(os);
+	if(in != nullptr)
+		f(in);
 	f(BOT);
 	f(TOP);
+	if(table != nullptr)
+		table->flush();
+}
+
+///
+void ACSDomain::clean(GCState *s) {
+	if(table != nullptr) {
+		auto a = dynamic_cast<ACS *>(s);
+		if(a != nullptr)
+			table->remove(a);
+	}
 }
 
 } }	// otawa::dcache
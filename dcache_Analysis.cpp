@@ -19,7 +19,14 @@
  *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <thread>
 #include "otawa/dcache/Analysis.h"
+#include "otawa/dcache/Solver.h"
+#include "otawa/dcache/Store.h"
 #include <elm/alloc/ListGC.h>
 #include <otawa/ai/CFGAnalyzer.h>
 
@@ -39,8 +46,46 @@ namespace otawa { namespace dcache {
  * This function is purely virtual and must be overridden to perform
  * a particular analysis.
  *
+ * As the sets are independent, their fixpoints can be computed in parallel
+ * (see @ref THREAD_COUNT). To support this, each set owns its own
+ * garbage collector, obtained by gcFor(), that the domains must use to allocate
+ * their states. The states allocated in this collector must be @ref GCState.
+ *
+ * The query functions (before(), after(), at(), release() and the cursors)
+ * may be called from several threads: the states of each set are protected
+ * by a lock of the set and a state retrieves its set by itself at release time.
+ *
  * @par Configuration
  *	* @ref ONLY_SET -- select the set to work on (do not process other sets, multiple accepted).
+ *	* @ref THREAD_COUNT -- number of threads used to compute the set fixpoints.
+ *	* @ref HASH_CONSING -- share the identical states (if supported by the domain).
+ *	* @ref RESULT_CACHE -- directory to store the results in and to reload them from.
+ *	* @ref INCREMENTAL -- reuse the stored results of the sets not changed since the previous run.
+ *	* @ref SHARD_COUNT -- number of shards the sets are split in (used with @ref RESULT_CACHE).
+ *	* @ref SHARD -- shard to compute (the shards are merged if not given).
+ *	* @ref LAZY -- compute the fixpoint of a set only when it is first queried.
+ *	* @ref WTO_ORDER -- iterate the fixpoints along a weak topological order.
+ *	* @ref SKIP_CALLS -- pass through the calls to functions not touching the set (implies @ref WTO_ORDER).
+ *	* @ref STREAM -- streaming mode of the builders (implies @ref LAZY).
+ *	* @ref STATS -- collect statistics on the computation of each set.
+ *	* @ref STATS_DUMP -- dump the statistics as JSON instead of the states.
+ *
+ * In lazy mode, processWorkSpace() does not compute any fixpoint: the
+ * fixpoint of a set is computed, and memoized, the first time a state
+ * of this set is asked for. The results of a set that is no more needed
+ * can be freed with drop(): they will be computed again if the set is queried
+ * again.
+ *
+ * In sharded mode (see @ref SHARD_COUNT), the sets are split in ranges
+ * analyzed by different runs, possibly on different nodes sharing
+ * the @ref RESULT_CACHE directory. A run given a @ref SHARD computes the sets
+ * of its range and saves them in a shard file (the other sets are computed
+ * on demand, as in lazy mode). A run without @ref SHARD maps the shard files
+ * and provides their sets as if they were computed locally: the sets missing
+ * from the shards are computed and the merged results are saved as usual.
+ *
+ * The statistics (see @ref Statistics) are available from statistics() and
+ * through the @ref STATISTICS property of the workspace.
  *
  * @ingroup dcache
  */
@@ -58,14 +103,246 @@ p::declare Analysis::reg = p::init("otawa::dcache::Analysis", Version(1, 0, 0))
 p::id<int> ONLY_SET("otawa::dcache::ONLY_SET");
 
 
+/**
+ * This property is a configuration of Analysis. It gives the number of
+ * threads used to compute the fixpoints of the sets: 1 (default) processes
+ * the sets sequentially, 0 uses as many threads as available cores.
+ * It is also used by CLPAccessBuilder to build the accesses of the blocks
+ * (the calls to the CLP manager remaining serialized) and by the category
+ * and event builders to classify the accesses, the results being the same
+ * as with one thread.
+ */
+p::id<int> THREAD_COUNT("otawa::dcache::THREAD_COUNT", 1);
+
+
+/**
+ * This property is a configuration of Analysis. If set to true, the domains
+ * supporting it store each distinct state only once, making the state
+ * comparison a pointer comparison, and memoize their transfer function
+ * (default false).
+ */
+p::id<bool> HASH_CONSING("otawa::dcache::HASH_CONSING", false);
+
+
+/**
+ * This property is a configuration of Analysis. It gives a directory where
+ * the analysis results are stored (see @ref Store). If the results of the
+ * same analysis, applied to the same program with the same cache, are found
+ * in this directory, they are reloaded instead of being computed. Else they
+ * are saved after computation. The domains must implement IO.
+ */
+p::id<sys::Path> RESULT_CACHE("otawa::dcache::RESULT_CACHE", sys::Path());
+
+
+/**
+ * This property is a configuration of Analysis used with @ref RESULT_CACHE.
+ * If set to true, the results are stored in a single file per analysis,
+ * replaced at each run, instead of one file per analyzed program. When the
+ * program changed since the previous run, the results of the sets whose
+ * cache blocks and accesses did not change are reused from this file
+ * and only the fixpoints of the other sets are computed (default false).
+ * The CFG structure must be unchanged, else all sets are computed.
+ */
+p::id<bool> INCREMENTAL("otawa::dcache::INCREMENTAL", false);
+
+
+/**
+ * This property is a configuration of Analysis used with @ref RESULT_CACHE.
+ * It gives the number of shards the sets are split in (default 0, no
+ * sharding). The shard i of N contains the sets of the range
+ * [i * S / N, (i + 1) * S / N[ with S the number of sets. The shards are
+ * computed by the runs configured with @ref SHARD and merged by a run without
+ * @ref SHARD.
+ */
+p::id<int> SHARD_COUNT("otawa::dcache::SHARD_COUNT", 0);
+
+
+/**
+ * This property is a configuration of Analysis used with @ref SHARD_COUNT.
+ * It gives the index of the shard computed and saved by the run, in
+ * [0, SHARD_COUNT[ (default -1, the shards are merged).
+ */
+p::id<int> SHARD("otawa::dcache::SHARD", -1);
+
+
+/**
+ * This property is a configuration of Analysis. If set to true, the fixpoint
+ * of a set is not computed when the analysis is run but the first time
+ * a state of the set is queried, so that a consumer looking only to some sets
+ * pays only for these sets (default false).
+ */
+p::id<bool> LAZY("otawa::dcache::LAZY", false);
+
+
+/**
+ * This property is a configuration of Analysis. If set to true, the fixpoints
+ * are computed by iterating along a weak topological order of the blocks
+ * (see @ref WTO and @ref WTOSolver) instead of the generic worklist of
+ * ai::CFGAnalyzer: the innermost loops are stabilized before their results
+ * are propagated outward. The resulting states are the same. With @ref STATS,
+ * the evaluations saved because no input of a block changed are counted
+ * in @ref SetStats::saved.
+ */
+p::id<bool> WTO_ORDER("otawa::dcache::WTO_ORDER", false);
+
+
+/**
+ * This property is a configuration of Analysis. If set to true, when the
+ * fixpoint of a set is computed, the calls to functions that do not touch
+ * the set, directly or through the functions they call (see @ref Footprint),
+ * are passed through instead of propagating the state into the callee
+ * (default false). This avoids iterating the body of such functions
+ * and, as the analysis is context-insensitive, improves the precision
+ * after these calls. It implies @ref WTO_ORDER and @ref FOOTPRINT_FEATURE
+ * is required.
+ */
+p::id<bool> SKIP_CALLS("otawa::dcache::SKIP_CALLS", false);
+
+
+/**
+ * This property is a configuration of Analysis. If set to true, statistics
+ * are collected for each set (see @ref Statistics). When not set (default),
+ * the collection costs only a test at each garbage collection.
+ */
+p::id<bool> STATS("otawa::dcache::STATS", false);
+
+
+/**
+ * This property is a configuration of Analysis. If set to true (and if
+ * @ref STATS is set), the dump of the analysis outputs the statistics in
+ * JSON instead of the states (default false).
+ */
+p::id<bool> STATS_DUMP("otawa::dcache::STATS_DUMP", false);
+
+
+/**
+ * This property, hooked to the workspace, gives the statistics of the
+ * analyses performed with @ref STATS configuration and not yet destroyed.
+ *
+ * @par Hooks
+ * * @ref WorkSpace
+ */
+p::id<Vector<const Statistics *> *> STATISTICS("otawa::dcache::STATISTICS", nullptr);
+
+
+/**
+ * Garbage collection manager of a set: it marks only the states of this set.
+ */
+class Analysis::SetGC: public GCManager {
+public:
+	SetGC(Analysis& analysis, int set, SetStats *stats = nullptr):
+		_ana(analysis), _set(set), st(stats), gc(*this) { }
+
+	void collect(AbstractGC& agc) override {
+		if(st != nullptr)
+			st->collections++;
+		_ana.collect(_set, [&](ai::State *s) { static_cast<GCState *>(s)->mark(agc); });
+	}
+
+	void clean(void *p) override {
+		auto s = static_cast<GCState *>(p);
+		if(st != nullptr) {
+			st->reclaimed_states++;
+			st->reclaimed_bytes += s->size();
+		}
+		if(_ana.doms[_set] != nullptr)
+			_ana.doms[_set]->clean(s);
+		s->~GCState();
+	}
+
+private:
+
+	// collector counting the allocations
+	class GC: public ListGC {
+	public:
+		GC(SetGC& manager): ListGC(manager), m(manager) { }
+		void *allocate(t::size size) override {
+			if(m.st != nullptr) {
+				m.st->states++;
+				m.st->allocated_bytes += size;
+			}
+			return ListGC::allocate(size);
+		}
+	private:
+		SetGC& m;
+	};
+
+	Analysis& _ana;
+	int _set;
+	SetStats *st;
+public:
+	GC gc;
+};
+
+
+/**
+ * Domain wrapper counting the calls performed by the analyzer
+ * (only used when statistics are collected).
+ */
+class Analysis::StatDomain: public ai::Domain {
+public:
+	StatDomain(Domain& domain, SetStats& stats): d(domain), st(stats) { }
+	ai::State *bot() override { return d.bot(); }
+	ai::State *top() override { return d.top(); }
+	ai::State *entry() override { return d.entry(); }
+	bool equals(ai::State *s1, ai::State *s2) override
+		{ st.iterations++; return d.equals(s1, s2); }
+	ai::State *join(ai::State *s1, ai::State *s2) override
+		{ st.joins++; return d.join(s1, s2); }
+	ai::State *update(Edge *e, ai::State *s) override
+		{ st.edge_updates++; return d.update(e, s); }
+	ai::State *update(otawa::Block *v, ai::State *s) override
+		{ st.block_updates++; return d.update(v, s); }
+	bool implementsPrinting() override { return d.implementsPrinting(); }
+	void print(ai::State *s, io::Output& out) override { d.print(s, out); }
+	bool implementsIO() override { return d.implementsIO(); }
+	void save(ai::State *s, io::OutStream *out) override { d.save(s, out); }
+	ai::State *load(io::InStream *in) override { return d.load(in); }
+	bool implementsCodePrinting() override { return d.implementsCodePrinting(); }
+	void printCode(otawa::Block *b, io::Output& out) override { d.printCode(b, out); }
+private:
+	Domain& d;
+	SetStats& st;
+};
+
+
 ///
-Analysis::Analysis(p::declare& reg): Processor(reg), coll(nullptr), cfgs(nullptr), n(0) { }
+Analysis::Analysis(p::declare& reg):
+	Processor(reg), coll(nullptr), cfgs(nullptr), n(0), thread_count(1), hash_consing(false), locks(nullptr), store(nullptr),
+	stats_on(false), stats_dump(false), stats(nullptr), lazy(false), wto_order(false), wto(nullptr), skip_calls(false), incremental(false),
+	shard_count(0), shard(-1) { }
 
 ///
 void Analysis::configure(const PropList& props) {
 	Processor::configure(props);
 	for(auto s: ONLY_SET.all(props))
 		only_sets.add(s);
+	hash_consing = HASH_CONSING(props);
+	store_dir = RESULT_CACHE(props);
+	incremental = INCREMENTAL(props);
+	stats_on = STATS(props);
+	stats_dump = STATS_DUMP(props);
+	shard_count = store_dir.isEmpty() ? 0 : max(0, SHARD_COUNT(props));
+	shard = shard_count == 0 ? -1 : SHARD(props);
+	if(shard >= shard_count)
+		shard = -1;
+	lazy = LAZY(props) || STREAM(props) > 0 || shard >= 0;
+	skip_calls = SKIP_CALLS(props);
+	wto_order = WTO_ORDER(props) || skip_calls;
+	thread_count = THREAD_COUNT(props);
+	if(thread_count <= 0)
+		thread_count = max(1, int(std::thread::hardware_concurrency()));
+}
+
+/**
+ * Get a tag identifying the format of the states saved by the domains of the
+ * analysis. It is part of the keys of the stored results and must change
+ * whenever the domains obtained from domainFor() change their save() / load()
+ * format. As a default, returns 0.
+ * @return	Format tag of the saved states.
+ */
+t::uint32 Analysis::format() const {
+	return 0;
 }
 
 /**
@@ -88,22 +365,57 @@ void Analysis::setup(WorkSpace *ws) {
 	cfgs = COLLECTED_CFG_FEATURE.get(ws);
 	ASSERT(cfgs);
 	n = coll->cache().setCount();
+	if(skip_calls)
+		ws->require(FOOTPRINT_FEATURE);
 
-	// initialize domains
+	// initialize garbage collectors and domains
+	locks = new std::mutex[n];
+	if(stats_on)
+		stats = new Statistics(name(), n);
+	gcs.set(n, new SetGC *[n]);
 	doms.set(n, new Domain *[n]);
-	for(int i = 0; i < n; i++)
-		if(coll->blockCount(i) != 0)
+	anas.set(n, new Solver *[n]);
+	sdoms.set(n, new StatDomain *[n]);
+	computed.set(n, new bool[n]);
+	for(int i = 0; i < n; i++) {
+		computed[i] = false;
+		gcs[i] = nullptr;
+		doms[i] = nullptr;
+		anas[i] = nullptr;
+		sdoms[i] = nullptr;
+		if(coll->blockCount(i) != 0) {
+			gcs[i] = new SetGC(*this, i, stats == nullptr ? nullptr : &stats->at(i));
 			doms[i] = domainFor(*coll, i);
-		else
-			doms[i] = nullptr;
+		}
+	}
 
 	// initialize analyzers
-	anas.set(n, new ai::CFGAnalyzer *[n]);
+	if(wto_order) {
+		wto = new WTO(*cfgs);
+		if(logFor(LOG_FUN))
+			log << "\tWTO with " << wto->componentCount() << " components\n";
+	}
 	for(int i = 0; i < n; i++)
-		if(doms[i] == nullptr)
-			anas[i] = nullptr;
-		else
-			anas[i] = new ai::CFGAnalyzer(*this, *doms[i]);
+		if(doms[i] != nullptr) {
+			if(stats != nullptr)
+				sdoms[i] = new StatDomain(*doms[i], stats->at(i));
+			anas[i] = makeSolver(i);
+		}
+}
+
+/**
+ * Build the solver computing the fixpoint of a set.
+ * @param set	Set to build the solver for.
+ * @return		Built solver.
+ */
+Solver *Analysis::makeSolver(int set) {
+	ai::Domain *dom = doms[set];
+	if(sdoms[set] != nullptr)
+		dom = sdoms[set];
+	if(wto != nullptr)
+		return new WTOSolver(*wto, *dom, stats == nullptr ? nullptr : &stats->at(set), skip_calls ? set : -1);
+	else
+		return new CFGSolver(*this, *dom);
 }
 
 
@@ -115,9 +427,8 @@ void Analysis::setup(WorkSpace *ws) {
  * @return		State in set s before edge e.
  */
 ai::State *Analysis::before(Edge *e, int s) {
-	auto r = anas[s]->before(e);
-	uses.put(r, s);
-	return r;
+	std::lock_guard<std::mutex> lock(locks[s]);
+	return stateBefore(e, s);
 }
 
 /**
@@ -128,9 +439,8 @@ ai::State *Analysis::before(Edge *e, int s) {
  * @return		State in set s after edge e.
  */
 ai::State *Analysis::after(Edge *e, int s) {
-	auto r = anas[s]->after(e);
-	uses.put(r, s);
-	return r;
+	std::lock_guard<std::mutex> lock(locks[s]);
+	return stateAfter(e, s);
 }
 
 /**
@@ -141,9 +451,8 @@ ai::State *Analysis::after(Edge *e, int s) {
  * @return		State in set s before block v.
  */
 ai::State *Analysis::before(otawa::Block *v, int s) {
-	auto r = anas[s]->before(v);
-	uses.put(r, s);
-	return r;
+	std::lock_guard<std::mutex> lock(locks[s]);
+	return stateBefore(v, s);
 }
 
 /**
@@ -154,98 +463,486 @@ ai::State *Analysis::before(otawa::Block *v, int s) {
  * @return		State in set s after block v.
  */
 ai::State *Analysis::after(otawa::Block *v, int s) {
-	auto r = anas[s]->after(v);
-	uses.put(r, s);
-	return r;
+	std::lock_guard<std::mutex> lock(locks[s]);
+	return stateAfter(v, s);
 }
 
 /**
  * Get the state before the execution of the access a in the block v for the set
  * touched by a. a must be an access contained in v.
  * The returned state s must be fried by a call to release().
+ *
+ * To get the states of several accesses of the same block, a Cursor
+ * is more efficient.
  * @param v		Concerned block.
  * @param a		Looked access.
  * @param set	Set of interest.
  * @return		State before a.
  */
 ai::State *Analysis::at(otawa::Block *v, const Access& a, int set) {
-	return at(v, a, before(v, set), set);
+	Cursor c(*this, v, set);
+	return at(c, a, set);
 }
 
 /**
  * Get the state before the execution of the access a along the edge e for the
  * set touched by a. a must be an access contained in the sink of e.
  * The returned state s must be fried by a call to release().
+ *
+ * To get the states of several accesses of the same block, a Cursor
+ * is more efficient.
  * @param e		Concerned edge.
  * @param a		Looked access.
  * @param set	Set of interest.
  * @return		State before a.
  */
 ai::State *Analysis::at(Edge *e, const Access& a, int set) {
-	return at(e->sink(), a, before(e, set), set);
+	Cursor c(*this, e, set);
+	return at(c, a, set);
 }
 
 ///
-ai::State *Analysis::at(otawa::Block *v, const Access& a, ai::State *s, int S) {
-	auto cs = s;
-	for(const auto &b: *ACCESSES(v)) {
-		if(&a == &b)
-			return cs;
-		if(b.access(S)) {
-			auto ns = doms[S]->update(a, s);
-			if(ns != cs) {
-				if(cs != s)
-					anas[S]->release(cs);
-				uses.remove(cs);
-				cs = ns;
-				anas[S]->use(cs);
-				uses.put(cs, S);
-			}
+ai::State *Analysis::at(Cursor& c, const Access& a, int S) {
+	while(!c.ended()) {
+		if(&c.access() == &a) {
+			auto r = c.state();
+			std::lock_guard<std::mutex> lock(locks[S]);
+			anas[S]->use(r);
+			return r;
 		}
+		c.next();
 	}
-	ASSERTP(false, "access " << a << " not in block " << v);
+	ASSERTP(false, "access " << a << " not in block");
 	return nullptr;
 }
 
+// Get the state before v, from the store or the analyzer (the state is used).
+ai::State *Analysis::stateBefore(otawa::Block *v, int set) {
+	if(!isStored(set)) {
+		ensure(set);
+		return anas[set]->before(v);
+	}
+	auto r = store->before(v, set);
+	anas[set]->use(r);
+	return r;
+}
+
+// Get the state before e, from the store or the analyzer (the state is used).
+ai::State *Analysis::stateBefore(Edge *e, int set) {
+	if(!isStored(set)) {
+		ensure(set);
+		return anas[set]->before(e);
+	}
+	auto r = store->after(e->source(), set);
+	anas[set]->use(r);
+	return r;
+}
+
+// Get the state after v, from the store or the analyzer (the state is used).
+ai::State *Analysis::stateAfter(otawa::Block *v, int set) {
+	if(!isStored(set)) {
+		ensure(set);
+		return anas[set]->after(v);
+	}
+	auto r = store->after(v, set);
+	anas[set]->use(r);
+	return r;
+}
+
+// Get the state after e, from the store or the analyzer (the state is used).
+ai::State *Analysis::stateAfter(Edge *e, int set) {
+	if(!isStored(set)) {
+		ensure(set);
+		return anas[set]->after(e);
+	}
+	auto r = store->after(e, set);
+	anas[set]->use(r);
+	return r;
+}
+
+// In lazy mode, compute the fixpoint of the set if not already done
+// (the lock of the set must be held).
+inline void Analysis::ensure(int set) {
+	if(lazy && !computed[set]) {
+		process(workspace(), set);
+		computed[set] = true;
+	}
+}
+
+/**
+ * In lazy mode, free the results of the given set: its fixpoint will be
+ * computed again if one of its states is queried. No state of the set
+ * must be used (not released) when this function is called. In non-lazy
+ * mode, this function does nothing.
+ * @param set	Set to drop.
+ */
+void Analysis::drop(int set) {
+	ASSERT(0 <= set && set < n);
+	if(!lazy || isStored(set))
+		return;
+	std::lock_guard<std::mutex> lock(locks[set]);
+	if(!computed[set] || anas[set] == nullptr)
+		return;
+	delete anas[set];
+	anas[set] = makeSolver(set);
+	gcs[set]->gc.runGC();
+	computed[set] = false;
+	if(logFor(LOG_FUN)) {
+		std::lock_guard<std::mutex> lock(log_mutex);
+		log << "	SET " << set << " dropped\n";
+	}
+}
+
+/**
+ * @fn bool Analysis::isLazy() const;
+ * Test if the analysis works in lazy mode (see @ref LAZY).
+ * @return	True if the analysis is lazy, false else.
+ */
+
+// Test if the results of the set come from the store.
+inline bool Analysis::isStored(int set) const {
+	return store != nullptr && store->isLoaded(set);
+}
+
 /**
  * Free a state previously allocated by one of function before(), after()
  * or at().
  * @param s		State to release.
  */
 void Analysis::release(ai::State *s) {
-	int S = uses.get(s, -1);
-	ASSERT(S >= 0);
+	int S = static_cast<GCState *>(s)->set();
+	ASSERT(0 <= S && S < n);
+	std::lock_guard<std::mutex> lock(locks[S]);
 	anas[S]->release(s);
 }
 
+/**
+ * Mark a state as used: it will not be freed until it is passed to
+ * release(). This is useful to keep alive a part of a state returned
+ * by before(), after() or at().
+ * @param s		State to use.
+ */
+void Analysis::use(ai::State *s) {
+	int S = static_cast<GCState *>(s)->set();
+	ASSERT(0 <= S && S < n);
+	std::lock_guard<std::mutex> lock(locks[S]);
+	anas[S]->use(s);
+}
+
+/**
+ * @class Analysis::Cursor
+ * A cursor walks along the accesses of a block and provides, for one set,
+ * the state before each access. Each access is applied only once to the state
+ * making a walk linear in the number of accesses of the block.
+ *
+ * The cursor owns its current state: it has not to be released.
+ */
+
+/**
+ * Build a cursor on the accesses of the given block starting from the
+ * state before the block.
+ * @param analysis	Analysis to get the states from.
+ * @param v			Walked block.
+ * @param set		Set of interest.
+ */
+Analysis::Cursor::Cursor(Analysis& analysis, otawa::Block *v, int set):
+	ana(analysis), as(*ACCESSES(v)), S(set), i(0), s(nullptr)
+{
+	std::lock_guard<std::mutex> lock(ana.locks[S]);
+	s = ana.stateBefore(v, set);
+}
+
+/**
+ * Build a cursor on the accesses of the sink of the given edge starting from
+ * the state before the edge.
+ * @param analysis	Analysis to get the states from.
+ * @param e			Edge leading to the walked block.
+ * @param set		Set of interest.
+ */
+Analysis::Cursor::Cursor(Analysis& analysis, Edge *e, int set):
+	ana(analysis), as(*ACCESSES(e->sink())), S(set), i(0), s(nullptr)
+{
+	std::lock_guard<std::mutex> lock(ana.locks[S]);
+	s = ana.stateBefore(e, set);
+}
+
+///
+Analysis::Cursor::~Cursor() {
+	std::lock_guard<std::mutex> lock(ana.locks[S]);
+	ana.anas[S]->release(s);
+}
+
+/**
+ * @fn bool Analysis::Cursor::ended() const;
+ * Test if the end of the accesses has been reached.
+ * @return	True if there is no more access, false else.
+ */
+
+/**
+ * @fn const Access& Analysis::Cursor::access() const;
+ * Get the current access.
+ * @return	Current access.
+ * @warning	Only valid if the cursor is not ended.
+ */
+
+/**
+ * @fn int Analysis::Cursor::index() const;
+ * Get the index of the current access in the block.
+ * @return	Current access index.
+ */
+
+/**
+ * @fn ai::State *Analysis::Cursor::state() const;
+ * Get the state before the current access.
+ * @return	State before the current access.
+ */
+
+/**
+ * Apply the current access to the state and move to the next access.
+ */
+void Analysis::Cursor::next() {
+	const auto& a = as[i];
+	if(a.access(S) && !a.isHit()) {
+		std::lock_guard<std::mutex> lock(ana.locks[S]);
+		auto ns = ana.doms[S]->update(a, s);
+		if(ns != s) {
+			ana.anas[S]->use(ns);
+			ana.anas[S]->release(s);
+			s = ns;
+		}
+	}
+	i++;
+}
+
+/**
+ * Move the cursor up to the access of the given index.
+ * @param index		Index of the access to move to (must be greater or equal
+ * 					to the current index).
+ */
+void Analysis::Cursor::moveTo(int index) {
+	ASSERT(index <= as.count());
+	while(i < index)
+		next();
+}
+
+
+/**
+ * @class Analysis::BlockCursor
+ * A block cursor walks along the accesses of a block and provides, for any set,
+ * the state before the current access. The per-set states are only computed
+ * when they are looked for: each set is then walked only once.
+ */
+
+/**
+ * Build a block cursor on the accesses of the given block.
+ * @param analysis	Analysis to get the states from.
+ * @param v			Walked block.
+ */
+Analysis::BlockCursor::BlockCursor(Analysis& analysis, otawa::Block *v):
+	ana(analysis), v(v), e(nullptr), i(0)
+	{ }
+
+/**
+ * Build a block cursor on the accesses of the sink of the given edge.
+ * @param analysis	Analysis to get the states from.
+ * @param e			Edge leading to the walked block.
+ */
+Analysis::BlockCursor::BlockCursor(Analysis& analysis, Edge *e):
+	ana(analysis), v(e->sink()), e(e), i(0)
+	{ }
+
+///
+Analysis::BlockCursor::~BlockCursor() {
+	for(auto c: curs)
+		delete c;
+}
+
+/**
+ * Get the state of the given set before the current access.
+ * The returned state is owned by the cursor and has not to be released.
+ * @param set	Looked set.
+ * @return		State before the current access.
+ */
+ai::State *Analysis::BlockCursor::state(int set) {
+	auto c = curs.get(set, nullptr);
+	if(c == nullptr) {
+		if(e != nullptr)
+			c = new Cursor(ana, e, set);
+		else
+			c = new Cursor(ana, v, set);
+		curs.put(set, c);
+	}
+	c->moveTo(i);
+	return c->state();
+}
+
+/**
+ * @fn void Analysis::BlockCursor::next();
+ * Move to the next access.
+ */
+
+/**
+ * @fn int Analysis::BlockCursor::index() const;
+ * Get the index of the current access.
+ * @return	Current access index.
+ */
+
+
 ///
 void Analysis::destroy(WorkSpace *ws) {
 
+	// cleanup the store
+	if(store != nullptr) {
+		delete store;
+		store = nullptr;
+	}
+
 	// cleanup analyzers
 	for(int i = 0; i < n; i++)
 		if(anas[i] != nullptr)
 			delete anas[i];
+	if(wto != nullptr) {
+		delete wto;
+		wto = nullptr;
+	}
 
 	// cleanup domains
-	for(int i = 0; i < n; i++)
+	for(int i = 0; i < n; i++) {
+		if(sdoms[i] != nullptr)
+			delete sdoms[i];
 		if(doms[i] != nullptr)
 			delete doms[i];
+	}
+
+	// cleanup garbage collectors
+	for(int i = 0; i < n; i++)
+		if(gcs[i] != nullptr)
+			delete gcs[i];
+	delete [] locks;
+	locks = nullptr;
+
+	// cleanup the statistics
+	if(stats != nullptr) {
+		auto l = STATISTICS(ws);
+		if(l != nullptr) {
+			int i = l->indexOf(stats);
+			if(i >= 0)
+				l->removeAt(i);
+			if(l->isEmpty()) {
+				delete l;
+				STATISTICS(ws).remove();
+			}
+		}
+		delete stats;
+		stats = nullptr;
+	}
+}
+
+///
+void Analysis::cleanup(WorkSpace *ws) {
+	for(int i = 0; i < n; i++)
+		if(gcs[i] != nullptr)
+			gcs[i]->gc.runGC();
+	Processor::cleanup(ws);
 }
 
+/**
+ * Get the garbage collector to allocate the states of the given set.
+ * @param set	Concerned set.
+ * @return		Set garbage collector.
+ */
+ListGC& Analysis::gcFor(int set) {
+	ASSERT(gcs[set] != nullptr);
+	return gcs[set]->gc;
+}
+
+/**
+ * @fn bool Analysis::hashConsing() const;
+ * Test if hash-consing of states is required (see @ref HASH_CONSING).
+ * @return	True if hash-consing is required, false else.
+ */
+
 ///
 void Analysis::process(WorkSpace *ws, int set) {
 	if(logFor(LOG_FUN)) {
+		std::lock_guard<std::mutex> lock(log_mutex);
 		log << "\tSET " << set << io::endl;
 		if(anas[set] == nullptr)
 			log << "\t\tempty\n";
 	}
-	if(anas[set] != nullptr)
+	if(anas[set] == nullptr)
+		return;
+	if(stats == nullptr)
 		anas[set]->process();
+	else {
+		auto& st = stats->at(set);
+		auto start = std::chrono::steady_clock::now();
+		anas[set]->process();
+		st.time = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+		st.analyzed = true;
+		if(logFor(LOG_FUN)) {
+			std::lock_guard<std::mutex> lock(log_mutex);
+			log << "\t\tSET " << set << ": " << st.iterations << " iterations, "
+				<< st.states << " states, " << st.collections << " GCs, ";
+			if(wto != nullptr)
+				log << st.saved << " saved evaluations, ";
+			log << st.time << "us\n";
+		}
+	}
+}
+
+/**
+ * Compute the fixpoints of the given sets using several threads.
+ * The sets are sorted by decreasing block count so that the heaviest
+ * sets are started first and each idle thread picks the next set
+ * in this order.
+ * @param ws	Current workspace.
+ * @param sets	Sets to process.
+ */
+void Analysis::processParallel(WorkSpace *ws, const Vector<int>& sets) {
+
+	// sort the sets, heaviest first
+	Vector<int> order(sets);
+	std::stable_sort(&order[0], &order[0] + order.length(), [&](int s1, int s2)
+		{ return coll->blockCount(s1) > coll->blockCount(s2); });
+
+	// run the workers
+	std::atomic<int> next(0);
+	std::exception_ptr failure;
+	std::mutex failure_mutex;
+	auto worker = [&]() {
+		for(int i = next++; i < order.length(); i = next++) {
+			try {
+				process(ws, order[i]);
+			}
+			catch(...) {
+				std::lock_guard<std::mutex> lock(failure_mutex);
+				if(!failure)
+					failure = std::current_exception();
+				next = order.length();
+			}
+		}
+	};
+	Vector<std::thread *> threads;
+	for(int i = 1; i < min(thread_count, order.length()); i++)
+		threads.add(new std::thread(worker));
+	worker();
+	for(auto t: threads) {
+		t->join();
+		delete t;
+	}
+
+	// propagate the failure, if any
+	if(failure)
+		std::rethrow_exception(failure);
 }
 
 ///
 void Analysis::dump(WorkSpace *ws, Output& out) {
-	if(only_sets)
+	if(stats != nullptr && stats_dump)
+		stats->dump(out);
+	else if(only_sets)
 		for(auto s: only_sets)
 			if(s < 0 || s >= coll->setCount())
 				log << "ERROR: ignoring invalid set number: " << s << io::endl;
@@ -265,7 +962,7 @@ void Analysis::dump(WorkSpace *ws, int set, Output& out) {
 		out << "\tCFG " << g << io::endl;
 		for(auto b: *g) {
 			out << "\t\t" << b << ": ";
-			auto s = anas[set]->after(b);
+			auto s = stateAfter(b, set);
 			doms[set]->print(s, out);
 			anas[set]->release(s);
 			out << io::endl;
@@ -279,26 +976,141 @@ void Analysis::dump(WorkSpace *ws, int set, Output& out) {
  * @param f		Function to call with each state.
  */
 void Analysis::collect(ai::state_collector_t f) {
-	for(auto d: doms)
-		if(d != nullptr)
-			d->collect(f);
-	for(auto a: anas)
-		if(a != nullptr)
-			a->collect(f);
+	for(int i = 0; i < n; i++)
+		collect(i, f);
+}
+
+/**
+ * Call it to collect all states of the given set stored in the analysis.
+ * @param set	Concerned set.
+ * @param f		Function to call with each state.
+ */
+void Analysis::collect(int set, ai::state_collector_t f) {
+	if(doms[set] != nullptr)
+		doms[set]->collect(f);
+	if(anas[set] != nullptr)
+		anas[set]->collect(f);
+	if(store != nullptr)
+		store->collect(set, f);
 }
 
 ///
 void Analysis::processWorkSpace(WorkSpace *ws) {
-	if(only_sets)
+
+	// look for stored results
+	sys::Path path;
+	t::uint64 key = 0;
+	if(!store_dir.isEmpty() && !only_sets) {
+		// passing through the calls changes the results, the domains the state format
+		t::uint64 config = (skip_calls ? 1 : 0) | (t::uint64(format()) << 1);
+		key = Store::key(name(), *cfgs, *coll, config);
+		if(shard >= 0)
+			path = shardPath(shard, key);
+		else if(incremental)
+			path = store_dir / (_ << name() << ".dcr");
+		else
+			path = store_dir / (_ << name() << '-' << key << ".dcr");
+		store = new Store(*cfgs, doms);
+		if(incremental)
+			store->computeKeys(name(), *coll, config);
+		if(shard < 0 && store->open(path, key)) {
+			if(logFor(LOG_FUN))
+				log << "	results loaded from " << path << io::endl;
+			return;
+		}
+		if(shard < 0 && shard_count > 0)
+			for(int i = 0; i < shard_count; i++) {
+				auto sp = shardPath(i, key);
+				int r = store->merge(sp, key);
+				if(logFor(LOG_FUN))
+					log << "	" << r << " sets merged from " << sp << io::endl;
+			}
+		else if(incremental) {
+			int r = store->reuse(path);
+			if(logFor(LOG_FUN))
+				log << "\t" << r << " sets reused from " << path << io::endl;
+		}
+	}
+
+	// select the sets
+	Vector<int> sets;
+	if(only_sets) {
 		for(auto s: only_sets)
 			if(s < 0 || s >= coll->setCount())
 				log << "ERROR: ignoring invalid set number: " << s << io::endl;
 			else
+				sets.add(s);
+	}
+	else {
+		int f = 0, l = n;
+		if(shard >= 0) {
+			f = t::int64(shard) * n / shard_count;
+			l = t::int64(shard + 1) * n / shard_count;
+		}
+		for(int i = f; i < l; i++)
+			if(coll->blockCount(i) != 0 && !isStored(i))
+				sets.add(i);
+	}
+
+	// process them (not in lazy mode, except the sets of the shard)
+	if(lazy && shard < 0) {
+		if(logFor(LOG_FUN))
+			log << "\tlazy mode: sets are computed on demand\n";
+	}
+	else {
+		if(thread_count <= 1 || sets.length() <= 1)
+			for(auto s: sets)
 				process(ws, s);
-	else
-		for(int i = 0; i < n; i++)
-			if(coll->blockCount(i) != 0)
-				process(ws, i);
+		else
+			processParallel(ws, sets);
+		if(lazy)
+			for(auto s: sets)
+				computed[s] = true;
+	}
+
+	// publish the statistics
+	if(stats != nullptr) {
+		auto l = STATISTICS(ws);
+		if(l == nullptr) {
+			l = new Vector<const Statistics *>();
+			STATISTICS(ws) = l;
+		}
+		l->add(stats);
+	}
+
+	// store the results (not available in lazy mode, except for a shard)
+	if(store != nullptr && (!lazy || shard >= 0))
+		save(path, key, sets);
+}
+
+/**
+ * Save the analysis results in the store.
+ * @param path	Path of the store file.
+ * @param key	Key of the analysis.
+ * @param sets	Computed sets to record (the other sets are either provided
+ * 				by the store or left out of the file).
+ */
+void Analysis::save(const sys::Path& path, t::uint64 key, const Vector<int>& sets) {
+	for(int i = 0; i < n; i++)
+		if(doms[i] != nullptr && !doms[i]->implementsIO()) {
+			warn("cannot store the results: domain does not implement IO.");
+			return;
+		}
+	try {
+		for(auto s: sets)
+			store->record(s, *anas[s]);
+		store->save(path, key);
+		if(logFor(LOG_FUN))
+			log << "	results stored to " << path << io::endl;
+	}
+	catch(elm::Exception& e) {
+		warn(_ << "cannot store the results to " << path << ": " << e.message());
+	}
+}
+
+// Get the path of the file of the given shard.
+sys::Path Analysis::shardPath(int shard, t::uint64 key) {
+	return store_dir / (_ << name() << '-' << key << '-' << shard << '-' << shard_count << ".dcr");
 }
 
 /**
@@ -328,6 +1140,150 @@ void Domain::printCode(otawa::Block *b, io::Output& out) {
 void Domain::collect(ai::state_collector_t f) {
 }
 
+/**
+ * Function called by the garbage collector just before the given state is
+ * freed. The default implementation does nothing.
+ * @param s		Freed state.
+ */
+void Domain::clean(GCState *s) {
+}
+
+
+
+/**
+ * @class SetStats
+ * Statistics collected on the computation of a set by Analysis
+ * (see @ref STATS):
+ *	* analyzed -- true if the fixpoint of the set has been computed,
+ *	* iterations -- number of fixpoint tests (state comparisons),
+ *	* block_updates, edge_updates -- number of transfer calls on blocks and edges,
+ *	* joins -- number of joins,
+ *	* saved -- number of block evaluations saved by the WTO iteration (see @ref WTO_ORDER),
+ *	* states, allocated_bytes -- number and size of allocated states,
+ *	* collections -- number of garbage collections,
+ *	* reclaimed_states, reclaimed_bytes -- number and size of freed states,
+ *	* time -- time of the fixpoint computation (in micro-seconds).
+ * @ingroup dcache
+ */
+
+///
+SetStats::SetStats():
+	analyzed(false),
+	iterations(0),
+	block_updates(0),
+	edge_updates(0),
+	joins(0),
+	saved(0),
+	states(0),
+	allocated_bytes(0),
+	collections(0),
+	reclaimed_states(0),
+	reclaimed_bytes(0),
+	time(0)
+	{ }
+
+/**
+ * Add the given statistics to the current one.
+ * @param s		Added statistics.
+ */
+void SetStats::add(const SetStats& s) {
+	analyzed = analyzed || s.analyzed;
+	iterations += s.iterations;
+	block_updates += s.block_updates;
+	edge_updates += s.edge_updates;
+	joins += s.joins;
+	saved += s.saved;
+	states += s.states;
+	allocated_bytes += s.allocated_bytes;
+	collections += s.collections;
+	reclaimed_states += s.reclaimed_states;
+	reclaimed_bytes += s.reclaimed_bytes;
+	time += s.time;
+}
+
+/**
+ * Output the statistics as the fields of a JSON object.
+ * @param out	Output stream.
+ */
+void SetStats::dump(io::Output& out) const {
+	out << "\"iterations\": " << iterations
+		<< ", \"block_updates\": " << block_updates
+		<< ", \"edge_updates\": " << edge_updates
+		<< ", \"joins\": " << joins
+		<< ", \"saved\": " << saved
+		<< ", \"states\": " << states
+		<< ", \"allocated_bytes\": " << allocated_bytes
+		<< ", \"collections\": " << collections
+		<< ", \"reclaimed_states\": " << reclaimed_states
+		<< ", \"reclaimed_bytes\": " << reclaimed_bytes
+		<< ", \"time\": " << time;
+}
+
+
+/**
+ * @class Statistics
+ * Statistics of an analysis: it gathers the statistics of each set
+ * (see @ref SetStats).
+ * @ingroup dcache
+ */
+
+/**
+ * Build the statistics.
+ * @param name		Name of the analysis.
+ * @param set_count	Number of sets.
+ */
+Statistics::Statistics(const string& name, int set_count): _name(name), sets(set_count) {
+}
+
+/**
+ * @fn const string& Statistics::name() const;
+ * Get the name of the analysis.
+ * @return	Analysis name.
+ */
+
+/**
+ * @fn int Statistics::setCount() const;
+ * Get the number of sets.
+ * @return	Number of sets.
+ */
+
+/**
+ * @fn const SetStats& Statistics::at(int set) const;
+ * Get the statistics of a set.
+ * @param set	Looked set.
+ * @return		Set statistics.
+ */
+
+/**
+ * Compute the sum of statistics of all sets.
+ * @return	Total statistics.
+ */
+SetStats Statistics::total() const {
+	SetStats t;
+	for(const auto& s: sets)
+		t.add(s);
+	return t;
+}
+
+/**
+ * Dump the statistics in JSON. Only the analyzed sets are output.
+ * @param out	Output stream.
+ */
+void Statistics::dump(io::Output& out) const {
+	out << "{\n\t\"analysis\": \"" << _name << "\",\n\t\"sets\": [";
+	bool first = true;
+	for(int i = 0; i < sets.count(); i++)
+		if(sets[i].analyzed) {
+			out << (first ? "\n" : ",\n") << "\t\t{ \"set\": " << i << ", ";
+			sets[i].dump(out);
+			out << " }";
+			first = false;
+		}
+	out << "\n\t],\n\t\"total\": { ";
+	total().dump(out);
+	out << " }\n}\n";
+}
+
 } }	// otawa::dcache
 
 
@@ -19,6 +19,9 @@
  *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <atomic>
+#include <exception>
+#include <thread>
 #include <elm/io/StringOutput.h>
 
 #include <otawa/hard/CacheConfiguration.h>
@@ -26,6 +29,7 @@
 #include <otawa/prog/Process.h>
 #include <otawa/sem/inst.h>
 
+#include "otawa/dcache/Analysis.h"
 #include "otawa/dcache/CLPAccessBuilder.h"
 
 namespace otawa { namespace dcache {
@@ -54,6 +58,22 @@ static action_t asDirect(action_t a) {
  * * @ref otawa::hard::MEMORY_FEATURE
  * * @ref otawa::clp::ANALYSIS_FEATURE
  *
+ * Configuration:
+ * * @ref THREAD_COUNT -- number of threads used to build the accesses.
+ * * @ref COALESCE -- mark the accesses that are hits thanks to a previous access of the same block.
+ *
+ * The blocks are processed independently: in multi-threaded mode, they are
+ * dispatched on the threads, each one filling its own access table. Once
+ * all blocks are processed, the ACCESSES properties are hooked to the slices
+ * of these tables. In both modes, the cache blocks are then renumbered by tag
+ * so that the result depends neither on the scheduling of the threads nor on
+ * the thread count.
+ *
+ * The CLP manager is not documented as reentrant (it may step the observed
+ * states with shared buffers): its calls are serialized by a lock and only
+ * the decoding of the instructions, the lookup of the cache blocks and the
+ * projection of the accesses on the sets run in parallel.
+ *
  * @ingroup dcache
  */
 
@@ -74,9 +94,20 @@ CLPAccessBuilder::CLPAccessBuilder(p::declare& r):
 	_cache(nullptr),
 	_mem(nullptr),
 	_coll(nullptr),
-	clp(nullptr)
+	clp(nullptr),
+	thread_count(1),
+	coalescing(false)
 	{ }
 
+///
+void CLPAccessBuilder::configure(const PropList& props) {
+	BBProcessor::configure(props);
+	thread_count = THREAD_COUNT(props);
+	if(thread_count <= 0)
+		thread_count = max(1, int(std::thread::hardware_concurrency()));
+	coalescing = COALESCE(props);
+}
+
 ///
 void *CLPAccessBuilder::interfaceFor(const AbstractFeature &feature) {
 	if(&feature == &ACCESS_FEATURE || &feature == &CLP_ACCESS_FEATURE)
@@ -103,10 +134,23 @@ void CLPAccessBuilder::setup(WorkSpace *ws) {
 void CLPAccessBuilder::processBB(WorkSpace *ws, CFG *g, otawa::Block *b) {
 	if(_cache == nullptr || !b->isBasic())
 		return;
-	BasicBlock *bb = b->toBasic();
+	int f = accs.length();
+	build(b->toBasic(), accs);
+	ACCESSES(b) = AccessList(accs, f, accs.length() - f);
+	SET_ACCESSES(b) = new SetAccesses(*ACCESSES(b), _cache->setCount());
+}
+
+/**
+ * Build the accesses of a basic block. Only the load and store semantic
+ * instructions are looked up in the CLP analysis, the observed state being
+ * moved forward along the block in a single walk.
+ * @param bb	Basic block to process.
+ * @param accs	Table to add the accesses to.
+ */
+void CLPAccessBuilder::build(BasicBlock *bb, FragTable<Access>& accs) {
 	clp::ObservedState *s = nullptr;
-	sem::Block buf;
 	int f = accs.length();
+	sem::Block buf;
 
 	for(auto inst: *bb) {
 		buf.clear();
@@ -128,11 +172,17 @@ void CLPAccessBuilder::processBB(WorkSpace *ws, CFG *g, otawa::Block *b) {
 			}
 			
 			// get the accessed address
-			s = clp->at(bb, inst, i, s);
-			auto addr = clp->valueOf(s, buf[i].addr());
-			if(logFor(LOG_INST))
+			clp::Value addr;
+			{
+				std::lock_guard<std::mutex> lock(clp_mutex);
+				s = clp->at(bb, inst, i, s);
+				addr = clp->valueOf(s, buf[i].addr());
+			}
+			if(logFor(LOG_INST)) {
+				std::lock_guard<std::mutex> lock(log_mutex);
 				log << "\t\t\t" << inst->address() << ": " << i << ": "
 					<< " access to " << addr << io::endl;
+			}
 
 			// access to T
 			if(addr.isAll())
@@ -148,11 +198,15 @@ void CLPAccessBuilder::processBB(WorkSpace *ws, CFG *g, otawa::Block *b) {
 				if(action == STORE && !_cache->doesWriteAllocate())
 					action = asDirect(action);
 				else if(b->id() < 0) {
-					if(logFor(LOG_INST))
+					if(logFor(LOG_INST)) {
+						std::lock_guard<std::mutex> lock(log_mutex);
 						log << "\t\t\t" << action << " at " << inst->address()
 							<< " is not cached!\n";
+					}
 					action = asDirect(action);
 				}
+				if(coalescing)
+					action = coalesce(accs, f, action, b);
 				accs.add(Access(inst, action, b, buf[i].type(), buf[i].memIndex()));
 			}
 
@@ -170,39 +224,85 @@ void CLPAccessBuilder::processBB(WorkSpace *ws, CFG *g, otawa::Block *b) {
 					throw otawa::Exception(_ << "no memory bank for address "
 						<< Address(l) << " accessed from " << inst->address());
 				else if(lb->bank() != hb->bank()) {
+					std::lock_guard<std::mutex> lock(log_mutex);
 					warn(_ << "access at " << inst->address()
 						<< " spanning over several banks considered as T.\n");
 					accs.add(Access(inst, action));
 				}
 				else if(!lb->bank()->isCached()) {
 					action = asDirect(action);
-					if(logFor(LOG_INST))
+					if(logFor(LOG_INST)) {
+						std::lock_guard<std::mutex> lock(log_mutex);
 						log << "\t\t\t" << action << " at " << inst->address()
 							<< " is not cached!\n";
+					}
 				}
 				if(action == STORE && !_cache->doesWriteAllocate())
 					action = asDirect(action);
-				if(lb == hb)
+				if(lb == hb) {
+					if(coalescing)
+						action = coalesce(accs, f, action, lb);
 					accs.add(Access(inst, action, lb, buf[i].type(), buf[i].memIndex()));
+				}
 				else {
-					Vector<const CacheBlock *> bs;
-					for(auto a = _cache->round(l); true;
-					a = a + _cache->blockSize()) {
-						auto block = _coll->add(a);
-						bs.add(block);
-						if(a == _cache->round(h))
-							break;
-					}
-					accs.add(Access(inst, action, bs, buf[i].type(), buf[i].memIndex()));
+					auto b = _cache->round(l);
+					int n = (_cache->round(h).offset() - b.offset()) >> _cache->blockBits();
+					int st = stride(addr);
+					for(int j = 0; j <= n; j += st)
+						_coll->add(b + j * _cache->blockSize());
+					accs.add(Access(inst, action, *_coll, b, st, n / st + 1,
+						buf[i].type(), buf[i].memIndex()));
 				}
 			}
 		}
 	}
-	if(s != nullptr)
+	if(s != nullptr) {
+		std::lock_guard<std::mutex> lock(clp_mutex);
 		clp->release(s);
+	}
+}
 
-	// record cached access
-	ACCESSES(b) = AccessList(accs, f, accs.length() - f);
+/**
+ * If coalescing is enabled (see @ref COALESCE), look if an access to the
+ * block b is a hit thanks to the previous access of the current basic block
+ * to the same set: this access must be a cached load or store to b. The state
+ * of the set is then unchanged by the access (b is already the youngest
+ * block).
+ * @param accs		Access table.
+ * @param f			Index of the first access of the current basic block.
+ * @param action	Action of the access.
+ * @param b			Accessed block.
+ * @return			HIT_LOAD or HIT_STORE if the access is a hit, action else.
+ */
+action_t CLPAccessBuilder::coalesce(const FragTable<Access>& accs, int f, action_t action, const CacheBlock *b) const {
+	if(action != LOAD && action != STORE)
+		return action;
+	for(int i = accs.length() - 1; i >= f; i--) {
+		const auto& a = accs[i];
+		if(a.access(b->set())) {
+			if(a.kind() == BLOCK && a.block() == b
+			&& (a.action() == LOAD || a.action() == STORE || a.isHit()))
+				return action == LOAD ? HIT_LOAD : HIT_STORE;
+			else
+				return action;
+		}
+	}
+	return action;
+}
+
+/**
+ * Compute the stride, in blocks, of the blocks accessed by a CLP range.
+ * If the CLP step is a multiple of the block size, only one block every
+ * step blocks is accessed; otherwise all blocks of the range are considered.
+ * @param addr	Accessed CLP.
+ * @return		Stride in blocks.
+ */
+int CLPAccessBuilder::stride(const clp::Value& addr) const {
+	t::uint32 d = addr.delta() < 0 ? -addr.delta() : addr.delta();
+	if(d == 0 || d % _cache->blockSize() != 0)
+		return 1;
+	else
+		return d >> _cache->blockBits();
 }
 
 ///
@@ -210,6 +310,8 @@ void CLPAccessBuilder::destroyBB (WorkSpace *ws, CFG *cfg, otawa::Block *b) {
 	if(!b->isBasic())
 		return;
 	ACCESSES(b).remove();
+	delete SET_ACCESSES(b);
+	SET_ACCESSES(b).remove();
 }
 
 ///
@@ -218,12 +320,114 @@ void CLPAccessBuilder::destroy(WorkSpace *ws) {
 		BBProcessor::destroy(ws);
 	if(_coll != nullptr)
 		delete _coll;
+	for(auto t: waccs)
+		delete t;
+	waccs.clear();
 }
 
 ///
 void CLPAccessBuilder::processWorkSpace(WorkSpace *ws) {
-	if(_cache != nullptr)
+	if(_cache != nullptr) {
+		if(thread_count <= 1)
+			BBProcessor::processWorkSpace(ws);
+		else
+			processParallel(ws);
+		_coll->renumber();
+		number(ws);
+		_coll->freeze();
+	}
+}
+
+/**
+ * Build the accesses of the basic blocks using several threads. Each thread
+ * adds the accesses of its blocks to its own table and the ACCESSES
+ * properties are set once all threads are done.
+ * @param ws	Current workspace.
+ */
+void CLPAccessBuilder::processParallel(WorkSpace *ws) {
+
+	// collect the basic blocks
+	Vector<BasicBlock *> bbs;
+	for(auto g: *COLLECTED_CFG_FEATURE.get(ws))
+		for(auto v: *g)
+			if(v->isBasic())
+				bbs.add(v->toBasic());
+	int tc = min(thread_count, bbs.length());
+	if(tc <= 1) {
 		BBProcessor::processWorkSpace(ws);
+		return;
+	}
+	if(logFor(LOG_FUN))
+		log << "\tbuilding accesses of " << bbs.length() << " blocks with " << tc << " threads\n";
+
+	// run the workers
+	typedef struct {
+		int w, f, n;
+		SetAccesses *sa;
+	} result_t;
+	AllocArray<result_t> res(bbs.length());
+	for(int i = 0; i < bbs.length(); i++)
+		res[i].sa = nullptr;
+	for(int i = 0; i < tc; i++)
+		waccs.add(new FragTable<Access>());
+	std::atomic<int> next(0);
+	std::exception_ptr failure;
+	std::mutex failure_mutex;
+	auto worker = [&](int w) {
+		auto& t = *waccs[w];
+		for(int i = next++; i < bbs.length(); i = next++) {
+			try {
+				int f = t.length();
+				build(bbs[i], t);
+				res[i].w = w;
+				res[i].f = f;
+				res[i].n = t.length() - f;
+				res[i].sa = new SetAccesses(AccessList(t, f, res[i].n), _cache->setCount());
+			}
+			catch(...) {
+				std::lock_guard<std::mutex> lock(failure_mutex);
+				if(!failure)
+					failure = std::current_exception();
+				next = bbs.length();
+			}
+		}
+	};
+	Vector<std::thread *> threads;
+	for(int i = 1; i < tc; i++)
+		threads.add(new std::thread(worker, i));
+	worker(0);
+	for(auto t: threads) {
+		t->join();
+		delete t;
+	}
+
+	// propagate the failure, if any
+	if(failure) {
+		for(int i = 0; i < bbs.length(); i++)
+			delete res[i].sa;
+		std::rethrow_exception(failure);
+	}
+
+	// splice the accesses in the blocks
+	for(int i = 0; i < bbs.length(); i++) {
+		ACCESSES(bbs[i]) = AccessList(*waccs[res[i].w], res[i].f, res[i].n);
+		SET_ACCESSES(bbs[i]) = res[i].sa;
+	}
+}
+
+/**
+ * Assign the access identifiers following the order of the CFG collection
+ * so that they do not depend on the way the blocks have been processed.
+ * @param ws	Current workspace.
+ */
+void CLPAccessBuilder::number(WorkSpace *ws) {
+	int n = 0;
+	for(auto g: *COLLECTED_CFG_FEATURE.get(ws))
+		for(auto v: *g)
+			if(v->isBasic())
+				for(auto& a: *ACCESSES(v))
+					a.setID(n++);
+	_coll->setAccessCount(n);
 }
 
 ///
@@ -246,4 +450,15 @@ p::interfaced_feature<const SetCollection> CLP_ACCESS_FEATURE(
 	p::make<CLPAccessBuilder>()
 );
 
+
+/**
+ * This property is a configuration of CLPAccessBuilder. If set to true, a load
+ * or a store to a cache block whose previous access to the same set, in the
+ * same basic block, is a load or a store to the same cache block is marked
+ * as a hit (@ref HIT_LOAD or @ref HIT_STORE action). Such an access does not
+ * change the cache state: it is skipped by the analyses and classified as
+ * always-hit by the category and event builders (default false).
+ */
+p::id<bool> COALESCE("otawa::dcache::COALESCE", false);
+
 } }	// otawa::dcache
@@ -19,12 +19,18 @@
  *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <atomic>
+#include <exception>
+#include <thread>
 #include <otawa/cfg/features.h>
 #include <otawa/cfg/Loop.h>
 #include <otawa/hard/Memory.h>
 #include <otawa/proc/BBProcessor.h>
 
+#include "otawa/dcache/Analysis.h"
+#include "otawa/dcache/Cursors.h"
 #include "otawa/dcache/features.h"
+#include "otawa/dcache/Stream.h"
 
 namespace otawa { namespace dcache { 
 
@@ -38,13 +44,47 @@ public:
 		may(nullptr),
 		pers(nullptr),
 		mpers(nullptr),
+		prod(nullptr),
 		mem(nullptr),
-		A(0)
-	{
-		array::set(cnt, CAT_CNT, 0);
+		A(0),
+		cats(nullptr),
+		stream(0),
+		thread_count(1),
+		replay(false)
+	{ }
+
+	void configure(const PropList& props) override {
+		BBProcessor::configure(props);
+		stream = STREAM(props);
+		thread_count = THREAD_COUNT(props);
+		if(thread_count <= 0)
+			thread_count = max(1, int(std::thread::hardware_concurrency()));
+		asked.clear();
+		for(auto w: ASSOCIATIVITY.all(props))
+			asked.add(w);
+	}
+
+	void *interfaceFor(const AbstractFeature& feature) override {
+		if(&feature == &CATEGORY_FEATURE)
+			return cats;
+		else
+			return nullptr;
 	}
 
 protected:
+	typedef Pair<category_t, Block *> result_t;
+
+	/**
+	 * Classification context of a thread: its cursors, the classifications
+	 * it records and its statistics.
+	 */
+	class Worker {
+	public:
+		inline Worker() { array::set(cnt, CAT_CNT, 0); }
+		AgeCursors cur;
+		StreamMemo<result_t> memo;
+		int cnt[CAT_CNT];
+	};
 
 	void setup(WorkSpace *ws) override {
 
@@ -70,24 +110,75 @@ protected:
 			mpers = MULTI_PERS_FEATURE.get(ws);
 			ASSERT(mpers != nullptr);
 		}
+
+		// get the MUST/MAY/PERS product, if any
+		if(ws->provides(PRODUCT_FEATURE)) {
+			prod = PRODUCT_FEATURE.get(ws);
+			ASSERT(prod != nullptr);
+		}
+		main.cur.init(must, may, pers, mpers, prod);
 		
 		// get the memory
 		mem = hard::MEMORY_FEATURE.get(ws);
 		
 		// get the cache
-		cache = &ACCESS_FEATURE.get(ws)->cache();
+		auto coll = ACCESS_FEATURE.get(ws);
+		cache = &coll->cache();
+
+		// select the explored associativities
+		Vector<int> ways;
+		ways.add(A);
+		if(!asked.isEmpty() && cache->replacementPolicy() != hard::Cache::LRU)
+			warn("associativity exploration only supported for LRU caches: ignored.");
+		else
+			for(auto w: asked)
+				if(0 < w && w < A && !ways.contains(w))
+					ways.add(w);
+
+		// allocate the categories
+		cats = new Categories(coll->accessCount(), ways);
 	}
 
-	category_t classify(Edge *e, const Access& a, const CacheBlock *cb, Block*& h) {
+	void destroy(WorkSpace *ws) override {
+		delete cats;
+		cats = nullptr;
+	}
+
+	/**
+	 * Classify a cache block accessed by an access for the associativity
+	 * of the given layer of categories: the ages computed for the actual
+	 * cache are projected on the layer associativity.
+	 * @param w		Current worker.
+	 * @param e		Current edge.
+	 * @param a		Current access.
+	 * @param cb	Classified cache block.
+	 * @param h		Set to the header of the persistence loop for PE.
+	 * @param l		Layer of categories.
+	 * @return		Block category.
+	 */
+	category_t classify(Worker& w, Edge *e, const Access& a, const CacheBlock *cb, Block*& h, int l) {
+		if(replay) {
+			const auto& r = w.memo.get(e, a, cb, l);
+			h = r.snd;
+			return r.fst;
+		}
+		auto c = compute(w, e, cb, h, l);
+		if(l == 0)
+			w.cnt[c]++;
+		return c;
+	}
+
+	category_t compute(Worker& w, Edge *e, const CacheBlock *cb, Block*& h, int l) {
 		h = nullptr;
-		
+		int W = cats->wayCount(l);
+
 		// AH?
-		if(must->age(e, a, cb) < A)
+		if(AgeInfo::ageFor(w.cur.must->age(cb), W) < W)
 			return AH;
 
-		// PE?
-		else if(mpers != nullptr) {
-			auto n = mpers->level(e, a, cb);
+		// PE? (multi-level persistence cannot be projected)
+		else if(mpers != nullptr && l == 0) {
+			auto n = w.cur.mpers->level(cb);
 			if(n != 0) {
 				auto l = Loop::of(e->sink());
 				for(int i = 1; i < n; i++) {
@@ -107,7 +198,7 @@ protected:
 		}
 			
 		// PE?
-		if(pers != nullptr && pers->age(e, a, cb) < A) {
+		if(pers != nullptr && AgeInfo::ageFor(w.cur.pers->age(cb), W) < W) {
 			auto l = Loop::of(e->sink());
 			if(!l->isTop())
 				while(!l->parent()->isTop())
@@ -120,7 +211,7 @@ protected:
 		}
 			
 		// AM?
-		if(may != nullptr && may->age(e, a, cb) >= A)
+		if(may != nullptr && AgeInfo::ageFor(w.cur.may->age(cb), W) >= W)
 			return AM;
 			
 		// NOT-CLASSIFIED
@@ -128,26 +219,24 @@ protected:
 			return NC;
 	}
 
-	void processAny(Edge *e, Access &a) {
-		CATEGORY(a) = NC;
+	void processAny(Edge *e, Access &a, int l) {
+		cats->set(a, NC, nullptr, l);
 	}
 
-	void processBlock(Edge *e, Access& a) {
+	void processBlock(Edge *e, Access& a, int l) {
 		Block *h;
-		auto c = classify(e, a, a.block(), h);
-		CATEGORY(a) = c;
-		if(c == PE)
-			RELATIVE_TO(a) = h;
+		auto c = classify(main, e, a, a.block(), h, l);
+		cats->set(a, c, c == PE ? h : nullptr, l);
 	}
 	
-	void processEnum(Edge *e, Access& a) {
+	void processEnum(Edge *e, Access& a, int l) {
 		
 		// prepare according to all blocks
 		Block *fh = nullptr;
 		Block *h;
 		auto c = NO_CAT;
-		for(auto cb: a.blocks()) {
-			auto nc = classify(e, a, cb, h);
+		for(int i = 0; i < a.blockCount(); i++) {
+			auto nc = classify(main, e, a, a.blockAt(i), h, l);
 			if(c == NO_CAT)
 				c = nc;
 			else if(c != nc) {
@@ -167,13 +256,11 @@ protected:
 		}
 		
 		// build the event
-		CATEGORY(a) = c;
-		if(c == PE)
-			RELATIVE_TO(a) = fh;
+		cats->set(a, c, c == PE ? fh : nullptr, l);
 	}
 	
-	void processDirect(Edge *e, Access& a) {
-		CATEGORY(a) = AM;
+	void processDirect(Edge *e, Access& a, int l) {
+		cats->set(a, AM, nullptr, l);
 	}
 
 	/**
@@ -184,9 +271,10 @@ protected:
 	 * instruction can be ignored in this case.
 	 * @param e		Current edge.
 	 * @param a		Access to build event for.
+	 * @param l		Layer of categories.
 	 * @return		True if a multiple to T has been managed, false else.
 	 */
-	void processAccess(Edge *e, Access& a) {
+	void processAccess(Edge *e, Access& a, int l) {
 
 		// build the event
 		switch(a.action()) {
@@ -195,7 +283,12 @@ protected:
 
 		case DIRECT_LOAD:
 		case DIRECT_STORE:
-			processDirect(e, a);
+			processDirect(e, a, l);
+			break;
+
+		case HIT_LOAD:
+		case HIT_STORE:
+			cats->set(a, AH, nullptr, l);
 			break;
 			
 		case PURGE:
@@ -205,16 +298,16 @@ protected:
 		case STORE:
 			switch(a.kind()) {
 			case ANY:
-				processAny(e, a);
+				processAny(e, a, l);
 				break;
 			case BLOCK:
-				processBlock(e, a);
+				processBlock(e, a, l);
 				break;
 			case ENUM:
-				processEnum(e, a);
+				processEnum(e, a, l);
 				break;
 			case RANGE:
-				processAny(e, a);
+				processAny(e, a, l);
 				break;
 			default:
 				ASSERT(false);
@@ -229,20 +322,184 @@ protected:
 			return;
 		auto b = b_->toBasic();
 
-		// set events
-		for(auto e: b->inEdges())
-			for(auto& a: *ACCESSES(b))
-				processAccess(e, a);
+		// set categories (no cursor needed if the classifications are replayed)
+		for(auto e: b->inEdges()) {
+			if(!replay)
+				main.cur.open(e);
+			for(auto& a: *ACCESSES(b)) {
+				for(int l = 0; l < cats->layerCount(); l++)
+					processAccess(e, a, l);
+				if(!replay)
+					main.cur.next();
+			}
+			if(!replay)
+				main.cur.close();
+		}
 	}
 	
+	void processWorkSpace(WorkSpace *ws) override {
+		if(stream <= 0 && thread_count <= 1) {
+			BBProcessor::processWorkSpace(ws);
+			dumpCounts();
+			return;
+		}
+
+		// collect the basic blocks
+		Vector<BasicBlock *> bbs;
+		for(auto g: *COLLECTED_CFG_FEATURE.get(ws))
+			for(auto v: *g)
+				if(v->isBasic())
+					bbs.add(v->toBasic());
+
+		// classify the blocks group of sets by group of sets
+		int S = cache->setCount();
+		int n = stream > 0 ? stream : S;
+		for(int f = 0; f < S; f += n) {
+			int l = min(S, f + n);
+			if(stream > 0 && logFor(LOG_FUN))
+				log << "\tstreaming sets [" << f << ", " << l << "[\n";
+			classifyBBs(bbs, f, l);
+			if(stream > 0)
+				for(int i = f; i < l; i++)
+					dropSet(i);
+		}
+
+		// build the categories from the recorded classifications
+		replay = true;
+		BBProcessor::processWorkSpace(ws);
+		replay = false;
+		main.memo.clear();
+		dumpCounts();
+	}
+
+	/**
+	 * Record the classifications of the blocks in the sets [f, l[ for
+	 * the given basic blocks. In multi-threaded mode (see @ref THREAD_COUNT),
+	 * the blocks are dispatched on the threads, each one recording the
+	 * classifications in its own memory. These memories are then merged
+	 * and, as they record different classifications, the result does not
+	 * depend on the scheduling of the threads.
+	 * @param bbs	Classified blocks.
+	 * @param f		First set.
+	 * @param l		Set after the last one.
+	 */
+	void classifyBBs(const Vector<BasicBlock *>& bbs, int f, int l) {
+		int tc = min(thread_count, bbs.length());
+		if(tc <= 1) {
+			for(auto b: bbs)
+				streamBB(main, b, f, l);
+			return;
+		}
+
+		// run the workers
+		AllocArray<Worker> ws(tc);
+		for(int i = 0; i < tc; i++)
+			ws[i].cur.init(must, may, pers, mpers, prod);
+		std::atomic<int> next(0);
+		std::exception_ptr failure;
+		std::mutex failure_mutex;
+		auto worker = [&](int w) {
+			for(int i = next++; i < bbs.length(); i = next++) {
+				try {
+					streamBB(ws[w], bbs[i], f, l);
+				}
+				catch(...) {
+					std::lock_guard<std::mutex> lock(failure_mutex);
+					if(!failure)
+						failure = std::current_exception();
+					next = bbs.length();
+				}
+			}
+		};
+		Vector<std::thread *> threads;
+		for(int i = 1; i < tc; i++)
+			threads.add(new std::thread(worker, i));
+		worker(0);
+		for(auto t: threads) {
+			t->join();
+			delete t;
+		}
+
+		// propagate the failure, if any
+		if(failure)
+			std::rethrow_exception(failure);
+
+		// merge the results
+		for(int i = 0; i < tc; i++) {
+			main.memo.merge(ws[i].memo);
+			for(int c = 0; c < CAT_CNT; c++)
+				main.cnt[c] += ws[i].cnt[c];
+		}
+	}
+
+	/**
+	 * Record the classification of the blocks of b that belongs to the
+	 * sets [f, l[.
+	 * @param w		Current worker.
+	 * @param b		Current block.
+	 * @param f		First set.
+	 * @param l		Set after the last one.
+	 */
+	void streamBB(Worker& w, BasicBlock *b, int f, int l) {
+		if(!StreamMemo<result_t>::touches(b, f, l))
+			return;
+		for(auto e: b->inEdges()) {
+			w.cur.open(e);
+			for(const auto& a: *ACCESSES(b)) {
+				if(a.action() == LOAD || a.action() == STORE) {
+					if(a.kind() == BLOCK)
+						record(w, e, a, a.block(), f, l);
+					else if(a.kind() == ENUM)
+						for(int i = 0; i < a.blockCount(); i++)
+							record(w, e, a, a.blockAt(i), f, l);
+				}
+				w.cur.next();
+			}
+			w.cur.close();
+		}
+	}
+
+	void record(Worker& w, Edge *e, const Access& a, const CacheBlock *cb, int f, int l) {
+		if(cb->set() < f || cb->set() >= l)
+			return;
+		for(int i = 0; i < cats->layerCount(); i++) {
+			Block *h;
+			auto c = classify(w, e, a, cb, h, i);
+			w.memo.put(e, a, cb, result_t(c, h), i);
+		}
+	}
+
+	void dropSet(int set) {
+		if(prod != nullptr)
+			prod->drop(set);
+		must->drop(set);
+		if(may != nullptr)
+			may->drop(set);
+		if(pers != nullptr)
+			pers->drop(set);
+		if(mpers != nullptr)
+			mpers->drop(set);
+	}
+
+	/**
+	 * Log the number of classified cache blocks by category.
+	 */
+	void dumpCounts() {
+		if(logFor(LOG_FUN))
+			for(int c = AH; c < CAT_CNT; c++)
+				log << "\t" << category_t(c) << ": " << main.cnt[c] << io::endl;
+	}
+
 	void dumpBB(Block *v, io::Output& out) override {
 		for(auto e: v->inEdges()) {
 			out << "\t\talong " << e << io::endl;
-			for(const auto& a: *ACCESSES(e)) {
-				auto c = CATEGORY(a);
+			for(const auto& a: *ACCESSES(v)) {
+				auto c = cats->category(a);
 				out << "\t\t\t" << a << ": " << c;
 				if(c == PE)
-					out << " (" << *RELATIVE_TO(a) << ")";
+					out << " (" << *cats->relativeTo(a) << ")";
+				for(int l = 1; l < cats->layerCount(); l++)
+					out << ", " << cats->wayCount(l) << "-way: " << cats->category(a, l);
 				out << io::endl;
 			}
 		}
@@ -252,10 +509,16 @@ private:
 
 	AgeInfo *must, *may, *pers;
 	MultiAgeInfo *mpers;
+	ProductInfo *prod;
 	const hard::Memory *mem;
 	int A;
-	int cnt[CAT_CNT];
 	const hard::Cache *cache;
+	Categories *cats;
+	int stream;
+	int thread_count;
+	bool replay;
+	Worker main;
+	Vector<int> asked;
 };
 
 
@@ -265,6 +528,7 @@ p::declare CategoryBuilder::reg = p::init("otawa::dcache::CategoryBuilder", Vers
 	.require(EXTENDED_LOOP_FEATURE)
 	.require(hard::MEMORY_FEATURE)
 	.require(ACCESS_FEATURE)
+	.provide(CATEGORY_FEATURE)
 	.extend<BBProcessor>()
 	.make<CategoryBuilder>();
 
@@ -272,39 +536,78 @@ p::declare CategoryBuilder::reg = p::init("otawa::dcache::CategoryBuilder", Vers
 /**
  * Assign to each data cache access a category representing its cache behaviour.
  * 
- * Properties:
- *  @ref otawa::dcache::CATEGORY
+ * Interface: @ref otawa::dcache::Categories
  * 
  * Default implementation: @ref otawa::dcache::CategoryBuilder
  * 
  * @ingroup dcache
  */
-p::feature CATEGORY_FEATURE("otawa::dcache::CATEGORY_FEATURE", p::make<CategoryBuilder>());
+p::interfaced_feature<const Categories> CATEGORY_FEATURE("otawa::dcache::CATEGORY_FEATURE", p::make<CategoryBuilder>());
+
 
 /**
- * Property hooked to data cache access (@ref dcache::Access) recording the access category
- * (@ref dcache::category_t).
- * 
- * @par Hooks
- * * @ref dcache::Access
- * 
- * @par Features
- * * @ref dcache::CATEGORY_FEATURE
+ * @class Categories
+ * Interface of @ref CATEGORY_FEATURE: it records, for each access, its
+ * category (@ref dcache::category_t) and, for a category of type
+ * @ref dcache::PE, the header of the loop it is persistent in. The
+ * information is stored in dense tables indexed by the access identifier
+ * (@ref Access::id()).
+ * @ingroup dcache
  */
-p::id<category_t> CATEGORY("otawa::dcache::CATEGORY", NO_CAT);
 
+/**
+ * Build the categories.
+ * @param count		Number of accesses.
+ * @param ways		Associativity of each layer of categories, the first
+ * 					one being the associativity of the analyzed cache
+ * 					(see @ref ASSOCIATIVITY).
+ */
+Categories::Categories(int count, const Vector<int>& ways)
+:	count(count),
+	ways(ways),
+	cats(count * ways.count(), t::uint8(NO_CAT)),
+	rels(count * ways.count(), static_cast<Block *>(nullptr))
+{ }
 
 /**
- * Supplement to @ref dcache::CATEGORY feature giving the loop header when
- * a catagory is of type @ref dcache::PE.
- * 
- * @par Hooks
- * * @ref dcache::Access
- * 
- * @par Features
- * * @ref dcache::CATEGORY_FEATURE
+ * @fn int Categories::layerCount() const;
+ * Get the number of layers of categories, that is, the number of explored
+ * associativities (see @ref ASSOCIATIVITY).
+ * @return	Number of layers.
+ */
+
+/**
+ * @fn int Categories::wayCount(int l) const;
+ * Get the associativity the categories of a layer are computed for.
+ * @param l		Layer (default to 0, the analyzed cache).
+ * @return		Number of ways.
+ */
+
+/**
+ * @fn category_t Categories::category(const Access& a, int l) const;
+ * Get the category of an access.
+ * @param a		Looked access.
+ * @param l		Layer (default to 0, the analyzed cache).
+ * @return		Access category.
+ */
+
+/**
+ * @fn Block *Categories::relativeTo(const Access& a, int l) const;
+ * For an access of category @ref dcache::PE, get the header of the loop
+ * the access is persistent in.
+ * @param a		Looked access.
+ * @param l		Layer (default to 0, the analyzed cache).
+ * @return		Loop header or null.
+ */
+
+/**
+ * @fn void Categories::set(const Access& a, category_t c, Block *h, int l);
+ * Set the category of an access.
+ * @param a		Changed access.
+ * @param c		Access category.
+ * @param h		Loop header for a @ref dcache::PE category (optional).
+ * @param l		Layer (default to 0, the analyzed cache).
  */
-p::id<Block *> RELATIVE_TO("otawa::dcache::RELATIVE_TO", nullptr);
 
 
 ///
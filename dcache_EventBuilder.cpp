@@ -19,6 +19,9 @@
  *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <atomic>
+#include <exception>
+#include <thread>
 #include <otawa/cfg/features.h>
 #include <otawa/cfg/Loop.h>
 #include <otawa/events/features.h>
@@ -28,7 +31,10 @@
 #include <otawa/ilp/Constraint.h>
 #include <otawa/proc/BBProcessor.h>
 
+#include "otawa/dcache/Analysis.h"
+#include "otawa/dcache/Cursors.h"
 #include "otawa/dcache/features.h"
+#include "otawa/dcache/Stream.h"
 
 namespace otawa { namespace dcache { 
 
@@ -42,27 +48,27 @@ public:
 		const Access& a,
 	   ot::time c,
 	   occurrence_t o,
-	   const ilp::Expression& xs = ilp::Expression::null
+	   const Vector<Block *>& hs = Vector<Block *>()
 	):
 		otawa::Event(a.inst()),
 		_acc(a),
+		_cat(NO_CAT),
 		_cost(c),
 		_occ(o),
-		_xs(xs)
+		_hs(hs)
 		{ }
 
 	cstring name() const override { return "DC"; }
 	string detail() const override {
 		StringBuffer buf;
-		buf << name() << ": " << CATEGORY(_acc) << " - " << _occ;
+		buf << name() << ": " << _cat << " - " << _occ;
 		// if(_occ == SOMETIMES) {
-		// 	if(_xs.count() > 0)
-		// 		buf << " (xe <= " << _xs << ")";
+		// 	if(_hs.count() > 0)
+		// 		buf << " (xe <= " << _hs << ")";
 		// 	else
 		// 		buf << " (no bound)";
 		// }
 		buf << " - " << _acc.action();
-		cout << _xs<< endl;
 		return buf.toString();
 	}
 
@@ -70,26 +76,63 @@ public:
 	ot::time cost() const override { return _cost; }
 	occurrence_t occurrence() const override { return _occ; }
 	inline const Access& access() const { return _acc; }
+	inline void setCategory(category_t c) { _cat = c; }
 
 	type_t type() const override { return LOCAL; }
 
 	bool isEstimating(bool on) const override {
 		if(on)
-			return !_xs.isEmpty();
+			return !_hs.isEmpty();
 		else
 			return false;
 	}
 	
 	void estimate(ilp::Constraint *cons, bool on) const override {
 		if(on)
-			_xs.addLeft(cons);
+			for(auto h: _hs)
+				cons->addLeft(1., ipet::VAR(h));
 	}
 
+	/**
+	 * Test if both events are the same, that is, they concern the same access
+	 * with the same cost and occurrence, bounded by the same loop headers.
+	 * @param e		Compared event.
+	 * @return		True if both events are equal, false else.
+	 */
+	bool equals(const Event& e) const {
+		if(&_acc != &e._acc || _cost != e._cost || _occ != e._occ
+		|| _hs.length() != e._hs.length())
+			return false;
+		for(int i = 0; i < _hs.length(); i++)
+			if(_hs[i] != e._hs[i])
+				return false;
+		return true;
+	}
+
+	/**
+	 * Test if the given event can be merged in the current one: both must be
+	 * ALWAYS or NEVER events of the same instruction.
+	 * @param e		Event to test.
+	 * @return		True if the events can be merged, false else.
+	 */
+	bool canMerge(const Event& e) const {
+		return e.inst() == inst() && e._occ == _occ
+			&& (_occ == ALWAYS || _occ == NEVER)
+			&& _hs.isEmpty() && e._hs.isEmpty();
+	}
+
+	/**
+	 * Merge the given event in the current one: the costs are summed.
+	 * @param e		Merged event.
+	 */
+	inline void merge(const Event& e) { _cost += e._cost; }
+
 private:
 	const Access& _acc;
+	category_t _cat;
 	time_t _cost;
 	occurrence_t _occ;	
-	mutable ilp::Expression _xs;
+	Vector<Block *> _hs;
 };
 
 
@@ -102,18 +145,43 @@ public:
 		may(nullptr),
 		pers(nullptr),
 		mpers(nullptr),
+		prod(nullptr),
+		replay(false),
 		mem(nullptr),
-		A(0)
-	{
-		array::set(cnt, CAT_CNT, 0);
-	}
+		A(0),
+		cats(nullptr),
+		aggregate(false),
+		buffer(nullptr),
+		stream(0),
+		thread_count(1)
+	{ }
 
 	void configure(const PropList& props) override {
 		BBProcessor::configure(props);
 		_explicit = ipet::EXPLICIT(props);
+		aggregate = AGGREGATE_EVENTS(props);
+		stream = STREAM(props);
+		thread_count = THREAD_COUNT(props);
+		if(thread_count <= 0)
+			thread_count = max(1, int(std::thread::hardware_concurrency()));
 	}
 	
 protected:
+	typedef Pair<Event::occurrence_t, Block *> t;
+
+	/**
+	 * Classification context of a thread: its cursors, the classifications
+	 * it records, its statistics and whether it works on the prefix of
+	 * an edge (see @ref PREFIX_EVENTS_FEATURE).
+	 */
+	class Worker {
+	public:
+		inline Worker(): prefix(false) { array::set(cnt, CAT_CNT, 0); }
+		AgeCursors cur;
+		StreamMemo<t> memo;
+		int cnt[CAT_CNT];
+		bool prefix;
+	};
 
 	void setup(WorkSpace *ws) override {
 
@@ -139,6 +207,13 @@ protected:
 			mpers = MULTI_PERS_FEATURE.get(ws);
 			ASSERT(mpers != nullptr);
 		}
+
+		// get the MUST/MAY/PERS product, if any
+		if(ws->provides(PRODUCT_FEATURE)) {
+			prod = PRODUCT_FEATURE.get(ws);
+			ASSERT(prod != nullptr);
+		}
+		main.cur.init(must, may, pers, mpers, prod);
 		
 		// get the memory
 		mem = hard::MEMORY_FEATURE.get(ws);
@@ -148,45 +223,76 @@ protected:
 		
 		// get the cache
 		cache = &ACCESS_FEATURE.get(ws)->cache();
+
+		// get the categories, if any
+		if(ws->provides(CATEGORY_FEATURE))
+			cats = CATEGORY_FEATURE.get(ws);
 	}
 
-	virtual int mustAge(Edge *e, const Access & a, const CacheBlock *cb) {
-		return must->age(e, a, cb);
+	/**
+	 * Open the cursors of the worker used to get the ages of the accesses
+	 * walked along edge e.
+	 * @param w		Current worker.
+	 * @param e		Current edge.
+	 */
+	virtual void openCursors(Worker& w, Edge *e) {
+		w.cur.open(e);
+	}
+
+	virtual int mustAge(Worker& w, Edge *e, const Access & a, const CacheBlock *cb) {
+		return w.cur.must->age(cb);
 	}
 	
-	virtual int mpersLevel(Edge *e, const Access& a, const CacheBlock *cb) {
-		return mpers->level(e, a, cb);
+	virtual int mpersLevel(Worker& w, Edge *e, const Access& a, const CacheBlock *cb) {
+		return w.cur.mpers->level(cb);
 	}
 
-	virtual int persAge(Edge *e, const Access& a, const CacheBlock *cb) {
-		return pers->age(e, a, cb);
+	virtual int persAge(Worker& w, Edge *e, const Access& a, const CacheBlock *cb) {
+		return w.cur.pers->age(cb);
 	}
 
-	virtual int mayAge(Edge *e, const Access& a, const CacheBlock *cb) {
-		return may->age(e, a, cb);
+	virtual int mayAge(Worker& w, Edge *e, const Access& a, const CacheBlock *cb) {
+		return w.cur.may->age(cb);
 	}
 
-	virtual Block *eventBlock(Edge *e) {
+	virtual Block *eventBlock(Worker& w, Edge *e) {
 		return e->sink();
 	}
 	
 	virtual void addEvent(Edge *e, Event *evt) {
-		EVENT(e).add(evt);
+		if(buffer != nullptr)
+			buffer->add(evt);
+		else {
+			categorize(evt);
+			EVENT(e).add(evt);
+		}
+	}
+
+	/**
+	 * Record in the event the category of its access, if categories are available.
+	 * @param evt	Event to categorize.
+	 */
+	void categorize(Event *evt) {
+		if(cats != nullptr)
+			evt->setCategory(cats->category(evt->access()));
 	}
 	
-	typedef Pair<Event::occurrence_t, Block *> t;
-	t classify(Edge *e, const Access& a, const CacheBlock *cb) {
+	t classify(Worker& w, Edge *e, const Access& a, const CacheBlock *cb) {
+		if(replay)
+			return w.memo.get(e, a, cb, w.prefix);
 
 		// AH?
-		if(mustAge(e, a, cb) < A)
+		if(mustAge(w, e, a, cb) < A) {
+			w.cnt[AH]++;
 			return t(Event::NEVER, nullptr);
+		}
 
 		// PE?
 		else if(mpers != nullptr) {
 			Block *h;
-			auto n = mpersLevel(e, a, cb);
+			auto n = mpersLevel(w, e, a, cb);
 			if(n != 0) {
-				auto l = Loop::of(eventBlock(e));
+				auto l = Loop::of(eventBlock(w, e));
 				for(int i = 1; i < n; i++) {
 					if(!l->isTop())
 						l = l->parent();
@@ -199,13 +305,14 @@ protected:
 					h = l->cfg()->entry()->outEdges().begin()->sink();
 				else
 					h = l->header();
+				w.cnt[PE]++;
 				return t(Event::SOMETIMES, h);
 			}
 		}
 			
 		// PE?
-		if(pers != nullptr && persAge(e, a, cb) < A) {
-			auto l = Loop::of(eventBlock(e));
+		if(pers != nullptr && persAge(w, e, a, cb) < A) {
+			auto l = Loop::of(eventBlock(w, e));
 			if(!l->isTop())
 				while(!l->parent()->isTop())
 					l = l->parent();
@@ -214,25 +321,32 @@ protected:
 				h = l->cfg()->entry()->outEdges().begin()->sink();
 			else
 				h = l->header();
+			w.cnt[PE]++;
 			return t(Event::SOMETIMES, h);
 		}
 			
 		// AM?
-		if(may != nullptr && mayAge(e, a, cb) >= A)
+		if(may != nullptr && mayAge(w, e, a, cb) >= A) {
+			w.cnt[AM]++;
 			return t(Event::NEVER, nullptr);
+		}
 			
 		// NOT-CLASSIFIED
-		else
+		else {
+			w.cnt[NC]++;
 			return t(Event::SOMETIMES, nullptr);
+		}
 	}
 
 	ot::time worstAccessTime(const Access& a) {
 		switch(a.action()) {
 		case LOAD:
-		case DIRECT_LOAD:		
+		case DIRECT_LOAD:
+		case HIT_LOAD:
 			return mem->worstReadTime();
 		case STORE:
 		case DIRECT_STORE:
+		case HIT_STORE:
 			return mem->worstWriteTime();
 		case NO_ACCESS:
 		case PURGE:
@@ -242,11 +356,7 @@ protected:
 	}
 	
 	Event *processAny(Edge *e, const Access &a) {
-		return new Event(
-			a,
-			worstAccessTime(a),
-			Event::SOMETIMES,
-			ilp::Expression::null);
+		return new Event(a, worstAccessTime(a), Event::SOMETIMES);
 	}
 
 	/**
@@ -267,29 +377,28 @@ protected:
 		// TO FIX: not really worst case
 		ot::time t = worstAccessTime(a);
 		for(int i = 0; i < cnt; i++)
-			addEvent(e,
-				new Event(a, t,	Event::ALWAYS, ilp::Expression::null));
+			addEvent(e, new Event(a, t, Event::ALWAYS));
 	}
 	
 	Event *processBlock(Edge *e, const Access& a) {
 		auto cb = a.block();
 		auto bank = cb->bank();
-		auto c = classify(e, a, cb);
+		auto c = classify(main, e, a, cb);
 		ot::time t;
 		if(a.action() == LOAD)
 			t = bank->readLatency();
 		else
 			t = bank->writeLatency();
-		ilp::Expression xs;
+		Vector<Block *> hs;
 		if(c.snd != nullptr)
-			xs.add(1., ipet::VAR(c.snd));
-		return new Event(a, t, c.fst, xs);
+			hs.add(c.snd);
+		return new Event(a, t, c.fst, hs);
 	}
 	
 	Event *processEnum(Edge *e, const Access& a) {
 		
 		// prepare the data
-		auto bank = a.blocks()[0]->bank();
+		auto bank = a.blockAt(0)->bank();
 		ot::time t;
 		if(a.action() == LOAD)
 			t = bank->readLatency();
@@ -298,18 +407,18 @@ protected:
 		
 		// prepare according to all blocks
 		Event::occurrence_t o = Event::NO_OCCURRENCE;
-		ilp::Expression xs;
-		for(auto cb: a.blocks()) {
-			auto c = classify(e, a, cb);
+		Vector<Block *> hs;
+		for(int i = 0; i < a.blockCount(); i++) {
+			auto c = classify(main, e, a, a.blockAt(i));
 			o = o | c.fst;
 			if(c.snd != nullptr)
-				xs.add(1., ipet::VAR(c.snd));
+				hs.add(c.snd);
 			else if(c.fst == Event::SOMETIMES)
 				return processAny(e, a);
 		}
 		
 		// build the event
-		return new Event(a, t, o, xs);
+		return new Event(a, t, o, hs);
 	}
 	
 	Event *processDirect(Edge *e, const Access& a) {
@@ -325,7 +434,7 @@ protected:
 			t = a.action() == DIRECT_LOAD ? bank->readLatency() : bank->writeLatency();
 			break;
 		case ENUM:
-			bank = a.blocks()[0]->bank();
+			bank = a.blockAt(0)->bank();
 			t = a.action() == DIRECT_LOAD ? bank->readLatency() : bank->writeLatency();
 			break;
 		default:
@@ -335,6 +444,12 @@ protected:
 		return new Event(a, t, Event::ALWAYS);
 	}
 
+	Event *processHit(Edge *e, const Access& a) {
+		auto bank = a.block()->bank();
+		main.cnt[AH]++;
+		return new Event(a, a.action() == HIT_LOAD ? bank->readLatency() : bank->writeLatency(), Event::NEVER);
+	}
+
 	/**
 	 * Build events for the given access. There is a specific optimization 
 	 * for multiple access instruction to T address: as the accesses are considered
@@ -357,6 +472,11 @@ protected:
 		case DIRECT_STORE:
 			evt = processDirect(e, a);
 			break;
+
+		case HIT_LOAD:
+		case HIT_STORE:
+			evt = processHit(e, a);
+			break;
 			
 		case PURGE:
 			return false;
@@ -393,19 +513,290 @@ protected:
 		return false;
 	}
 	
+	void processWorkSpace(WorkSpace *ws) override {
+		if(stream <= 0 && thread_count <= 1) {
+			BBProcessor::processWorkSpace(ws);
+			dumpCounts();
+			return;
+		}
+
+		// collect the basic blocks
+		Vector<BasicBlock *> bbs;
+		for(auto g: *COLLECTED_CFG_FEATURE.get(ws))
+			for(auto v: *g)
+				if(v->isBasic())
+					bbs.add(v->toBasic());
+
+		// classify the blocks group of sets by group of sets
+		int S = cache->setCount();
+		int n = stream > 0 ? stream : S;
+		for(int f = 0; f < S; f += n) {
+			int l = min(S, f + n);
+			if(stream > 0 && logFor(LOG_FUN))
+				log << "\tstreaming sets [" << f << ", " << l << "[\n";
+			classifyBBs(bbs, f, l);
+			if(stream > 0)
+				for(int i = f; i < l; i++)
+					dropSet(i);
+		}
+
+		// build the events from the recorded classifications
+		replay = true;
+		BBProcessor::processWorkSpace(ws);
+		replay = false;
+		main.memo.clear();
+		dumpCounts();
+	}
+
+	/**
+	 * Record the classifications of the blocks in the sets [f, l[ for
+	 * the given basic blocks. In multi-threaded mode (see @ref THREAD_COUNT),
+	 * the blocks are dispatched on the threads, each one recording the
+	 * classifications in its own memory. These memories are then merged
+	 * and the events are built sequentially from them so that the events,
+	 * and the ILP system, do not depend on the scheduling of the threads.
+	 * @param bbs	Classified blocks.
+	 * @param f		First set.
+	 * @param l		Set after the last one.
+	 */
+	void classifyBBs(const Vector<BasicBlock *>& bbs, int f, int l) {
+		int tc = min(thread_count, bbs.length());
+		if(tc <= 1) {
+			for(auto b: bbs)
+				streamBB(main, b, f, l);
+			return;
+		}
+
+		// run the workers
+		AllocArray<Worker> ws(tc);
+		for(int i = 0; i < tc; i++)
+			ws[i].cur.init(must, may, pers, mpers, prod);
+		std::atomic<int> next(0);
+		std::exception_ptr failure;
+		std::mutex failure_mutex;
+		auto worker = [&](int w) {
+			for(int i = next++; i < bbs.length(); i = next++) {
+				try {
+					streamBB(ws[w], bbs[i], f, l);
+				}
+				catch(...) {
+					std::lock_guard<std::mutex> lock(failure_mutex);
+					if(!failure)
+						failure = std::current_exception();
+					next = bbs.length();
+				}
+			}
+		};
+		Vector<std::thread *> threads;
+		for(int i = 1; i < tc; i++)
+			threads.add(new std::thread(worker, i));
+		worker(0);
+		for(auto t: threads) {
+			t->join();
+			delete t;
+		}
+
+		// propagate the failure, if any
+		if(failure)
+			std::rethrow_exception(failure);
+
+		// merge the results
+		for(int i = 0; i < tc; i++) {
+			main.memo.merge(ws[i].memo);
+			for(int c = 0; c < CAT_CNT; c++)
+				main.cnt[c] += ws[i].cnt[c];
+		}
+	}
+
+	/**
+	 * Record the classification of the blocks of b that belongs to the
+	 * sets [f, l[.
+	 * @param w		Current worker.
+	 * @param b		Current block.
+	 * @param f		First set.
+	 * @param l		Set after the last one.
+	 */
+	virtual void streamBB(Worker& w, BasicBlock *b, int f, int l) {
+		if(!StreamMemo<t>::touches(b, f, l))
+			return;
+		for(auto e: b->inEdges())
+			streamEdge(w, e, b, f, l);
+	}
+
+	/**
+	 * Record the classification of the blocks of the accesses of b,
+	 * along edge e, that belongs to the sets [f, l[.
+	 * @param w		Current worker.
+	 * @param e		Current edge.
+	 * @param b		Block containing the accesses.
+	 * @param f		First set.
+	 * @param l		Set after the last one.
+	 */
+	void streamEdge(Worker& w, Edge *e, Block *b, int f, int l) {
+		openCursors(w, e);
+		for(const auto& a: *ACCESSES(b)) {
+			if(a.action() == LOAD || a.action() == STORE) {
+				if(a.kind() == BLOCK)
+					record(w, e, a, a.block(), f, l);
+				else if(a.kind() == ENUM)
+					for(int i = 0; i < a.blockCount(); i++)
+						record(w, e, a, a.blockAt(i), f, l);
+			}
+			w.cur.next();
+		}
+		w.cur.close();
+	}
+
+	void record(Worker& w, Edge *e, const Access& a, const CacheBlock *cb, int f, int l) {
+		if(cb->set() >= f && cb->set() < l)
+			w.memo.put(e, a, cb, classify(w, e, a, cb), w.prefix);
+	}
+
+	void dropSet(int set) {
+		if(prod != nullptr)
+			prod->drop(set);
+		must->drop(set);
+		if(may != nullptr)
+			may->drop(set);
+		if(pers != nullptr)
+			pers->drop(set);
+		if(mpers != nullptr)
+			mpers->drop(set);
+	}
+
+	/**
+	 * Log the number of classified cache blocks by category.
+	 */
+	void dumpCounts() {
+		if(logFor(LOG_FUN))
+			for(int c = AH; c < CAT_CNT; c++)
+				log << "\t" << category_t(c) << ": " << main.cnt[c] << io::endl;
+	}
+
 	void processBB(WorkSpace *ws, CFG *g, Block *b_) override {
 		if(!b_->isBasic())
 			return;
 		auto b = b_->toBasic();
 
 		// set events
-		for(auto e: b->inEdges()) {
-			Inst *multi = nullptr;
-			for(const auto& a: *ACCESSES(b))
-				if(a.inst() != multi)
-					if(processAccess(e, a))
-						multi = a.inst();
+		if(aggregate)
+			processAggregated(b);
+		else
+			for(auto e: b->inEdges())
+				processEdge(e, b);
+	}
+
+	/**
+	 * Build the events of the accesses of b along edge e.
+	 * @param e		Current edge.
+	 * @param b		Block containing the accesses.
+	 */
+	void processEdge(Edge *e, BasicBlock *b) {
+		processAccesses(e, b);
+	}
+
+	/**
+	 * Build the events of the accesses of b along edge e using the main
+	 * worker. If the classifications are replayed, the cursors are not
+	 * needed and are not opened.
+	 * @param e		Current edge.
+	 * @param b		Block containing the accesses.
+	 */
+	void processAccesses(Edge *e, Block *b) {
+		Inst *multi = nullptr;
+		if(!replay)
+			openCursors(main, e);
+		for(const auto& a: *ACCESSES(b)) {
+			if(a.inst() != multi)
+				if(processAccess(e, a))
+					multi = a.inst();
+			if(!replay)
+				main.cur.next();
 		}
+		if(!replay)
+			main.cur.close();
+	}
+
+	/**
+	 * Build the events of b in aggregation mode (see @ref AGGREGATE_EVENTS):
+	 * the events are first built for each in-edge and, if they are the same
+	 * for all in-edges, the events of the first edge are hooked to all
+	 * in-edges (an event object is then shared by all in-edges). Each in-edge
+	 * is still classified and gets its own events in the ILP: only the
+	 * merge of the ALWAYS and NEVER events of a same instruction, done in
+	 * both cases, reduces the ILP system.
+	 * @param b		Current block.
+	 */
+	void processAggregated(BasicBlock *b) {
+
+		// build the events of each edge
+		Vector<Edge *> es;
+		for(auto e: b->inEdges())
+			es.add(e);
+		if(es.isEmpty())
+			return;
+		AllocArray<Vector<Event *> > evts(es.length());
+		for(int i = 0; i < es.length(); i++) {
+			buffer = &evts[i];
+			processEdge(es[i], b);
+			merge(evts[i]);
+		}
+		buffer = nullptr;
+
+		// all the same?
+		bool same = true;
+		for(int i = 1; same && i < es.length(); i++)
+			same = equals(evts[0], evts[i]);
+
+		// hook the events
+		if(same) {
+			if(logFor(LOG_BLOCK) && es.length() > 1)
+				log << "\t\t\tevents of " << es.length() << " edges shared on " << b << io::endl;
+			for(auto evt: evts[0]) {
+				categorize(evt);
+				for(auto e: es)
+					EVENT(e).add(evt);
+			}
+			for(int i = 1; i < es.length(); i++)
+				for(auto evt: evts[i])
+					delete evt;
+		}
+		else
+			for(int i = 0; i < es.length(); i++)
+				for(auto evt: evts[i])
+					EventBuilder::addEvent(es[i], evt);
+	}
+
+	/**
+	 * Merge the successive ALWAYS or NEVER events of a same instruction.
+	 * @param evts	List of events to merge.
+	 */
+	void merge(Vector<Event *>& evts) {
+		int j = 0;
+		for(int i = 1; i < evts.length(); i++)
+			if(evts[j]->canMerge(*evts[i])) {
+				evts[j]->merge(*evts[i]);
+				delete evts[i];
+			}
+			else
+				evts[++j] = evts[i];
+		if(!evts.isEmpty())
+			evts.setLength(j + 1);
+	}
+
+	/**
+	 * Test if two lists of events are equal.
+	 * @param l1	First list.
+	 * @param l2	Second list.
+	 * @return		True if both lists are equal, false else.
+	 */
+	static bool equals(const Vector<Event *>& l1, const Vector<Event *>& l2) {
+		if(l1.length() != l2.length())
+			return false;
+		for(int i = 0; i < l1.length(); i++)
+			if(!l1[i]->equals(*l2[i]))
+				return false;
+		return true;
 	}
 	
 	void dumpBB(Block *v, io::Output& out) override {
@@ -423,14 +814,21 @@ protected:
 
 	AgeInfo *must, *may, *pers;
 	MultiAgeInfo *mpers;
+	ProductInfo *prod;
+	Worker main;
+	bool replay;
 	
 private:
 	const hard::Memory *mem;
 	int A;
-	int cnt[CAT_CNT];
 	ilp::System *sys;
 	bool _explicit;
 	const hard::Cache *cache;
+	const Categories *cats;
+	bool aggregate;
+	Vector<Event *> *buffer;
+	int stream;
+	int thread_count;
 };
 
 
@@ -449,50 +847,40 @@ p::declare EventBuilder::reg = p::init("otawa::dcache::EventBuilder", Version(1,
 class PrefixEventBuilder: public EventBuilder {
 public:
 	static p::declare reg;
-	PrefixEventBuilder(p::declare& r = reg): EventBuilder(r), prefix(false) {}
+	PrefixEventBuilder(p::declare& r = reg): EventBuilder(r) {}
 
 protected:
 	
 	void addEvent(Edge *e, Event *evt) override {
-		if(prefix)
+		if(main.prefix) {
+			categorize(evt);
 			PREFIX_EVENT(e).add(evt);
+		}
 		else
 			EventBuilder::addEvent(e, evt);
 	}
 	
-	int mustAge(Edge *e, const Access &a, const CacheBlock *cb) override {
-		if(prefix)
-			return must->age(e->source(), a, cb);
-		else
-			return EventBuilder::mustAge(e, a, cb);
-	}
-
-	int mayAge(Edge *e, const Access &a, const CacheBlock *cb) override {
-		if(prefix)
-			return may->age(e->source(), a, cb);
+	void openCursors(Worker& w, Edge *e) override {
+		if(!w.prefix)
+			EventBuilder::openCursors(w, e);
 		else
-			return EventBuilder::mayAge(e, a, cb);
-	}
-
-	int persAge(Edge *e, const Access &a, const CacheBlock *cb) override {
-		if(prefix)
-			return pers->age(e->source(), a, cb);
-		else
-			return EventBuilder::persAge(e, a, cb);
-	}
-
-	int mpersLevel(Edge *e, const Access &a, const CacheBlock *cb) override {
-		if(prefix)
-			return mpers->level(e->source(), a, cb);
-		else
-			return EventBuilder::mpersLevel(e, a, cb);
+			w.cur.open(e->source());
 	}
 	
-	Block *eventBlock(Edge * e) override {
-		if(prefix)
+	Block *eventBlock(Worker& w, Edge * e) override {
+		if(w.prefix)
 			return e->source();
 		else
-			return EventBuilder::eventBlock(e);
+			return EventBuilder::eventBlock(w, e);
+	}
+
+	void streamBB(Worker& w, BasicBlock *b, int f, int l) override {
+		w.prefix = true;
+		for(auto e: b->inEdges())
+			if(StreamMemo<t>::touches(e->source(), f, l))
+				streamEdge(w, e, e->source(), f, l);
+		w.prefix = false;
+		EventBuilder::streamBB(w, b, f, l);
 	}
 
 	void processBB(WorkSpace *ws, CFG *g, Block *v) override {
@@ -501,15 +889,10 @@ protected:
 		auto b = v->toBasic();
 
 		// set events
-		prefix = true;
-		for(auto e: b->inEdges()) {
-			Inst *multi = nullptr;
-			for(const auto& a: *ACCESSES(e->source()))
-				if(a.inst() != multi)
-					if(processAccess(e, a))
-						multi = a.inst();
-		}
-		prefix = false;
+		main.prefix = true;
+		for(auto e: b->inEdges())
+			processAccesses(e, e->source());
+		main.prefix = false;
 		EventBuilder::processBB(ws, g, v);
 	}
 
@@ -530,8 +913,6 @@ protected:
 				out << "\t\t[B]" << evts[i]->detail() << io::endl;			
 		}
 	}
-
-	bool prefix;
 };
 
 
@@ -545,11 +926,16 @@ p::declare PrefixEventBuilder::reg =
 	
 /**
  * Ensure that events generated by the instruction cache analysis are linked
- * to the edge.
+ * to the edge. In aggregation mode (see @ref AGGREGATE_EVENTS), when the
+ * events of a block are the same along all its in-edges, the same event
+ * objects are linked to each in-edge.
  * 
  * Properties:
  *  @ref otawa::EVENT
  * 
+ * Configuration:
+ *  @ref otawa::dcache::AGGREGATE_EVENTS
+ * 
  * Default implementation: @ref otawa::dcache::EventBuilder
  * 
  * @ingroup dcache
@@ -557,6 +943,23 @@ p::declare PrefixEventBuilder::reg =
 p::feature EVENTS_FEATURE("otawa::dcache::EVENTS_FEATURE", p::make<EventBuilder>());
 
 
+/**
+ * Configuration of @ref EVENTS_FEATURE: when true, the successive ALWAYS or
+ * NEVER events of a same instruction are merged in a single event cumulating
+ * their costs. This merge is the only reduction of the ILP system: the
+ * accesses are still classified along each in-edge and, when the events of
+ * a block are the same along all its in-edges, the event objects of the
+ * first in-edge are shared by all in-edges but each in-edge keeps its
+ * events in the ILP. The events remain linked to the edges, as without
+ * aggregation, so that the WCET is unchanged.
+ *
+ * Default value: false.
+ *
+ * @ingroup dcache
+ */
+p::id<bool> AGGREGATE_EVENTS("otawa::dcache::AGGREGATE_EVENTS", false);
+
+
 /**
  * Ensure that events generated by the instruction cache analysis, generated by
  * the previous block, are linked to the edge.
@@ -0,0 +1,210 @@
+/*
+ *	FootprintBuilder class
+ *
+ *	This file is part of OTAWA
+ *	Copyright (c) 2020, IRIT UPS.
+ *
+ *	OTAWA is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	OTAWA is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with OTAWA; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <otawa/cfg/features.h>
+#include <otawa/proc/Processor.h>
+
+#include "otawa/dcache/features.h"
+
+namespace otawa { namespace dcache {
+
+/**
+ * @class Footprint
+ * Footprint of a function: the sets its accesses, or the accesses of the
+ * functions it calls, may touch. A function accessing an unknown address
+ * (@ref ANY access) touches all sets.
+ * @ingroup dcache
+ */
+
+/**
+ * Build an empty footprint.
+ * @param set_count		Number of sets.
+ */
+Footprint::Footprint(int set_count): _sets(set_count), _any(false) {
+}
+
+/**
+ * @fn bool Footprint::touches(int set) const;
+ * Test if the function may touch the given set.
+ * @param set	Tested set.
+ * @return		True if the set may be touched, false else.
+ */
+
+/**
+ * @fn bool Footprint::accessesAny() const;
+ * Test if the function performs accesses to unknown addresses (@ref ANY).
+ * @return	True if there is an access to any address, false else.
+ */
+
+/**
+ * @fn const BitVector& Footprint::sets() const;
+ * Get the sets accessed by known addresses.
+ * @return	Accessed sets.
+ */
+
+/**
+ * @fn void Footprint::add(int set);
+ * Add a set to the footprint.
+ * @param set	Added set.
+ */
+
+/**
+ * @fn void Footprint::setAny();
+ * Record the footprint contains an access to an unknown address.
+ */
+
+/**
+ * Add the given footprint to the current one.
+ * @param f		Added footprint.
+ * @return		True if the current footprint has changed, false else.
+ */
+bool Footprint::add(const Footprint& f) {
+	bool changed = false;
+	if(f._any && !_any) {
+		_any = true;
+		changed = true;
+	}
+	if(!_sets.includes(f._sets)) {
+		_sets.applyOr(f._sets);
+		changed = true;
+	}
+	return changed;
+}
+
+
+/**
+ * Compute the @ref Footprint of each function of the program: the sets
+ * accessed by the function itself are collected from @ref SET_ACCESSES
+ * and then the footprints of the called functions are added up to a
+ * fixpoint (to support recursive calls).
+ *
+ * Provided features:
+ * * @ref otawa::dcache::FOOTPRINT_FEATURE
+ *
+ * Required features:
+ * * @ref otawa::dcache::ACCESS_FEATURE
+ * * @ref otawa::COLLECTED_CFG_FEATURE
+ *
+ * @ingroup dcache
+ */
+class FootprintBuilder: public Processor {
+public:
+	static p::declare reg;
+	FootprintBuilder(p::declare& r = reg): Processor(r) { }
+
+protected:
+
+	void processWorkSpace(WorkSpace *ws) override {
+		int S = ACCESS_FEATURE.get(ws)->setCount();
+		auto cfgs = COLLECTED_CFG_FEATURE.get(ws);
+
+		// footprints of the function bodies
+		for(auto g: *cfgs) {
+			auto f = new Footprint(S);
+			for(auto v: *g) {
+				if(!v->isBasic())
+					continue;
+				auto sa = SET_ACCESSES(v);
+				if(sa == nullptr)
+					continue;
+				for(int i = 0; i < sa->count(); i++)
+					f->add(sa->set(i));
+				for(int i = 0; i < sa->wideCount(); i++)
+					if(sa->wide(i).isAny())
+						f->setAny();
+					else
+						for(int s = 0; s < S; s++)
+							if(sa->wide(i).access(s))
+								f->add(s);
+			}
+			FOOTPRINT(g) = f;
+		}
+
+		// add the footprints of the callees
+		bool changed = true;
+		while(changed) {
+			changed = false;
+			for(auto g: *cfgs) {
+				Footprint *f = FOOTPRINT(g);
+				for(auto v: *g)
+					if(v->isSynth() && v->toSynth()->callee() != nullptr) {
+						const Footprint *cf = FOOTPRINT(v->toSynth()->callee());
+						if(f->add(*cf))
+							changed = true;
+					}
+			}
+		}
+
+		// log the footprints
+		if(logFor(LOG_CFG))
+			for(auto g: *cfgs) {
+				auto f = FOOTPRINT(g);
+				log << "\tfunction " << g << ": ";
+				if(f->accessesAny())
+					log << "all sets (T access)\n";
+				else
+					log << f->sets().countBits() << " sets\n";
+			}
+	}
+
+	void destroy(WorkSpace *ws) override {
+		for(auto g: *COLLECTED_CFG_FEATURE.get(ws)) {
+			delete FOOTPRINT(g);
+			FOOTPRINT(g).remove();
+		}
+	}
+};
+
+///
+p::declare FootprintBuilder::reg = p::init("otawa::dcache::FootprintBuilder", Version(1, 0, 0))
+	.require(ACCESS_FEATURE)
+	.require(COLLECTED_CFG_FEATURE)
+	.provide(FOOTPRINT_FEATURE)
+	.make<FootprintBuilder>();
+
+
+/**
+ * Property providing, for a CFG, the footprint of the function
+ * (see @ref Footprint).
+ *
+ * Feature:
+ * * @ref otawa::dcache::FOOTPRINT_FEATURE
+ *
+ * @ingroup dcache
+ */
+p::id<Footprint *> FOOTPRINT("otawa::dcache::FOOTPRINT", nullptr);
+
+
+/**
+ * Ensures that each function of the program is labelled with its footprint,
+ * that is, the sets it may touch (including the functions it calls).
+ *
+ * Properties:
+ * * @ref otawa::dcache::FOOTPRINT
+ *
+ * Processors:
+ * * @ref otawa::dcache::FootprintBuilder
+ *
+ * @ingroup dcache
+ */
+p::feature FOOTPRINT_FEATURE("otawa::dcache::FOOTPRINT_FEATURE", p::make<FootprintBuilder>());
+
+} }		// otawa::dcache
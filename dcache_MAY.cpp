@@ -30,18 +30,10 @@ namespace otawa { namespace dcache {
  * Implements the MAY instruction cache analysis.
  * @ingroup dcache
  */
-class MAYAnalysis: public Analysis, public AgeInfo, public GCManager {
+class MAYAnalysis: public Analysis, public AgeInfo {
 public:
 	static p::declare reg;
-	MAYAnalysis(): Analysis(reg), A(0), gc(*this) { }
-
-	void collect(AbstractGC& gc) override {
-		Analysis::collect([&](ai::State *s) { gc.mark(s, sizeof(ACS)); });
-	}
-
-	void clean(void *p) override {
-		reinterpret_cast<ACS *>(p)->~ACS();
-	}
+	MAYAnalysis(): Analysis(reg), A(0) { }
 
 	void *interfaceFor(const AbstractFeature& f) override {
 		if(&f == &MAY_FEATURE)
@@ -84,6 +76,18 @@ public:
 		Analysis::release(a);
 	}
 
+	void drop(int set) override {
+		Analysis::drop(set);
+	}
+
+	AgeInfo::Cursor *cursor(otawa::Block *v) override {
+		return new ACSCursor(*this, v);
+	}
+
+	AgeInfo::Cursor *cursor(Edge *e) override {
+		return new ACSCursor(*this, e);
+	}
+
 protected:
 
 	void setup(WorkSpace *ws) override {
@@ -91,17 +95,11 @@ protected:
 		Analysis::setup(ws);
 	}
 
-	void cleanup(WorkSpace *ws) override {
-		gc.runGC();
-		Analysis::cleanup(ws);
-	}
-
 	Domain *domainFor(const SetCollection& coll, int set) override {
-		return new MAY(coll, set, A, gc);
+		return new MAY(coll, set, A, gcFor(set), hashConsing());
 	}
 
 	int A;
-	ListGC gc;
 };
 
 ///
@@ -125,9 +123,9 @@ p::interfaced_feature<AgeInfo> MAY_FEATURE("otawa::dcache::MAY_FEATURE", p::make
  */
 
 ///
-MAY::MAY(const SetCollection& collection, int set, int assoc, ListGC& gc):
-	ACSDomain(collection, set, assoc, 0, gc),
-	EMPTY(make(0))
+MAY::MAY(const SetCollection& collection, int set, int assoc, ListGC& gc, bool sharing):
+	ACSDomain(collection, set, assoc, 0, gc, sharing),
+	EMPTY(share(make(0)))
 {
 	ASSERT(A > 0);
 }
@@ -147,24 +145,19 @@ ai::State *MAY::join(ai::State *_1, ai::State *_2) {
 	else if(s1 == TOP || s2 == TOP)
 		return TOP;
 	else {
-		os = make();
-		auto s = 0;
-		for(int i = 0; i < N; i++) {
-			os->age[i] = min(s1->age[i], s2->age[i]);
-			s += os->age[i];
-		}
-		if(s == sumA)
+		os = alloc();
+		kernel::min(os->age, s1->age, s2->age, N);
+		if(sum(os) == sumA)
 			return TOP;
-		return os;
+		return os = share(os);
 	}
 }
 
 ///
 ai::State *MAY::update(Block *v, ai::State *s) {
 	os = acs(s);
-	for(const auto& a: *ACCESSES(v))
-		if(a.access(S))
-			os = acs(update(a, os));
+	for(auto a: SetAccesses::of(v, S))
+		os = acs(update(*a, os));
 	return os;
 }
 
@@ -176,6 +169,22 @@ ai::State *MAY::update(const Access& a, ai::State *s_) {
 	if(s == BOT)
 		return s;
 
+	auto r = memo(a, s);
+	if(r == nullptr) {
+		in = s;
+		r = memo(a, s, transfer(a, s));
+		in = nullptr;
+	}
+	return r;
+}
+
+/**
+ * Compute the effect of the given access on the given ACS.
+ * @param a		Performed access.
+ * @param s		Input ACS.
+ * @return		Output ACS.
+ */
+ACS *MAY::transfer(const Access& a, ACS *s) {
 	switch(a.action()) {
 
 	case NO_ACCESS:
@@ -196,7 +205,7 @@ ai::State *MAY::update(const Access& a, ai::State *s_) {
 		switch(a.kind()) {
 		case ANY:	return TOP;
 		case BLOCK:	return purge(s, a.block()->id());
-		case ENUM:	return purge(s, a.block()->id());
+		case ENUM:	return purge(s, a.blockIn(S)->id());
 		case RANGE:	return TOP;
 		}
 		break;
@@ -210,15 +219,11 @@ ai::State *MAY::update(const Access& a, ai::State *s_) {
 
 ///
 ACS *MAY::access(ACS *is, int b) {
-	os = make();
-	auto ba = is->age[b];
-	for(int i = 0; i < N; i++)
-		if(is->age[i] <= ba && is->age[i] != A)
-			os->age[i] = is->age[i] + 1;
-		else
-			os->age[i] = is->age[i];
+	os = alloc();
+	// age <= ba && age != A  <=>  age <= min(ba, A - 1)
+	kernel::age(os->age, is->age, N, min(int(is->age[b]), A - 1));
 	os->age[b] = 0;
-	return os;
+	return os = share(os);
 }
 
 ///
@@ -227,7 +232,7 @@ ACS *MAY::purge(ACS *is, int b) {
 	os->age[b] = A;
 	if(sum(os) == sumA)
 		return TOP;
-	return os;
+	return os = share(os);
 }
 
 ///
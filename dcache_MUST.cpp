@@ -23,17 +23,28 @@
 #include <elm/data/ListMap.h>
 #include "otawa/dcache/Analysis.h"
 #include "otawa/dcache/MUST.h"
+#include "otawa/dcache/SmallMUST.h"
 
 namespace otawa { namespace dcache {
 
 /**
  * Implements the MUST instruction cache analysis.
+ *
+ * For associativities 1, 2, 4 and 8, the sets are analyzed with the
+ * @ref SmallMUST domain (unless @ref SMALL_MUST is false). Then, acsBefore()
+ * and acsAfter() build the returned ACS out of the garbage-collected memory
+ * and release() frees them.
  * @ingroup dcache
  */
-class MUSTAnalysis: public Analysis, public AgeInfo, public GCManager {
+class MUSTAnalysis: public Analysis, public AgeInfo {
 public:
 	static p::declare reg;
-	MUSTAnalysis(): Analysis(reg), A(0), gc(*this) { }
+	MUSTAnalysis(): Analysis(reg), sets(nullptr), A(0), small(false), small_on(true) { }
+
+	void configure(const PropList& props) override {
+		Analysis::configure(props);
+		small_on = SMALL_MUST(props);
+	}
 
 	void *interfaceFor(const AbstractFeature& f) override {
 		if(&f == &MUST_FEATURE)
@@ -47,62 +58,111 @@ public:
 	}
 
 	int age(otawa::Block *v, const Access& a, const CacheBlock *b) override {
-		auto s = acs(at(v, a, b->set()));
-		auto r = s->age[b->id()];
+		auto s = at(v, a, b->set());
+		auto r = ageOf(s, b);
 		Analysis::release(s);
 		return r;
 	}
 
 	int age(Edge *e, const Access& a, const CacheBlock *b) override {
-		auto s = acs(at(e, a, b->set()));
-		auto r = s->age[b->id()];
+		auto s = at(e, a, b->set());
+		auto r = ageOf(s, b);
 		Analysis::release(s);
 		return r;
 	}
 
 	ACS *acsBefore(Block *b, int s) override {
-		return acs(before(b, s));
+		return expand(before(b, s), s);
 	}
 
 	ACS *acsAfter(Block *b, int s) override {
-		return acs(after(b, s));
+		return expand(after(b, s), s);
 	}
 
 	ACS *acsAfter(Edge *e, int s) override {
-		return acs(after(e, s));
+		return expand(after(e, s), s);
 	}
 
 	void release(ACS *a) override {
-		Analysis::release(a);
+		if(!small)
+			Analysis::release(a);
+		else {
+			a->~ACS();
+			delete [] reinterpret_cast<char *>(a);
+		}
 	}
 
-	void collect(AbstractGC& gc) override {
-		Analysis::collect([&](ai::State *s) { gc.mark(s, sizeof(ACS)); });
+	void drop(int set) override {
+		Analysis::drop(set);
+	}
+
+	AgeInfo::Cursor *cursor(otawa::Block *v) override {
+		if(!small)
+			return new ACSCursor(*this, v);
+		else
+			return new SmallCursor(*this, v);
 	}
 
-	void clean(void *p) override {
-		reinterpret_cast<ACS *>(p)->~ACS();
+	AgeInfo::Cursor *cursor(Edge *e) override {
+		if(!small)
+			return new ACSCursor(*this, e);
+		else
+			return new SmallCursor(*this, e);
 	}
 
 protected:
 
 	void setup(WorkSpace *ws) override {
-		A = dcache::actualAssoc(ACCESS_FEATURE.get(ws)->cache());
+		sets = ACCESS_FEATURE.get(ws);
+		A = dcache::actualAssoc(sets->cache());
+		small = small_on && (A == 1 || A == 2 || A == 4 || A == 8);
 		Analysis::setup(ws);
 	}
 
-	void cleanup(WorkSpace *ws) {
-		gc.runGC();
-		Analysis::cleanup(ws);
+	t::uint32 format() const override {
+		return small ? 1 : 0;
 	}
 
 	Domain *domainFor(const SetCollection& coll, int set) override {
-		return new MUST(coll, set, A, gc);
+		switch(small ? A : 0) {
+		case 1:		return new SmallMUST<1>(coll, set, gcFor(set));
+		case 2:		return new SmallMUST<2>(coll, set, gcFor(set));
+		case 4:		return new SmallMUST<4>(coll, set, gcFor(set));
+		case 8:		return new SmallMUST<8>(coll, set, gcFor(set));
+		default:	return new MUST(coll, set, A, gcFor(set), hashConsing());
+		}
 	}
 
+private:
+
+	class SmallCursor: public AgeInfo::Cursor {
+	public:
+		inline SmallCursor(Analysis& analysis, otawa::Block *v): c(analysis, v) { }
+		inline SmallCursor(Analysis& analysis, Edge *e): c(analysis, e) { }
+		int age(const CacheBlock *b) override
+			{ return sacs(c.state(b->set()))->age(b->id()); }
+		void next() override { c.next(); }
+	private:
+		Analysis::BlockCursor c;
+	};
+
+	inline int ageOf(ai::State *s, const CacheBlock *b) const
+		{ return small ? sacs(s)->age(b->id()) : acs(s)->age[b->id()]; }
+
+	// build an ACS out of the GC from a SmallACS (the state is released)
+	ACS *expand(ai::State *s, int set) {
+		if(!small)
+			return acs(s);
+		int N = sets->blockCount(set);
+		auto r = sacs(s)->expand(N, new char[ACS::size(N)]);
+		Analysis::release(s);
+		return r;
+	}
+
+	const SetCollection *sets;
 	int A;
+	bool small, small_on;
 	ListMap<ACS *, int> kept;
-	ListGC gc;
 };
 
 ///
@@ -118,15 +178,49 @@ p::declare MUSTAnalysis::reg = p::init("otawa::dcache::MUSTAnalysis", Version(1,
 p::interfaced_feature<AgeInfo> MUST_FEATURE("otawa::dcache::MUST_FEATURE", p::make<MUSTAnalysis>());
 
 
+/**
+ * This property is a configuration of MUSTAnalysis. If set to false, the
+ * generic @ref MUST domain is used for all associativities, instead of
+ * @ref SmallMUST for associativities 1, 2, 4 and 8 (default true). Both
+ * give the same ages: this is mainly useful to check it.
+ */
+p::id<bool> SMALL_MUST("otawa::dcache::SMALL_MUST", true);
+
+
 /**
  * @class MUST
  * Provides the implementation of the domain for the MUST analysis.
  * @ingroup dcache
  */
 
+
+/**
+ * @class SmallACS
+ * Abstract cache state of the @ref SmallMUST domain: instead of an age per
+ * block of the set, it records only the blocks younger than the associativity
+ * W (at most W blocks in a MUST state) with their age. The other blocks
+ * have the age W (or ACS::BOT in the BOT state).
+ *
+ * The entries are stored inline, after the header: a SmallACS for
+ * associativity W must be allocated with a size of SmallACS::size(W) bytes.
+ * @ingroup dcache
+ */
+
+/**
+ * @class SmallMUST
+ * Implementation of the MUST domain for a small associativity W known at
+ * compile time (used for W in {1, 2, 4, 8}). The states are @ref SmallACS
+ * so that their size and the cost of the operations depend only on W, and
+ * not on the number of blocks of the set, and the loops on the ways are
+ * unrolled. The computed ages are the same as with @ref MUST. Hash-consing
+ * (@ref HASH_CONSING) is not supported: the states are small enough.
+ * @param W		Associativity.
+ * @ingroup dcache
+ */
+
 ///
-MUST::MUST(const SetCollection& collection, int set, int assoc, ListGC& gc):
-	ACSDomain(collection, set, assoc, assoc, gc)
+MUST::MUST(const SetCollection& collection, int set, int assoc, ListGC& gc, bool sharing):
+	ACSDomain(collection, set, assoc, assoc, gc, sharing)
 	{ }
 
 
@@ -140,24 +234,38 @@ ai::State *MUST::join(ai::State *_1, ai::State *_2) {
 	else if(s1 == TOP || s2 == TOP)
 		return TOP;
 	else {
-		os = make(N);
-		auto s = 0;
-		for(int i = 0; i < N; i++) {
-			os->age[i] = max(s1->age[i], s2->age[i]);
-			s += os->age[i];
-		}
-		if(s == sumA)
+		os = alloc();
+		kernel::max(os->age, s1->age, s2->age, N);
+		if(sum(os) == sumA)
 			return TOP;
-		return os;
+		return os = share(os);
 	}
 }
 
 ///
 ai::State *MUST::update(Block *v, ai::State *s) {
 	os = acs(s);
-	for(const auto& a: *ACCESSES(v))
-		if(a.access(S))
-			os = acs(update(a, os));
+	if(os == BOT)
+		return os;
+
+	// the sequences of accesses to unknown blocks are applied at once
+	int k = 0;
+	const Access *f = nullptr;
+	for(auto a: SetAccesses::of(v, S))
+		if(agesAll(*a)) {
+			if(k == 0)
+				f = a;
+			k++;
+		}
+		else {
+			if(k != 0) {
+				os = accessAny(*f, os, k);
+				k = 0;
+			}
+			os = acs(update(*a, os));
+		}
+	if(k != 0)
+		os = accessAny(*f, os, k);
 	return os;
 }
 
@@ -169,6 +277,22 @@ ai::State *MUST::update(const Access& a, ai::State *s_) {
 	if(s == BOT)
 		return s;
 
+	auto r = memo(a, s);
+	if(r == nullptr) {
+		in = s;
+		r = memo(a, s, transfer(a, s));
+		in = nullptr;
+	}
+	return r;
+}
+
+/**
+ * Compute the effect of the given access on the given ACS.
+ * @param a		Performed access.
+ * @param s		Input ACS.
+ * @return		Output ACS.
+ */
+ACS *MUST::transfer(const Access& a, ACS *s) {
 	switch(a.action()) {
 
 	case NO_ACCESS:
@@ -189,7 +313,7 @@ ai::State *MUST::update(const Access& a, ai::State *s_) {
 		switch(a.kind()) {
 		case ANY:	return TOP;
 		case BLOCK:	return purge(s, a.block()->id());
-		case ENUM:	return purge(s, a.block()->id());
+		case ENUM:	return purge(s, a.blockIn(S)->id());
 		case RANGE:	return TOP;
 		}
 		break;
@@ -206,27 +330,18 @@ ai::State *MUST::update(const Access& a, ai::State *s_) {
 ACS *MUST::access(ACS *is, int b) {
 	if(is == BOT)
 		return is;
-	os = make();
-	auto ba = is->age[b];
-	for(int i = 0; i < N; i++)
-		if(is->age[i] <= ba && is->age[i] != A)
-			os->age[i] = is->age[i] + 1;
-		else
-			os->age[i] = is->age[i];
+	os = alloc();
+	// age <= ba && age != A  <=>  age <= min(ba, A - 1)
+	kernel::age(os->age, is->age, N, min(int(is->age[b]), A - 1));
 	os->age[b] = 0;
-	return os;
+	return os = share(os);
 }
 
 ///
 ACS *MUST::preaccess(ACS *is, int b) {
-	os = make();
-	auto ba = is->age[b];
-	for(int i = 0; i < N; i++)
-		if(is->age[i] <= ba)
-			os->age[i] = is->age[i] + 1;
-		else
-			os->age[i] = is->age[i];
-	return os;
+	os = alloc();
+	kernel::age(os->age, is->age, N, is->age[b]);
+	return os = share(os);
 }
 
 ///
@@ -235,20 +350,45 @@ ACS *MUST::purge(ACS *is, int b) {
 	os->age[b] = A;
 	if(sum(os) == sumA)
 		return TOP;
-	return os;
+	return os = share(os);
 }
 
-///
-ACS *MUST::accessAny(ACS *is) {
-	os = make();
-	auto s = 0;
-	for(int i = 0; i < N; i++) {
-		os->age[i] = min(int(A), is->age[i] + 1);
-		s += os->age[i];
-	}
-	if(s == sumA)
+/**
+ * Compute the effect of k accesses to unknown blocks: all blocks get older
+ * by k. If k is greater or equal to the associativity or if the state
+ * is TOP, the result is TOP without looking to the ages. Else, it costs one
+ * pass over the ages whatever k: update(Block) batches the runs of such
+ * accesses but an isolated access is not cheaper than with k = 1.
+ * @param is	Input ACS (not BOT).
+ * @param k		Number of accesses.
+ * @return		Output ACS.
+ */
+ACS *MUST::accessAny(ACS *is, int k) {
+	if(is == TOP || k >= A)
 		return TOP;
-	return os;
+	os = alloc();
+	kernel::ageAll(os->age, is->age, N, A, k);
+	if(sum(os) == sumA)
+		return TOP;
+	return os = share(os);
+}
+
+/**
+ * Compute, through the memo, the effect of a run of k accesses to unknown
+ * blocks starting with access a.
+ * @param a		First access of the run.
+ * @param s		Input ACS.
+ * @param k		Number of accesses of the run.
+ * @return		Output ACS.
+ */
+ACS *MUST::accessAny(const Access& a, ACS *s, int k) {
+	auto r = memo(a, s, k);
+	if(r == nullptr) {
+		in = s;
+		r = memo(a, s, accessAny(s, k), k);
+		in = nullptr;
+	}
+	return r;
 }
 
 } };	// otawa::dcache
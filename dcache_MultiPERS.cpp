@@ -29,67 +29,81 @@ namespace otawa { namespace dcache {
  * Implements the multi-persistence analysis: the ACS is a stack of ACS where
  * each element corresponds to a loop level. This lets the persistence
  * analysis to apply to inner loops and to improve its precision.
+ *
+ * The stack is persistent: a multi-ACS is a list of runs, from the innermost
+ * level to the outermost one, each run being a count of consecutive levels
+ * with the same ACS. The outer runs that are not changed by an operation are
+ * shared by pointer between the multi-ACS and the levels equal to their
+ * neighbour are stored once.
  * @ingroup dcache
  */
 
 /**
- * Build a multi-ACS with the given depth.
- * @param D		Depth of the ACS.
- * @param I		Initial value of each ACS (optional).
+ * Build a multi-ACS by adding a run of levels on top of outer.
+ * @param set	Set of the multi-ACS.
+ * @param a		ACS of the added levels.
+ * @param count	Count of added levels.
+ * @param outer	Outer levels (null for none).
  */
-MultiACS::MultiACS(int D, ACS *I): as(D, new ACS *[D]) {
-	for(int i = 0; i < D; i++)
-		as[i] = I;
+MultiACS::MultiACS(int set, ACS *a, int count, MultiACS *outer):
+	GCState(set),
+	_acs(a),
+	_count(count),
+	_depth(count + (outer == nullptr ? 0 : outer->_depth)),
+	_outer(outer)
+{
+	ASSERT(count > 0);
 }
 
 /**
- * Build an ACS by duplicating the given one.
- * @param a		Duplicated ACS.
+ * @fn int MultiACS::depth() const;
+ * Get the count of levels of the multi-ACS.
+ * @return	Multi-ACS depth.
  */
-MultiACS::MultiACS(MultiACS *a): as(a->as.count(), new ACS *[a->as.count()]) {
-	for(int i = 0; i < as.count(); i++)
-		as[i] = a->as[i];
-}
 
 /**
- * Build a multi-ACS by copying the given but with a different depth.
- * If the depth is less than the depth of a, the copy is just truncated.
- * Else the additional ACS is set to i.
- * @param a		Multi-ACS to copy.
- * @param D		Resulting ACS depth.
- * @param i		ACS to initialize non-copied part.
+ * @fn ACS *MultiACS::inner() const;
+ * Get the ACS of the innermost run.
+ * @return	Innermost ACS.
  */
-MultiACS::MultiACS(MultiACS *a, int D, ACS *i): MultiACS(a, a->as.count(), D, i) {
-}
 
+/**
+ * @fn int MultiACS::count() const;
+ * Get the count of levels of the innermost run.
+ * @return	Innermost run level count.
+ */
 
 /**
- * Build a multi-ACS by copying the given one but with a different depth
- * only a part of the original ACS.
- * 
- * The OD ACS of original multi-ACS are copied as is and ACS in depth OD+1 to ND
- * (if any) are initialized with i.
- * @param a		Multi-ACS to copy.
- * @param OD	Original ACS depth to preserve (must be less than a depth).
- * @param ND	Resulting ACS depth.
- * @param i		ACS to initialize non-copied part.
+ * @fn MultiACS *MultiACS::outer() const;
+ * Get the runs outer to the innermost run.
+ * @return	Outer runs or null.
  */
-MultiACS::MultiACS(MultiACS *a, int OD, int ND, ACS *i): as(ND, new ACS *[ND]) {
-	ASSERT(OD <= a->as.count());
-	int b = min(OD, ND);
-	for(int j = 0; j < b; j++)
-		as[j] = a->as[j];
-	for(int j = b; j < ND; j++)
-		as[j] = i;
-}
 
+/**
+ * Get the ACS of a level.
+ * @param i		Level index, from 0 (outermost) to depth() - 1 (innermost).
+ * @return		ACS of the level.
+ */
+ACS *MultiACS::level(int i) const {
+	ASSERT(0 <= i && i < _depth);
+	auto p = this;
+	while(p->_depth - p->_count > i)
+		p = p->_outer;
+	return p->_acs;
+}
 
-///
+/**
+ * Mark the runs of the multi-ACS. As the outer runs are shared, the walk
+ * stops at the first run already marked (its outer runs are then marked
+ * too): each run is visited once per collection.
+ * @param gc	Current garbage collector.
+ */
 void MultiACS::mark(AbstractGC& gc) {
-	gc.mark(this, sizeof(MultiACS));
-	for(auto p: as)
-		if(p != nullptr)
-			gc.mark(p, sizeof(ACS));
+	for(auto p = this; p != nullptr; p = p->_outer) {
+		if(!gc.mark(p, sizeof(MultiACS)))
+			break;
+		p->_acs->mark(gc);
+	}
 }
 
 
@@ -101,12 +115,107 @@ MultiPERS::MultiPERS(const SetCollection& coll, int set, int assoc, ListGC& gc_)
 	Domain(set),
 	pers(coll, set, assoc, gc_),
 	gc(gc_),
-	BOT(make(1, acs(pers.bot()))),
-	TOP(make(1, acs(pers.top()))),
+	BOT(make(acs(pers.bot()), 1, nullptr)),
+	TOP(make(acs(pers.top()), 1, nullptr)),
 	os(BOT)
 {
 }
 
+/**
+ * Add levels on top of a multi-ACS.
+ * @param s		Multi-ACS to extend (may be null).
+ * @param a		ACS of the new levels.
+ * @param n		Number of added levels.
+ * @return		Extended multi-ACS.
+ */
+MultiACS *MultiPERS::push(MultiACS *s, ACS *a, int n) {
+	if(s != nullptr && s->inner() == a)
+		return make(a, s->count() + n, s->outer());
+	else
+		return make(a, n, s);
+}
+
+/**
+ * Remove the innermost levels of a multi-ACS.
+ * @param s		Multi-ACS to shorten.
+ * @param n		Number of removed levels (less than s depth).
+ * @return		Shortened multi-ACS.
+ */
+MultiACS *MultiPERS::drop(MultiACS *s, int n) {
+	while(n > 0 && n >= s->count()) {
+		n -= s->count();
+		s = s->outer();
+		ASSERT(s != nullptr);
+	}
+	if(n == 0)
+		return s;
+	else
+		return make(s->inner(), s->count() - n, s->outer());
+}
+
+/**
+ * Change the depth of a multi-ACS. The multi-ACS is truncated or the new
+ * levels are initialized with a.
+ * @param s		Multi-ACS to resize.
+ * @param D		New depth.
+ * @param a		ACS for the new levels.
+ * @return		Resized multi-ACS.
+ */
+MultiACS *MultiPERS::resize(MultiACS *s, int D, ACS *a) {
+	if(D < s->depth())
+		return drop(s, s->depth() - D);
+	else if(D > s->depth())
+		return push(s, a, D - s->depth());
+	else
+		return s;
+}
+
+/**
+ * Get the ACS of each level of a multi-ACS, from the outermost to the
+ * innermost.
+ * @param s		Multi-ACS to expand.
+ * @param ls	Vector to store the levels in.
+ */
+void MultiPERS::expand(MultiACS *s, Vector<ACS *>& ls) {
+	ls.setLength(s->depth());
+	for(auto p = s; p != nullptr; p = p->outer())
+		for(int i = p->depth() - p->count(); i < p->depth(); i++)
+			ls[i] = p->inner();
+}
+
+/**
+ * Build the multi-ACS corresponding to the levels in levs sharing the
+ * outermost runs of s that are not changed.
+ * @param s		Original multi-ACS (may be null).
+ * @param old	Levels of s.
+ * @return		Multi-ACS with levels of levs.
+ */
+MultiACS *MultiPERS::rebuild(MultiACS *s, const Vector<ACS *>& old) {
+
+	// look for the unchanged levels
+	int k = 0;
+	while(k < levs.length() && k < old.length() && levs[k] == old[k])
+		k++;
+	if(k == levs.length() && k == old.length()) {
+		levs.clear();
+		return s;
+	}
+
+	// build the changed levels (os keeps them alive)
+	os = s;
+	while(os != nullptr && os->depth() > k)
+		os = os->outer();
+	for(int i = os == nullptr ? 0 : os->depth(); i < levs.length();) {
+		int j = i + 1;
+		while(j < levs.length() && levs[j] == levs[i])
+			j++;
+		os = push(os, levs[i], j - i);
+		i = j;
+	}
+	levs.clear();
+	return os;
+}
+
 ///
 ai::State *MultiPERS::bot() {
 	return BOT;
@@ -127,10 +236,14 @@ static inline MultiACS *multi(ai::State *s) { return static_cast<MultiACS *>(s);
 ///
 bool MultiPERS::equals(ai::State *s1_, ai::State *s2_) {
 	auto s1 = multi(s1_), s2 = multi(s2_);
-	if(s1->as.count() != s2->as.count())
-			return false;
-	for(int i = 0; i < s1->as.count(); i++)
-		if(!pers.equals(s1->as[i], s2->as[i]))
+	if(s1 == s2)
+		return true;
+	if(s1->depth() != s2->depth())
+		return false;
+	expand(s1, in1);
+	expand(s2, in2);
+	for(int i = 0; i < in1.length(); i++)
+		if(in1[i] != in2[i] && !pers.equals(in1[i], in2[i]))
 			return false;
 	return true;
 }
@@ -142,13 +255,22 @@ ai::State *MultiPERS::join(ai::State *s1_, ai::State *s2_) {
 		return s2;
 	else if(s2 == BOT)
 		return s1;
+	else if(s1 == s2)
+		return s1;
 	else {
-		if(s1->as.count() < s2->as.count())
+		if(s1->depth() < s2->depth())
 			swap(s1, s2);
-		os = copy(s1);
-		for(int i = 0; i < s2->as.count(); i++)
-			os->as[i] = acs(pers.join(s1->as[i], s2->as[i]));
-		return os;
+		expand(s1, in1);
+		expand(s2, in2);
+		levs.setLength(in1.length());
+		for(int i = 0; i < in1.length(); i++)
+			levs[i] = in1[i];
+		for(int i = 0; i < in2.length(); i++)
+			if(i > 0 && in1[i] == in1[i - 1] && in2[i] == in2[i - 1])
+				levs[i] = levs[i - 1];
+			else
+				levs[i] = acs(pers.join(in1[i], in2[i]));
+		return rebuild(s1, in1);
 	}
 }
 
@@ -157,19 +279,17 @@ ai::State *MultiPERS::join(ai::State *s1_, ai::State *s2_) {
 ai::State *MultiPERS::update(Edge *e, ai::State *s_) {
 	auto s = multi(s_);
 	if(LOOP_EXIT(e))
-		os = copy(s, s->as.count() + Loop::of(e->sink())->depth() - Loop::of(e->source())->depth(), acs(pers.entry()));
+		os = resize(s, s->depth() + Loop::of(e->sink())->depth() - Loop::of(e->source())->depth(), acs(pers.entry()));
 	else if(LOOP_ENTRY(e))
-		os = copy(s, s->as.count() + 1, acs(pers.entry()));	
+		os = push(s, acs(pers.entry()), 1);
 	else if(!e->source()->isSynth())
 		os = s;
 	else {
 		int d = ds.get(e->source(), -1);
 		if(d == -1)
 			return BOT;
-		else if(d == s->as.count())
-			os = copy(s);
 		else
-			os = copy(s, d, acs(pers.entry()));		
+			os = resize(s, d, acs(pers.entry()));
 	}
 	return os;
 }
@@ -185,14 +305,25 @@ ai::State *MultiPERS::update(Block *v, ai::State *s_) {
 	
 	// function call case
 	if(v->isSynth())
-		ds.put(v, s->as.count());
-
-	// update the state
-	for(const auto& a: *ACCESSES(v))
-		if(a.access(S))
-			for(int i = 0; i < os->as.count(); i++)
-				os->as[i] = acs(pers.update(a, os->as[i]));
-	return os;
+		ds.put(v, s->depth());
+
+	// transparent block
+	auto as = SetAccesses::of(v, S);
+	if(as.count() == 0)
+		return s;
+
+	// update the levels (levels equal to their outer neighbour are updated once)
+	expand(s, in1);
+	levs.setLength(in1.length());
+	for(int i = 0; i < in1.length(); i++)
+		levs[i] = in1[i];
+	for(auto a: as)
+		for(int i = 0; i < levs.length(); i++)
+			if(i > 0 && in1[i] == in1[i - 1])
+				levs[i] = levs[i - 1];
+			else
+				levs[i] = acs(pers.update(*a, levs[i]));
+	return rebuild(s, in1);
 }
 
 ///
@@ -204,11 +335,11 @@ bool MultiPERS::implementsPrinting() {
 void MultiPERS::print(ai::State *s_, io::Output& out) {
 	auto s = multi(s_);
 	out << "{ ";
-	for(int i = 0; i < s->as.count(); i++) {
+	for(int i = 0; i < s->depth(); i++) {
 		if(i != 0)
 			out << ", ";
 		out << "L" << i << ": ";
-		pers.print(s->as[i], out);
+		pers.print(s->level(i), out);
 	}
 	out << " }";
 }
@@ -221,11 +352,12 @@ bool MultiPERS::implementsIO() {
 ///
 void MultiPERS::save(ai::State *s_, io::OutStream *out) {
 	auto s = multi(s_);
-	t::int32 c = s->as.count();
-	if(out->write(reinterpret_cast<char *>(c), sizeof(c)) != sizeof(c))
+	t::int32 c = s->depth();
+	if(out->write(reinterpret_cast<const char *>(&c), sizeof(c)) != sizeof(c))
 		throw io::IOException(out->lastErrorMessage());
+	expand(s, in1);
 	for(int i = 0; i < c; i++)
-		pers.save(s->as[i], out);
+		pers.save(in1[i], out);
 }
 
 ///
@@ -233,28 +365,41 @@ ai::State *MultiPERS::load(io::InStream *in) {
 	t::int32 c;
 	if(in->read(&c, sizeof(c)) != sizeof(c))
 		throw io::IOException(in->lastErrorMessage());
-	os = make(c, acs(pers.bot()));
+	levs.setLength(c);
 	for(int i = 0; i < c; i++)
-		os->as[i] = acs(pers.load(in));
-	return os;
+		levs[i] = nullptr;
+	for(int i = 0; i < c; i++)
+		levs[i] = acs(pers.load(in));
+	in1.clear();
+	return rebuild(nullptr, in1);
 }
 
 ///
 ai::State *MultiPERS::update(const Access& a, ai::State *s_) {
 	auto s = multi(s_);
-	if(s == BOT)
-		return BOT;
-	os = make(s->as.count(), acs(pers.bot()));
-	for(int i = 0; i < s->as.count(); i++)
-		os->as[i] = acs(pers.update(a, s->as[i]));
-	return os;
+	if(s == BOT || !a.access(S))
+		return s;
+	expand(s, in1);
+	levs.setLength(in1.length());
+	for(int i = 0; i < in1.length(); i++)
+		levs[i] = in1[i];
+	for(int i = 0; i < levs.length(); i++)
+		if(i > 0 && in1[i] == in1[i - 1])
+			levs[i] = levs[i - 1];
+		else
+			levs[i] = acs(pers.update(a, levs[i]));
+	return rebuild(s, in1);
 }
 
 ///
 void MultiPERS::collect(ai::state_collector_t f) {
 	f(BOT);
 	f(TOP);
-	f(os);
+	if(os != nullptr)
+		f(os);
+	for(auto a: levs)
+		if(a != nullptr)
+			f(a);
 	pers.collect(f);
 }
 
@@ -262,19 +407,11 @@ void MultiPERS::collect(ai::state_collector_t f) {
  * Default implementation of MultiPERSAnalsis.
  * @ingroup icat
  */
-class MultiPERSAnalysis: public Analysis, public MultiAgeInfo, public GCManager {
+class MultiPERSAnalysis: public Analysis, public MultiAgeInfo {
 public:
 
 	static p::declare reg;
-	MultiPERSAnalysis(): Analysis(reg), A(0), gc(*this) { }
-
-	void collect(AbstractGC& gc) override {
-		Analysis::collect([&](ai::State *s) { static_cast<GCState *>(s)->mark(gc); });
-	}
-
-	void clean(void *p) override {
-		reinterpret_cast<ACS *>(p)->~ACS();
-	}
+	MultiPERSAnalysis(): Analysis(reg), A(0) { }
 
 	void *interfaceFor(const AbstractFeature& f) override {
 		if(&f == &MULTI_PERS_FEATURE)
@@ -289,20 +426,24 @@ public:
 
 	int level(Block *b, const Access& a, const CacheBlock *cb) override {
 		auto s = multi(at(b, a, cb->set()));
-		int i = s->as.length() - 1;
-		while(i >= 0 && s->as[i]->age[cb->id()] < A)
-			i--;
+		auto r = level(s, cb);
 		Analysis::release(s);
-		return s->as.length() - 1 - i;
+		return r;
 	}
 
 	int level(Edge *e, const Access& a, const CacheBlock *cb) override {
 		auto s = multi(at(e, a, cb->set()));
-		int i = s->as.length() - 1;
-		while(i >= 0 && s->as[i]->age[cb->id()] < A)
-			i--;
+		auto r = level(s, cb);
 		Analysis::release(s);
-		return s->as.length() - 1 - i;
+		return r;
+	}
+
+	MultiAgeInfo::Cursor *cursor(otawa::Block *v) override {
+		return new Cursor(*this, v);
+	}
+
+	MultiAgeInfo::Cursor *cursor(Edge *e) override {
+		return new Cursor(*this, e);
 	}
 
 	MultiACS *acsAfter(Block *b,int s) override {
@@ -325,6 +466,10 @@ public:
 		Analysis::release(a);
 	}
 
+	void drop(int set) override {
+		Analysis::drop(set);
+	}
+
 protected:
 
 	void setup(WorkSpace *ws) override {
@@ -332,18 +477,32 @@ protected:
 		Analysis::setup(ws);
 	}
 
-	void cleanup(WorkSpace *ws) override {
-		gc.runGC();
-		Analysis::cleanup(ws);
-	}
-
 	Domain *domainFor(const SetCollection& coll, int set) override {
-		return new MultiPERS(coll, set, A, gc);
+		return new MultiPERS(coll, set, A, gcFor(set));
 	}
 
 private:
+
+	class Cursor: public MultiAgeInfo::Cursor {
+	public:
+		Cursor(MultiPERSAnalysis& analysis, otawa::Block *v): ana(analysis), c(analysis, v) { }
+		Cursor(MultiPERSAnalysis& analysis, Edge *e): ana(analysis), c(analysis, e) { }
+		int level(const CacheBlock *b) override
+			{ return ana.level(multi(c.state(b->set())), b); }
+		void next() override { c.next(); }
+	private:
+		MultiPERSAnalysis& ana;
+		Analysis::BlockCursor c;
+	};
+
+	int level(MultiACS *s, const CacheBlock *cb) {
+		int n = 0;
+		for(auto p = s; p != nullptr && p->inner()->age[cb->id()] < A; p = p->outer())
+			n += p->count();
+		return n;
+	}
+
 	int A;
-	ListGC gc;
 };
 
 
@@ -31,18 +31,10 @@ namespace otawa { namespace dcache {
  * Implements the PERS instruction cache analysis.
  * @ingroup dcache
  */
-class PERSAnalysis: public Analysis, public AgeInfo, public GCManager {
+class PERSAnalysis: public Analysis, public AgeInfo {
 public:
 	static p::declare reg;
-	PERSAnalysis(): Analysis(reg), A(0), gc(*this) { }
-
-	void collect(AbstractGC& gc) override {
-		Analysis::collect([&](ai::State *s) { gc.mark(s, sizeof(ACS)); });
-	}
-
-	void clean(void *p) override {
-		reinterpret_cast<ACS *>(p)->~ACS();
-	}
+	PERSAnalysis(): Analysis(reg), A(0) { }
 
 	void *interfaceFor(const AbstractFeature& f) override {
 		if(&f == &PERS_FEATURE)
@@ -85,6 +77,18 @@ public:
 		Analysis::release(a);
 	}
 
+	void drop(int set) override {
+		Analysis::drop(set);
+	}
+
+	AgeInfo::Cursor *cursor(otawa::Block *v) override {
+		return new ACSCursor(*this, v);
+	}
+
+	AgeInfo::Cursor *cursor(Edge *e) override {
+		return new ACSCursor(*this, e);
+	}
+
 protected:
 
 	void setup(WorkSpace *ws) override {
@@ -92,18 +96,12 @@ protected:
 		Analysis::setup(ws);
 	}
 
-	void cleanup(WorkSpace *ws) override {
-		gc.runGC();
-		Analysis::cleanup(ws);
-	}
-
 	Domain *domainFor(const SetCollection& coll, int set) override {
-		return new PERS(coll, set, A, gc);
+		return new PERS(coll, set, A, gcFor(set), hashConsing());
 	}
 
 	int A;
 	ListMap<ACS *, int> kept;
-	ListGC gc;
 };
 
 ///
@@ -125,9 +123,9 @@ p::interfaced_feature<AgeInfo> PERS_FEATURE("otawa::dcache::PERS_FEATURE", p::ma
  */
 
 ///
-PERS::PERS(const SetCollection& collection, int set, int assoc, ListGC& gc):
-	ACSDomain(collection, set, assoc, assoc, gc),
-	EMPTY(make(ACS::BOT))
+PERS::PERS(const SetCollection& collection, int set, int assoc, ListGC& gc, bool sharing):
+	ACSDomain(collection, set, assoc, assoc, gc, sharing),
+	EMPTY(share(make(ACS::BOT)))
 	{ }
 
 ///
@@ -149,21 +147,10 @@ ai::State *PERS::join(ai::State *_1, ai::State *_2) {
 	else if(s2 == BOT)
 		return s1;
 	else {
-		auto s = make(N);
-		int cnt = 0, sum = 0;
-		for(int i = 0; i < N; i++) {
-			if(s1->age[i] == ACS::BOT)
-				s->age[i] = s2->age[i];
-			else if(s2->age[i] == ACS::BOT)
-				s->age[i] = s1->age[i];
-			else
-				s->age[i] = max(s1->age[i], s2->age[i]);
-			sum += s->age[i];
-			if(s->age[i] < A && s->age[i] != ACS::BOT)
-				cnt++;
-		}
-		if(cnt <= A && sum != sumA)
-			return s;
+		auto s = alloc();
+		kernel::maxBot(s->age, s1->age, s2->age, N);
+		if(kernel::countBelow(s->age, N, A) <= A && sum(s) != sumA)
+			return share(s);
 		else
 			return TOP;
 	}
@@ -173,9 +160,25 @@ ai::State *PERS::join(ai::State *_1, ai::State *_2) {
 ai::State *PERS::update(Block *v, ai::State *s) {
 	auto os = acs(s);
 	if(os != BOT) {
-		for(const auto& a: *ACCESSES(v))
-			if(a.access(S))
-				os = acs(update(a, os));
+
+		// the sequences of accesses to unknown blocks are applied at once
+		int k = 0;
+		const Access *f = nullptr;
+		for(auto a: SetAccesses::of(v, S))
+			if(agesAll(*a)) {
+				if(k == 0)
+					f = a;
+				k++;
+			}
+			else {
+				if(k != 0) {
+					os = accessAny(*f, os, k);
+					k = 0;
+				}
+				os = acs(update(*a, os));
+			}
+		if(k != 0)
+			os = accessAny(*f, os, k);
 	}
 	return os;
 }
@@ -183,7 +186,22 @@ ai::State *PERS::update(Block *v, ai::State *s) {
 ///
 ai::State *PERS::update(const Access& a, ai::State *s_) {
 	auto s = acs(s_);
+	auto r = memo(a, s);
+	if(r == nullptr) {
+		in = s;
+		r = memo(a, s, transfer(a, s));
+		in = nullptr;
+	}
+	return r;
+}
 
+/**
+ * Compute the effect of the given access on the given ACS.
+ * @param a		Performed access.
+ * @param s		Input ACS.
+ * @return		Output ACS.
+ */
+ACS *PERS::transfer(const Access& a, ACS *s) {
 	switch(a.action()) {
 
 	case NO_ACCESS:
@@ -204,7 +222,7 @@ ai::State *PERS::update(const Access& a, ai::State *s_) {
 		switch(a.kind()) {
 		case ANY:	return TOP;
 		case BLOCK:	return purge(s, a.block()->id());
-		case ENUM:	return purge(s, a.block()->id());
+		case ENUM:	return purge(s, a.blockIn(S)->id());
 		case RANGE:	return TOP;
 		}
 		break;
@@ -218,17 +236,14 @@ ai::State *PERS::update(const Access& a, ai::State *s_) {
 
 ///
 ACS *PERS::access(ACS *is, int b) const {
-	auto os = make(N);
+	auto os = alloc();
 	auto ba = is->age[b];
 	if(ba == ACS::BOT)
 		ba = A;
-	for(int i = 0; i < N; i++)
-		if(is->age[i] <= ba && is->age[i] != A && is->age[i] != ACS::BOT)
-			os->age[i] = is->age[i] + 1;
-		else
-			os->age[i] = is->age[i];
+	// age <= ba && age != A && age != BOT  <=>  age <= min(ba, A - 1)
+	kernel::age(os->age, is->age, N, min(int(ba), A - 1));
 	os->age[b] = 0;
-	return os;
+	return share(os);
 }
 
 
@@ -236,18 +251,43 @@ ACS *PERS::access(ACS *is, int b) const {
 ACS *PERS::purge(ACS *is, int b) const {
 	auto os = copy(is);
 	os->age[b] = A;
-	return os;
+	return share(os);
 }
 
-///
-ACS *PERS::accessAny(ACS *is) const {
-	auto os = make(N);
-	for(int i = 0; i < N; i++)
-		if(is->age[i] != ACS::BOT)
-			os->age[i] = min(int(A), is->age[i] + 1);
-		else
-			os->age[i] = is->age[i];
-	return os;
+/**
+ * Compute the effect of k accesses to unknown blocks: all blocks get older
+ * by k, an aging by more than the associativity being the same as an aging
+ * by the associativity. The TOP state is returned as is. Else, it costs one
+ * pass over the ages whatever k: update(Block) batches the runs of such
+ * accesses but an isolated access is not cheaper than with k = 1.
+ * @param is	Input ACS.
+ * @param k		Number of accesses.
+ * @return		Output ACS.
+ */
+ACS *PERS::accessAny(ACS *is, int k) const {
+	if(is == TOP)
+		return TOP;
+	auto os = alloc();
+	kernel::ageAll(os->age, is->age, N, A, min(k, int(A)));
+	return share(os);
+}
+
+/**
+ * Compute, through the memo, the effect of a run of k accesses to unknown
+ * blocks starting with access a.
+ * @param a		First access of the run.
+ * @param s		Input ACS.
+ * @param k		Number of accesses of the run.
+ * @return		Output ACS.
+ */
+ACS *PERS::accessAny(const Access& a, ACS *s, int k) {
+	auto r = memo(a, s, k);
+	if(r == nullptr) {
+		in = s;
+		r = memo(a, s, accessAny(s, k), k);
+		in = nullptr;
+	}
+	return r;
 }
 
 } };	// otawa::dcache
@@ -0,0 +1,422 @@
+/*
+ *	Product Domain implementation
+ *
+ *	This file is part of OTAWA
+ *	Copyright (c) 2020, IRIT UPS.
+ *
+ *	OTAWA is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	OTAWA is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with OTAWA; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <elm/array.h>
+#include "otawa/dcache/Analysis.h"
+#include "otawa/dcache/Product.h"
+
+namespace otawa { namespace dcache {
+
+/**
+ * @class ProductACS
+ * State of the Product domain: the MUST, MAY and PERS ACS of a set side
+ * by side.
+ * @ingroup dcache
+ */
+
+///
+void ProductACS::mark(AbstractGC& gc) {
+	gc.mark(this, sizeof(ProductACS));
+	for(auto a: comp)
+		a->mark(gc);
+}
+
+
+/**
+ * @class Product
+ * Product of the MUST, MAY and PERS domains. The three ACS are updated
+ * together, the accesses of a block being decoded only once, and a single
+ * fixpoint computation provides the three analyses.
+ * @ingroup dcache
+ */
+
+///
+Product::Product(const SetCollection& coll, int set, int assoc, ListGC& gc_, bool sharing):
+	Domain(set),
+	must(coll, set, assoc, gc_, sharing),
+	may(coll, set, assoc, gc_, sharing),
+	pers(coll, set, assoc, gc_, sharing),
+	gc(gc_),
+	BOT(nullptr),
+	TOP(nullptr),
+	ENTRY(nullptr)
+{
+	array::set(cur, ProductInfo::COMP_CNT, static_cast<ACS *>(nullptr));
+	BOT = new(gc.alloc<ProductACS>()) ProductACS(S, acs(must.bot()), acs(may.bot()), acs(pers.bot()));
+	TOP = new(gc.alloc<ProductACS>()) ProductACS(S, acs(must.top()), acs(may.top()), acs(pers.top()));
+	ENTRY = new(gc.alloc<ProductACS>()) ProductACS(S, acs(must.entry()), acs(may.entry()), acs(pers.entry()));
+}
+
+/**
+ * Build the product state from the current components. If they are the same
+ * as the components of s, s is returned.
+ * @param s		Original state (may be null).
+ * @return		Product of the current components.
+ */
+ProductACS *Product::make(ProductACS *s) {
+	if(s == nullptr
+	|| cur[ProductInfo::MUST_AGE] != s->comp[ProductInfo::MUST_AGE]
+	|| cur[ProductInfo::MAY_AGE] != s->comp[ProductInfo::MAY_AGE]
+	|| cur[ProductInfo::PERS_AGE] != s->comp[ProductInfo::PERS_AGE])
+		s = new(gc.alloc<ProductACS>()) ProductACS(S,
+			cur[ProductInfo::MUST_AGE], cur[ProductInfo::MAY_AGE], cur[ProductInfo::PERS_AGE]);
+	array::set(cur, ProductInfo::COMP_CNT, static_cast<ACS *>(nullptr));
+	return s;
+}
+
+///
+ai::State *Product::bot() {
+	return BOT;
+}
+
+///
+ai::State *Product::top() {
+	return TOP;
+}
+
+///
+ai::State *Product::entry() {
+	return ENTRY;
+}
+
+///
+bool Product::equals(ai::State *_1, ai::State *_2) {
+	auto s1 = product(_1), s2 = product(_2);
+	if(s1 == s2)
+		return true;
+	else if(s1 == BOT || s2 == BOT)
+		return false;
+	else
+		return must.equals(s1->comp[ProductInfo::MUST_AGE], s2->comp[ProductInfo::MUST_AGE])
+			&& may.equals(s1->comp[ProductInfo::MAY_AGE], s2->comp[ProductInfo::MAY_AGE])
+			&& pers.equals(s1->comp[ProductInfo::PERS_AGE], s2->comp[ProductInfo::PERS_AGE]);
+}
+
+///
+ai::State *Product::join(ai::State *_1, ai::State *_2) {
+	auto s1 = product(_1), s2 = product(_2);
+	if(s1 == BOT)
+		return s2;
+	else if(s2 == BOT)
+		return s1;
+	cur[ProductInfo::MUST_AGE] = acs(must.join(s1->comp[ProductInfo::MUST_AGE], s2->comp[ProductInfo::MUST_AGE]));
+	cur[ProductInfo::MAY_AGE] = acs(may.join(s1->comp[ProductInfo::MAY_AGE], s2->comp[ProductInfo::MAY_AGE]));
+	cur[ProductInfo::PERS_AGE] = acs(pers.join(s1->comp[ProductInfo::PERS_AGE], s2->comp[ProductInfo::PERS_AGE]));
+	return make(s1);
+}
+
+///
+ai::State *Product::update(Block *v, ai::State *s_) {
+	auto s = product(s_);
+	if(s == BOT)
+		return s;
+
+	// transparent block
+	auto as = SetAccesses::of(v, S);
+	if(as.count() == 0)
+		return s;
+
+	// update the three ACS at once
+	array::copy(cur, s->comp, ProductInfo::COMP_CNT);
+	for(auto a: as) {
+		cur[ProductInfo::MUST_AGE] = acs(must.update(*a, cur[ProductInfo::MUST_AGE]));
+		cur[ProductInfo::MAY_AGE] = acs(may.update(*a, cur[ProductInfo::MAY_AGE]));
+		cur[ProductInfo::PERS_AGE] = acs(pers.update(*a, cur[ProductInfo::PERS_AGE]));
+	}
+	return make(s);
+}
+
+///
+ai::State *Product::update(Edge *e, ai::State *s_) {
+	auto s = product(s_);
+	if(s == BOT)
+		return s;
+	cur[ProductInfo::MUST_AGE] = acs(must.update(e, s->comp[ProductInfo::MUST_AGE]));
+	cur[ProductInfo::MAY_AGE] = acs(may.update(e, s->comp[ProductInfo::MAY_AGE]));
+	cur[ProductInfo::PERS_AGE] = acs(pers.update(e, s->comp[ProductInfo::PERS_AGE]));
+	return make(s);
+}
+
+///
+ai::State *Product::update(const Access& a, ai::State *s_) {
+	auto s = product(s_);
+	if(s == BOT || !a.access(S))
+		return s;
+	cur[ProductInfo::MUST_AGE] = acs(must.update(a, s->comp[ProductInfo::MUST_AGE]));
+	cur[ProductInfo::MAY_AGE] = acs(may.update(a, s->comp[ProductInfo::MAY_AGE]));
+	cur[ProductInfo::PERS_AGE] = acs(pers.update(a, s->comp[ProductInfo::PERS_AGE]));
+	return make(s);
+}
+
+///
+bool Product::implementsPrinting() {
+	return true;
+}
+
+///
+void Product::print(ai::State *s_, io::Output& out) {
+	auto s = product(s_);
+	if(s == BOT) {
+		out << "_";
+		return;
+	}
+	out << "{ MUST: ";
+	must.print(s->comp[ProductInfo::MUST_AGE], out);
+	out << ", MAY: ";
+	may.print(s->comp[ProductInfo::MAY_AGE], out);
+	out << ", PERS: ";
+	pers.print(s->comp[ProductInfo::PERS_AGE], out);
+	out << " }";
+}
+
+///
+bool Product::implementsIO() {
+	return true;
+}
+
+///
+void Product::save(ai::State *s_, io::OutStream *out) {
+	auto s = product(s_);
+	t::uint8 tag = s == BOT ? 0 : 1;
+	if(out->write(reinterpret_cast<const char *>(&tag), sizeof(tag)) != sizeof(tag))
+		throw io::IOException(out->lastErrorMessage());
+	if(tag != 0) {
+		must.save(s->comp[ProductInfo::MUST_AGE], out);
+		may.save(s->comp[ProductInfo::MAY_AGE], out);
+		pers.save(s->comp[ProductInfo::PERS_AGE], out);
+	}
+}
+
+///
+ai::State *Product::load(io::InStream *in) {
+	t::uint8 tag;
+	if(in->read(&tag, sizeof(tag)) != sizeof(tag))
+		throw io::IOException(in->lastErrorMessage());
+	if(tag == 0)
+		return BOT;
+	cur[ProductInfo::MUST_AGE] = acs(must.load(in));
+	cur[ProductInfo::MAY_AGE] = acs(may.load(in));
+	cur[ProductInfo::PERS_AGE] = acs(pers.load(in));
+	return make(nullptr);
+}
+
+///
+void Product::collect(ai::state_collector_t f) {
+	f(BOT);
+	f(TOP);
+	f(ENTRY);
+	for(auto a: cur)
+		if(a != nullptr)
+			f(a);
+	must.collect(f);
+	may.collect(f);
+	pers.collect(f);
+}
+
+///
+void Product::clean(GCState *s) {
+	must.clean(s);
+	may.clean(s);
+	pers.clean(s);
+}
+
+
+/**
+ * Implements the product of MUST, MAY and PERS analyses. Besides
+ * the ProductInfo interface, it provides the interfaces of MUST, MAY
+ * and PERS features as views on the product.
+ * @ingroup dcache
+ */
+class ProductAnalysis: public Analysis, public ProductInfo {
+public:
+	static p::declare reg;
+	ProductAnalysis(): Analysis(reg), A(0),
+		must_view(*this, MUST_AGE), may_view(*this, MAY_AGE), pers_view(*this, PERS_AGE) { }
+
+	void *interfaceFor(const AbstractFeature& f) override {
+		if(&f == &PRODUCT_FEATURE)
+			return static_cast<ProductInfo *>(this);
+		else if(&f == &MUST_FEATURE)
+			return static_cast<AgeInfo *>(&must_view);
+		else if(&f == &MAY_FEATURE)
+			return static_cast<AgeInfo *>(&may_view);
+		else if(&f == &PERS_FEATURE)
+			return static_cast<AgeInfo *>(&pers_view);
+		else
+			return nullptr;
+	}
+
+	ProductInfo::Cursor *cursor(otawa::Block *v) override {
+		return new Cursor(*this, v);
+	}
+
+	ProductInfo::Cursor *cursor(Edge *e) override {
+		return new Cursor(*this, e);
+	}
+
+	void drop(int set) override {
+		Analysis::drop(set);
+	}
+
+protected:
+
+	void setup(WorkSpace *ws) override {
+		A = actualAssoc(ACCESS_FEATURE.get(ws)->cache());
+		Analysis::setup(ws);
+	}
+
+	Domain *domainFor(const SetCollection& coll, int set) override {
+		return new Product(coll, set, A, gcFor(set), hashConsing());
+	}
+
+private:
+
+	// cursor on one component, owning its block cursor
+	class ComponentCursor: public AgeInfo::Cursor {
+	public:
+		ComponentCursor(ProductAnalysis& analysis, otawa::Block *v, comp_t comp): c(analysis, v), k(comp) { }
+		ComponentCursor(ProductAnalysis& analysis, Edge *e, comp_t comp): c(analysis, e), k(comp) { }
+		int age(const CacheBlock *b) override
+			{ return product(c.state(b->set()))->get(k)->age[b->id()]; }
+		void next() override { c.next(); }
+	private:
+		Analysis::BlockCursor c;
+		comp_t k;
+	};
+
+	// view of a product cursor on one component
+	class View: public AgeInfo::Cursor {
+	public:
+		View(Analysis::BlockCursor& cursor, comp_t comp): c(cursor), k(comp) { }
+		int age(const CacheBlock *b) override
+			{ return product(c.state(b->set()))->get(k)->age[b->id()]; }
+		void next() override { }
+	private:
+		Analysis::BlockCursor& c;
+		comp_t k;
+	};
+
+	class Cursor: public ProductInfo::Cursor {
+	public:
+		Cursor(ProductAnalysis& analysis, otawa::Block *v): c(analysis, v),
+			views{View(c, MUST_AGE), View(c, MAY_AGE), View(c, PERS_AGE)} { }
+		Cursor(ProductAnalysis& analysis, Edge *e): c(analysis, e),
+			views{View(c, MUST_AGE), View(c, MAY_AGE), View(c, PERS_AGE)} { }
+		AgeInfo::Cursor *view(comp_t k) override { return &views[k]; }
+		void next() override { c.next(); }
+	private:
+		Analysis::BlockCursor c;
+		View views[COMP_CNT];
+	};
+
+	class Component: public AgeInfo {
+	public:
+		Component(ProductAnalysis& analysis, comp_t comp): ana(analysis), k(comp) { }
+
+		int wayCount() override {
+			return ana.A;
+		}
+
+		int age(otawa::Block *v, const Access& a, const CacheBlock *b) override {
+			auto s = product(ana.at(v, a, b->set()));
+			auto r = s->get(k)->age[b->id()];
+			ana.Analysis::release(s);
+			return r;
+		}
+
+		int age(Edge *e, const Access& a, const CacheBlock *b) override {
+			auto s = product(ana.at(e, a, b->set()));
+			auto r = s->get(k)->age[b->id()];
+			ana.Analysis::release(s);
+			return r;
+		}
+
+		ACS *acsBefore(Block *b, int s) override {
+			return project(ana.before(b, s));
+		}
+
+		ACS *acsAfter(Block *b, int s) override {
+			return project(ana.after(b, s));
+		}
+
+		ACS *acsAfter(Edge *e, int s) override {
+			return project(ana.after(e, s));
+		}
+
+		void release(ACS *a) override {
+			ana.Analysis::release(a);
+		}
+
+		void drop(int set) override {
+			ana.Analysis::drop(set);
+		}
+
+		AgeInfo::Cursor *cursor(otawa::Block *v) override {
+			return new ComponentCursor(ana, v, k);
+		}
+
+		AgeInfo::Cursor *cursor(Edge *e) override {
+			return new ComponentCursor(ana, e, k);
+		}
+
+	private:
+
+		// keep the component alive and release the product
+		ACS *project(ai::State *s) {
+			auto r = product(s)->get(k);
+			ana.use(r);
+			ana.Analysis::release(s);
+			return r;
+		}
+
+		ProductAnalysis& ana;
+		comp_t k;
+	};
+
+	int A;
+	Component must_view, may_view, pers_view;
+};
+
+///
+p::declare ProductAnalysis::reg = p::init("otawa::dcache::ProductAnalysis", Version(1, 0, 0))
+	.make<ProductAnalysis>()
+	.extend<Analysis>()
+	.provide(PRODUCT_FEATURE)
+	.provide(MUST_FEATURE)
+	.provide(MAY_FEATURE)
+	.provide(PERS_FEATURE);
+
+
+/**
+ * Provides the results of a single analysis computing together the MUST,
+ * MAY and PERS ACS. Once this feature is provided, @ref MUST_FEATURE,
+ * @ref MAY_FEATURE and @ref PERS_FEATURE are also provided, the CFG being
+ * traversed once instead of three times.
+ *
+ * **interface:** ProductInfo
+ *
+ * **default implementation:** ProductAnalysis
+ *
+ * @ingroup dcache
+ */
+p::interfaced_feature<ProductInfo> PRODUCT_FEATURE("otawa::dcache::PRODUCT_FEATURE", p::make<ProductAnalysis>());
+
+} }		// otawa::dcache
@@ -0,0 +1,743 @@
+/*
+ *	Solver classes implementation
+ *
+ *	This file is part of OTAWA
+ *	Copyright (c) 2020, IRIT UPS.
+ *
+ *	OTAWA is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	OTAWA is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with OTAWA; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <climits>
+#include "otawa/dcache/Analysis.h"
+#include "otawa/dcache/features.h"
+#include "otawa/dcache/Solver.h"
+
+namespace otawa { namespace dcache {
+
+/**
+ * @class Solver
+ * A solver computes the fixpoint of a set for Analysis and give access
+ * to the resulting states. The states returned by the before() and after()
+ * functions are used and must be released with release().
+ * @ingroup dcache
+ */
+
+///
+Solver::~Solver() {
+}
+
+/**
+ * @fn void Solver::process();
+ * Compute the fixpoint.
+ */
+
+/**
+ * @fn ai::State *Solver::before(Edge *e);
+ * Get the state before an edge.
+ * @param e		Looked edge.
+ * @return		State before e (used).
+ */
+
+/**
+ * @fn ai::State *Solver::after(Edge *e);
+ * Get the state after an edge.
+ * @param e		Looked edge.
+ * @return		State after e (used).
+ */
+
+/**
+ * @fn ai::State *Solver::before(otawa::Block *v);
+ * Get the state before a block.
+ * @param v		Looked block.
+ * @return		State before v (used).
+ */
+
+/**
+ * @fn ai::State *Solver::after(otawa::Block *v);
+ * Get the state after a block.
+ * @param v		Looked block.
+ * @return		State after v (used).
+ */
+
+/**
+ * @fn void Solver::use(ai::State *s);
+ * Mark a state as used: it is kept alive until it is released.
+ * @param s		Used state.
+ */
+
+/**
+ * @fn void Solver::release(ai::State *s);
+ * Release a state previously used.
+ * @param s		Released state.
+ */
+
+/**
+ * @fn void Solver::collect(ai::state_collector_t f);
+ * Call f on each state kept alive by the solver (for garbage collection).
+ * @param f		Function to call on each state.
+ */
+
+
+/**
+ * @class CFGSolver
+ * Solver using the generic worklist of ai::CFGAnalyzer.
+ * @ingroup dcache
+ */
+
+/**
+ * Build the solver.
+ * @param mon	Monitor providing the CFGs.
+ * @param dom	Domain of the analysis.
+ */
+CFGSolver::CFGSolver(Monitor& mon, ai::Domain& dom): ana(mon, dom) {
+}
+
+///
+void CFGSolver::process() {
+	ana.process();
+}
+
+///
+ai::State *CFGSolver::before(Edge *e) {
+	return ana.before(e);
+}
+
+///
+ai::State *CFGSolver::after(Edge *e) {
+	return ana.after(e);
+}
+
+///
+ai::State *CFGSolver::before(otawa::Block *v) {
+	return ana.before(v);
+}
+
+///
+ai::State *CFGSolver::after(otawa::Block *v) {
+	return ana.after(v);
+}
+
+///
+void CFGSolver::use(ai::State *s) {
+	ana.use(s);
+}
+
+///
+void CFGSolver::release(ai::State *s) {
+	ana.release(s);
+}
+
+///
+void CFGSolver::collect(ai::state_collector_t f) {
+	ana.collect(f);
+}
+
+
+/**
+ * @class WTO
+ * Weak topological ordering (WTO) of the blocks of a CFG collection as
+ * defined by F. Bourdoncle ("Efficient chaotic iteration strategies with
+ * widenings", 1993). The WTO is computed on the graph of the dependencies
+ * between blocks: the CFG edges, the edges from a call block to the entry of
+ * the callee and from the exit of the callee to the call block. Each
+ * strongly connected component (typically a loop) is a sub-sequence, starting
+ * by its head, and containing the nested components.
+ *
+ * The WTO only depends on the CFGs: it is computed once and shared by all
+ * sets of an analysis.
+ * @ingroup dcache
+ */
+
+// Bourdoncle's algorithm
+class WTO::Builder {
+public:
+	Builder(WTO& wto, const AllocArray<int>& first, const Vector<int>& succs):
+		w(wto), sfirst(first), succs(succs), dfn(wto.count(), 0), num(0) { }
+
+	~Builder() {
+		for(auto c: comps)
+			delete c;
+	}
+
+	void make(int entry) {
+		Vector<int> part;
+		visit(entry, part);
+		flatten(part);
+	}
+
+private:
+
+	// the recursions of the algorithm are unrolled on an explicit stack
+	// of frames so that big CFG collections do not overflow the C++ stack
+	typedef enum {
+		VISIT,		// visiting the successors of v
+		WAIT,		// waiting for the component of v
+		COMPONENT	// building the component of v
+	} kind_t;
+	typedef struct frame_t {
+		kind_t kind;
+		int v, i, head;
+		bool loop;
+		Vector<int> *part;
+	} frame_t;
+	typedef struct fframe_t {
+		const Vector<int> *part;
+		int i, p;
+	} fframe_t;
+
+	void push(int v, Vector<int> *part) {
+		stack.push(v);
+		dfn[v] = ++num;
+		frames.push({ VISIT, v, sfirst[v], dfn[v], false, part });
+	}
+
+	// pop the top frame returning head to the calling frame
+	void ret(int head) {
+		frames.pop();
+		if(!frames.isEmpty()) {
+			auto& f = frames.last();
+			if(f.kind == VISIT && head <= f.head) {
+				f.head = head;
+				f.loop = true;
+			}
+		}
+	}
+
+	// partitions are built in reverse order,
+	// components are encoded as negative numbers in the partitions
+	void visit(int v, Vector<int>& part) {
+		push(v, &part);
+		while(!frames.isEmpty()) {
+			auto& f = frames.last();
+			switch(f.kind) {
+
+			case VISIT:
+				if(f.i < sfirst[f.v + 1]) {
+					int s = succs[f.i++];
+					if(dfn[s] == 0)
+						push(s, f.part);
+					else if(dfn[s] <= f.head) {
+						f.head = dfn[s];
+						f.loop = true;
+					}
+				}
+				else if(f.head != dfn[f.v])
+					ret(f.head);
+				else {
+					dfn[f.v] = INT_MAX;
+					int e = stack.pop();
+					if(!f.loop) {
+						f.part->add(f.v);
+						ret(f.head);
+					}
+					else {
+						while(e != f.v) {
+							dfn[e] = 0;
+							e = stack.pop();
+						}
+						f.kind = WAIT;
+						frames.push({ COMPONENT, f.v, sfirst[f.v], 0, false, new Vector<int>() });
+					}
+				}
+				break;
+
+			case COMPONENT:
+				if(f.i < sfirst[f.v + 1]) {
+					int s = succs[f.i++];
+					if(dfn[s] == 0)
+						push(s, f.part);
+				}
+				else {
+					comps.add(f.part);
+					heads.add(f.v);
+					frames.pop();
+					auto& wf = frames.last();
+					wf.part->add(-comps.length());
+					ret(wf.head);
+				}
+				break;
+
+			case WAIT:
+				ASSERT(false);
+				break;
+			}
+		}
+	}
+
+	void flatten(const Vector<int>& part) {
+		Vector<fframe_t> fs;
+		fs.push({ &part, part.length() - 1, -1 });
+		while(!fs.isEmpty()) {
+			auto& f = fs.last();
+			if(f.i < 0) {
+				if(f.p >= 0) {
+					w.ends[f.p] = w.seq.length();
+					w.comp_cnt++;
+				}
+				fs.pop();
+			}
+			else {
+				int x = (*f.part)[f.i--];
+				if(x >= 0) {
+					w.seq.add(x);
+					w.ends.add(-1);
+				}
+				else {
+					int c = -x - 1;
+					int p = w.seq.length();
+					w.seq.add(heads[c]);
+					w.ends.add(0);
+					fs.push({ comps[c], comps[c]->length() - 1, p });
+				}
+			}
+		}
+	}
+
+	WTO& w;
+	const AllocArray<int>& sfirst;
+	const Vector<int>& succs;
+	AllocArray<int> dfn;
+	Vector<int> stack;
+	Vector<frame_t> frames;
+	int num;
+	Vector<Vector<int> *> comps;
+	Vector<int> heads;
+};
+
+/**
+ * Build the WTO of the given CFGs.
+ * @param cfgs	CFG collection.
+ */
+WTO::WTO(const CFGCollection& cfgs):
+	_cfgs(cfgs),
+	base(cfgs.count()),
+	blocks(cfgs.countBlocks()),
+	pfirst(cfgs.countBlocks() + 1),
+	efirst(cfgs.countBlocks() + 1),
+	comp_cnt(0)
+{
+	// number the blocks and the edges
+	int b = 0, e = 0;
+	for(auto g: cfgs) {
+		base[g->index()] = b;
+		for(auto v: *g) {
+			blocks[b + v->index()] = v;
+			efirst[b + v->index()] = e;
+			e += v->countIns();
+		}
+		b += g->count();
+	}
+	efirst[b] = e;
+
+	// build the dependencies
+	int n = count();
+	for(int i = 0; i < n; i++) {
+		auto v = blocks[i];
+		pfirst[i] = preds.length();
+		if(v->isEntry())
+			for(auto c: v->cfg()->callers())
+				preds.add(index(c));
+		else
+			for(auto e: v->inEdges())
+				preds.add(index(e->source()));
+		if(v->isSynth() && v->toSynth()->callee() != nullptr
+		&& v->toSynth()->callee()->exit() != nullptr)
+			preds.add(index(v->toSynth()->callee()->exit()));
+	}
+	pfirst[n] = preds.length();
+
+	// build the successors (reverse of the dependencies)
+	AllocArray<int> sfirst(n + 1, 0), fill(n, 0);
+	for(auto p: preds)
+		sfirst[p + 1]++;
+	for(int i = 0; i < n; i++)
+		sfirst[i + 1] += sfirst[i];
+	Vector<int> succs;
+	succs.setLength(preds.length());
+	for(int i = 0; i < n; i++)
+		for(int j = pfirst[i]; j < pfirst[i + 1]; j++) {
+			int p = preds[j];
+			succs[sfirst[p] + fill[p]++] = i;
+		}
+
+	// compute the WTO
+	Builder builder(*this, sfirst, succs);
+	builder.make(index(cfgs.entry()->entry()));
+}
+
+/**
+ * Get the index of an edge, in [0, edgeCount()[.
+ * @param e		Looked edge.
+ * @return		Edge index.
+ */
+int WTO::edgeIndex(Edge *e) const {
+	int i = efirst[index(e->sink())];
+	for(auto ee: e->sink()->inEdges()) {
+		if(ee == e)
+			return i;
+		i++;
+	}
+	ASSERTP(false, "edge not found: " << e);
+	return -1;
+}
+
+/**
+ * @fn const CFGCollection& WTO::cfgs() const;
+ * Get the ordered CFGs.
+ * @return	CFG collection.
+ */
+
+/**
+ * @fn int WTO::count() const;
+ * Get the number of blocks.
+ * @return	Number of blocks.
+ */
+
+/**
+ * @fn int WTO::index(otawa::Block *v) const;
+ * Get the index of a block, in [0, count()[.
+ * @param v		Looked block.
+ * @return		Block index.
+ */
+
+/**
+ * @fn otawa::Block *WTO::block(int i) const;
+ * Get a block by its index.
+ * @param i		Block index.
+ * @return		Matching block.
+ */
+
+/**
+ * @fn int WTO::length() const;
+ * Get the number of positions of the WTO (the blocks not reachable from
+ * the entry of the task are not in the WTO).
+ * @return	WTO length.
+ */
+
+/**
+ * @fn int WTO::at(int p) const;
+ * Get the index of the block at the given position in the WTO.
+ * @param p		Position.
+ * @return		Block index.
+ */
+
+/**
+ * @fn bool WTO::isHead(int p) const;
+ * Test if the block at the given position heads a component.
+ * @param p		Position.
+ * @return		True if it is a component head, false else.
+ */
+
+/**
+ * @fn int WTO::endOf(int p) const;
+ * For a component head, get the position after the end of the component.
+ * @param p		Position of the head.
+ * @return		Position after the end of the component.
+ */
+
+/**
+ * @fn int WTO::predCount(int i) const;
+ * Get the number of blocks the given block depends on.
+ * @param i		Block index.
+ * @return		Number of dependencies.
+ */
+
+/**
+ * @fn int WTO::pred(int i, int j) const;
+ * Get a block the given block depends on.
+ * @param i		Block index.
+ * @param j		Dependency index in [0, predCount(i)[.
+ * @return		Index of the depended block.
+ */
+
+/**
+ * @fn int WTO::firstEdge(int i) const;
+ * Get the index of the first in-edge of a block: the in-edges of a block
+ * are numbered consecutively.
+ * @param i		Block index.
+ * @return		Index of the first in-edge.
+ */
+
+/**
+ * @fn int WTO::edgeCount() const;
+ * Get the number of edges.
+ * @return	Number of edges.
+ */
+
+/**
+ * @fn int WTO::componentCount() const;
+ * Get the number of components of the WTO.
+ * @return	Number of components.
+ */
+
+
+/**
+ * @class WTOSolver
+ * Solver iterating along a WTO (see @ref WTO) with the recursive strategy
+ * of Bourdoncle: the components are stabilized from the innermost one to
+ * the outermost one and the blocks outside of the components are evaluated
+ * only once. In addition, a block is not evaluated again if none of the
+ * blocks it depends on changed since its last evaluation; the number of these
+ * saved evaluations is recorded in the @ref SetStats::saved statistics.
+ *
+ * The computation is the usual one: the state before a block is the join of
+ * the states after its in-edges, the state before a function entry is the
+ * join of the states produced by the calls, and the state after a call is
+ * the state after the exit of the callee.
+ *
+ * If a set to skip calls for is given, the calls to functions whose
+ * @ref Footprint does not touch this set are passed through: the state after
+ * the call is the state before the call (updated by the call block) and the
+ * callee does not receive this state. As the callee does not change the set,
+ * the result is the same as analyzing the callee in the single context of
+ * this call, that is, at least as precise as the join of all calling contexts.
+ * @ingroup dcache
+ */
+
+/**
+ * Build the solver.
+ * @param wto		WTO of the CFGs.
+ * @param dom		Domain of the analysis.
+ * @param stats		Statistics to fill (optional).
+ * @param skip_set	Set to pass through the calls not touching it for
+ * 					(-1 for none, requires @ref FOOTPRINT_FEATURE).
+ */
+WTOSolver::WTOSolver(const WTO& wto, ai::Domain& dom, SetStats *stats, int skip_set):
+	wto(wto),
+	dom(dom),
+	st(stats),
+	skip_set(skip_set),
+	ins(wto.count(), dom.bot()),
+	outs(wto.count(), dom.bot()),
+	calls(wto.count(), dom.bot()),
+	eouts(wto.edgeCount(), dom.bot()),
+	changes(wto.count(), t::uint32(0)),
+	evals(wto.count(), t::uint32(0)),
+	clock(0),
+	tmp(nullptr),
+	live(0)
+	{ }
+
+///
+WTOSolver::~WTOSolver() {
+	for(auto s: used)
+		static_cast<GCState *>(s)->_uses = 0;
+}
+
+///
+void WTOSolver::process() {
+	run(0, wto.length());
+}
+
+// evaluate the positions [f, l[
+void WTOSolver::run(int f, int l) {
+	int p = f;
+	while(p < l)
+		if(wto.isHead(p)) {
+			stabilize(p);
+			p = wto.endOf(p);
+		}
+		else {
+			eval(wto.at(p));
+			p++;
+		}
+}
+
+// stabilize the component headed at position p
+void WTOSolver::stabilize(int p) {
+	int h = wto.at(p);
+	eval(h);
+	do
+		run(p + 1, wto.endOf(p));
+	while(eval(h));
+}
+
+// compute the state before v
+ai::State *WTOSolver::input(int v) {
+	auto b = wto.block(v);
+	ai::State *s = nullptr;
+
+	// function entry: join of the calls
+	if(b->isEntry()) {
+		if(b->cfg() == wto.cfgs().entry())
+			s = dom.entry();
+		for(auto c: b->cfg()->callers()) {
+			auto cs = calls[wto.index(c)];
+			tmp = s = s == nullptr ? cs : dom.join(s, cs);
+		}
+	}
+
+	// other blocks: join of the in-edges
+	else {
+		int i = wto.firstEdge(v);
+		for(auto e: b->inEdges()) {
+			eouts[i] = dom.update(e, outs[wto.index(e->source())]);
+			tmp = s = s == nullptr ? eouts[i] : dom.join(s, eouts[i]);
+			i++;
+		}
+	}
+
+	tmp = nullptr;
+	return s == nullptr ? dom.bot() : s;
+}
+
+// evaluate block v and return true if one of its states changed
+bool WTOSolver::eval(int v) {
+
+	// nothing changed?
+	if(evals[v] != 0) {
+		bool changed = false;
+		for(int i = 0; !changed && i < wto.predCount(v); i++)
+			changed = changes[wto.pred(v, i)] > evals[v];
+		if(!changed) {
+			if(st != nullptr)
+				st->saved++;
+			return false;
+		}
+	}
+	evals[v] = ++clock;
+
+	// update the input
+	bool in_changed = false;
+	auto s = input(v);
+	if(!dom.equals(s, ins[v])) {
+		ins[v] = s;
+		in_changed = true;
+	}
+
+	// update the output
+	bool out_changed = false;
+	auto b = wto.block(v);
+	CFG *callee = b->isSynth() ? b->toSynth()->callee() : nullptr;
+	if(callee != nullptr && skip_set >= 0 && !FOOTPRINT(callee)->touches(skip_set))
+		callee = nullptr;
+	if(callee == nullptr) {
+		if(in_changed) {
+			s = dom.update(b, ins[v]);
+			if(!dom.equals(s, outs[v])) {
+				outs[v] = s;
+				out_changed = true;
+			}
+		}
+	}
+	else {
+		if(in_changed) {
+			s = dom.update(b, ins[v]);
+			if(!dom.equals(s, calls[v])) {
+				calls[v] = s;
+				out_changed = true;
+			}
+		}
+		s = callee->exit() == nullptr ? dom.bot() : outs[wto.index(callee->exit())];
+		if(!dom.equals(s, outs[v])) {
+			outs[v] = s;
+			out_changed = true;
+		}
+	}
+
+	if(out_changed)
+		changes[v] = ++clock;
+	return in_changed || out_changed;
+}
+
+// return a used state
+ai::State *WTOSolver::give(ai::State *s) {
+	use(s);
+	return s;
+}
+
+// the use count of a state is kept in the state itself, the LISTED bit
+// telling that the state is in the used list
+static const t::uint32 LISTED = 0x80000000;
+
+// remove the states no more used from the used list
+void WTOSolver::compact() {
+	int j = 0;
+	for(auto s: used) {
+		auto g = static_cast<GCState *>(s);
+		if((g->_uses & ~LISTED) == 0)
+			g->_uses = 0;
+		else
+			used[j++] = s;
+	}
+	used.setLength(j);
+}
+
+///
+ai::State *WTOSolver::before(Edge *e) {
+	return give(outs[wto.index(e->source())]);
+}
+
+///
+ai::State *WTOSolver::after(Edge *e) {
+	return give(eouts[wto.edgeIndex(e)]);
+}
+
+///
+ai::State *WTOSolver::before(otawa::Block *v) {
+	return give(ins[wto.index(v)]);
+}
+
+///
+ai::State *WTOSolver::after(otawa::Block *v) {
+	return give(outs[wto.index(v)]);
+}
+
+/**
+ * The uses are counted in the state: a state is added to the list of used
+ * states on its first use and, as a release only decrements the count, the
+ * states no more used are removed from the list by chunks. Both use() and
+ * release() are O(1) (amortized for use()).
+ */
+void WTOSolver::use(ai::State *s) {
+	auto g = static_cast<GCState *>(s);
+	if((g->_uses & ~LISTED) == 0)
+		live++;
+	g->_uses++;
+	if((g->_uses & LISTED) == 0) {
+		g->_uses |= LISTED;
+		used.add(s);
+		if(used.length() > 2 * live + 16)
+			compact();
+	}
+}
+
+///
+void WTOSolver::release(ai::State *s) {
+	auto g = static_cast<GCState *>(s);
+	ASSERTP((g->_uses & ~LISTED) != 0, "releasing a not used state");
+	g->_uses--;
+	if((g->_uses & ~LISTED) == 0)
+		live--;
+}
+
+///
+void WTOSolver::collect(ai::state_collector_t f) {
+	for(auto s: ins)
+		f(s);
+	for(auto s: outs)
+		f(s);
+	for(auto s: calls)
+		f(s);
+	for(auto s: eouts)
+		f(s);
+	compact();
+	for(auto s: used)
+		f(s);
+	if(tmp != nullptr)
+		f(tmp);
+}
+
+} }		// otawa::dcache
@@ -0,0 +1,634 @@
+/*
+ *	Store class implementation
+ *
+ *	This file is part of OTAWA
+ *	Copyright (c) 2020, IRIT UPS.
+ *
+ *	OTAWA is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	OTAWA is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with OTAWA; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <elm/avl/Map.h>
+#include <elm/io/BlockInStream.h>
+#include <elm/sys/System.h>
+
+#include "otawa/dcache/Analysis.h"
+#include "otawa/dcache/Solver.h"
+#include "otawa/dcache/Store.h"
+
+namespace otawa { namespace dcache {
+
+// version of the file format (to change when the format or the domains change)
+static const t::uint32 VERSION = 3;
+
+// FNV-1a hash
+class Hasher {
+public:
+	Hasher(): h(0xcbf29ce484222325ULL) { }
+	void add(const void *p, t::size s) {
+		auto b = static_cast<const t::uint8 *>(p);
+		for(t::size i = 0; i < s; i++)
+			h = (h ^ b[i]) * 0x100000001b3ULL;
+	}
+	inline Hasher& operator<<(t::int64 x) { add(&x, sizeof(x)); return *this; }
+	inline Hasher& operator<<(const String& s)
+		{ add(s.toCString(), s.length()); return *this << t::int64(s.length()); }
+	inline Hasher& operator<<(Address a)
+		{ return *this << t::int64(a.page()) << t::int64(a.offset()); }
+	inline t::uint64 value() const { return h; }
+private:
+	t::uint64 h;
+};
+
+// hash an access as seen from the given set (-1 for all sets), independently
+// of the address of its instruction
+static void hashAccess(Hasher& h, const Access& a, int set) {
+	h << int(a.kind()) << int(a.action());
+	switch(a.kind()) {
+	case BLOCK:
+		h << a.block()->set() << a.block()->tag();
+		break;
+	case ENUM:
+		for(int i = 0; i < a.blockCount(); i++) {
+			auto b = a.blockAt(i);
+			if(set < 0 || (b != nullptr && b->set() == set))
+				h << (b == nullptr ? -1 : b->set()) << (b == nullptr ? -1 : b->tag());
+		}
+		break;
+	case RANGE:
+		if(set < 0)
+			h << a.first() << a.last();
+		break;
+	default:
+		break;
+	}
+}
+
+static void read(io::InStream& in, void *p, int s) {
+	if(in.read(p, s) != s)
+		throw io::IOException("corrupted result store");
+}
+
+static void write(io::OutStream& out, const void *p, int s) {
+	if(out.write(static_cast<const char *>(p), s) != s)
+		throw io::IOException(out.lastErrorMessage());
+}
+
+
+/**
+ * @class Store
+ * A store records the states computed by an Analysis (before and after each
+ * block and after each edge, for each set) in a file. On a later run with the
+ * same program, set collection and cache, the file is memory-mapped and the
+ * states of a set are decoded the first time the set is looked, replacing
+ * the computation of its fixpoint.
+ *
+ * In addition, each set is identified by its own key (see computeKeys())
+ * built from the CFG structure and from the accesses touching the set only.
+ * When the program changes slightly, the previous file can still provide
+ * the sets whose key did not change (see reuse()): only the other sets have
+ * to be computed again, and the saved file contains both kinds of sets.
+ *
+ * Finally, a store may gather the sets from several files (see merge()),
+ * typically the shards produced by runs analyzing disjoint groups of sets
+ * (see @ref Analysis::SHARD).
+ *
+ * The file starts with a header (including the key identifying the analyzed
+ * program and cache and the key of the CFG structure) followed by the offsets
+ * of the set records and by the keys of the sets. In a set record, each state
+ * is a tag byte possibly followed by the state, saved by the domain, or by
+ * the index of a previous identical state.
+ *
+ * @ingroup dcache
+ */
+
+/**
+ * Build a store.
+ * @param collection	Analyzed CFG collection.
+ * @param domains	Domains of the sets (used to load and save the states).
+ */
+Store::Store(const CFGCollection& collection, const AllocArray<Domain *>& domains):
+	cfgs(collection),
+	doms(domains),
+	base(cfgs.count()),
+	first(cfgs.countBlocks()),
+	slots(0),
+	states(domains.count()),
+	outs(domains.count()),
+	full(false),
+	src(domains.count(), -1),
+	shape(0),
+	skeys(domains.count(), t::uint64(0))
+{
+	int b = 0;
+	for(auto g: cfgs) {
+		base[g->index()] = b;
+		for(auto v: *g) {
+			first[b + v->index()] = slots;
+			slots += 2 + v->countOuts();
+		}
+		b += g->count();
+	}
+	for(int i = 0; i < domains.count(); i++) {
+		states[i] = nullptr;
+		outs[i] = nullptr;
+	}
+}
+
+///
+Store::~Store() {
+	for(int i = 0; i < states.count(); i++) {
+		if(states[i] != nullptr)
+			delete [] states[i];
+		if(outs[i] != nullptr)
+			delete outs[i];
+	}
+	unmap();
+}
+
+/**
+ * Compute the key identifying an analysis. It is built from the analysis
+ * name, the cache geometry, the cache blocks of the set collection and the
+ * CFGs with their accesses. The addresses of the code are not used: they
+ * do not change the analysis results.
+ * @param name		Analysis name.
+ * @param cfgs		Analyzed CFGs.
+ * @param coll		Set collection.
+ * @param config	Configuration of the analysis changing its results.
+ * @return			Analysis key.
+ */
+t::uint64 Store::key(const string& name, const CFGCollection& cfgs, const SetCollection& coll, t::uint64 config) {
+	Hasher h;
+	h << VERSION << name << t::int64(config);
+
+	// cache and blocks
+	const auto& c = coll.cache();
+	h << c.setCount() << c.wayCount() << c.blockBits()
+	  << int(c.replacementPolicy()) << c.doesWriteAllocate();
+	for(int s = 0; s < coll.setCount(); s++) {
+		h << coll.blockCount(s);
+		for(int i = 0; i < coll.blockCount(s); i++)
+			h << s << coll.block(s, i)->tag();
+	}
+
+	// CFGs and accesses
+	for(auto g: cfgs) {
+		h << g->index() << g->count();
+		for(auto v: *g) {
+			h << v->index() << v->isEntry() << v->isExit() << v->isBasic() << v->isSynth();
+			if(v->isSynth() && v->toSynth()->callee() != nullptr)
+				h << v->toSynth()->callee()->index();
+			for(auto e: v->outEdges())
+				h << e->sink()->cfg()->index() << e->sink()->index();
+			const AccessList& accs = *ACCESSES(v);
+			h << accs.count();
+			for(const auto& a: accs)
+				hashAccess(h, a, -1);
+		}
+	}
+	return h.value();
+}
+
+/**
+ * Compute the key of the CFG structure and the key of each set, used to save
+ * the store and to reuse the sets of a previous store (see reuse()). The key
+ * of a set is built from the analysis name, the cache geometry, the CFG
+ * structure, the cache blocks of the set and the accesses touching the set
+ * (see @ref SET_ACCESSES) with their position in the blocks: it does not
+ * change when only accesses to other sets change. As the keys do not depend
+ * on the code addresses, moving the code does not change them either.
+ * @param name		Analysis name.
+ * @param coll		Set collection.
+ * @param config	Configuration of the analysis changing its results.
+ */
+void Store::computeKeys(const string& name, const SetCollection& coll, t::uint64 config) {
+
+	// CFG structure
+	Hasher h;
+	h << VERSION << name << t::int64(config);
+	const auto& c = coll.cache();
+	h << c.setCount() << c.wayCount() << c.blockBits()
+	  << int(c.replacementPolicy()) << c.doesWriteAllocate();
+	for(auto g: cfgs) {
+		h << g->index() << g->count();
+		for(auto v: *g) {
+			h << v->index() << v->isEntry() << v->isExit() << v->isBasic() << v->isSynth();
+			if(v->isSynth() && v->toSynth()->callee() != nullptr)
+				h << v->toSynth()->callee()->index();
+			for(auto e: v->outEdges())
+				h << e->sink()->cfg()->index() << e->sink()->index();
+		}
+	}
+	shape = h.value();
+
+	// cache blocks of the sets
+	AllocArray<Hasher> shs(skeys.count());
+	for(int s = 0; s < skeys.count(); s++) {
+		shs[s] << t::int64(shape) << coll.blockCount(s);
+		for(int i = 0; i < coll.blockCount(s); i++)
+			shs[s] << s << coll.block(s, i)->tag();
+	}
+
+	// accesses of the sets, in a single walk of the blocks
+	for(auto g: cfgs)
+		for(auto v: *g) {
+			auto sa = SET_ACCESSES(v);
+			if(sa == nullptr)
+				continue;
+			// with wide accesses, any set may be concerned
+			int n = sa->wideCount() != 0 ? skeys.count() : sa->count();
+			for(int k = 0; k < n; k++) {
+				int s = sa->wideCount() != 0 ? k : sa->set(k);
+				auto as = sa->accesses(s);
+				if(as.count() == 0)
+					continue;
+				shs[s] << g->index() << v->index() << as.count();
+				for(auto a: as)
+					hashAccess(shs[s], *a, s);
+			}
+		}
+	for(int s = 0; s < skeys.count(); s++)
+		skeys[s] = shs[s].value();
+}
+
+/**
+ * Open the store file and check that it matches the given key.
+ * @param path	Path of the store file.
+ * @param key	Expected key.
+ * @return		True if the file has been opened, false else.
+ */
+bool Store::open(const sys::Path& path, t::uint64 key) {
+	int m = map_file(path);
+	if(m < 0)
+		return false;
+	if(header(maps[m].base)->key != key) {
+		drop();
+		return false;
+	}
+	full = true;
+	for(int i = 0; i < src.count(); i++)
+		src[i] = m;
+	return true;
+}
+
+/**
+ * Open a store file produced for a different version of the program and
+ * make available the sets whose key (see computeKeys()) did not change.
+ * The CFG structure must be the same. The other sets have to be computed
+ * and recorded (see record()) again.
+ * @param path	Path of the previous store file.
+ * @return		Number of reused sets.
+ */
+int Store::reuse(const sys::Path& path) {
+	int m = map_file(path);
+	if(m < 0)
+		return 0;
+	auto mb = maps[m].base;
+	if(header(mb)->shape != shape) {
+		drop();
+		return 0;
+	}
+	int cnt = 0;
+	auto offs = offsets(mb);
+	auto ks = keys(mb);
+	for(int i = 0; i < src.count(); i++)
+		if(src[i] < 0 && doms[i] != nullptr && ks[i] == skeys[i] && offs[i] < offs[i + 1]) {
+			src[i] = m;
+			cnt++;
+		}
+	if(cnt == 0)
+		drop();
+	return cnt;
+}
+
+/**
+ * Add the sets recorded in the given store file, typically a shard produced
+ * by a run analyzing only part of the sets (see @ref Analysis::SHARD).
+ * The file must match the given key and only sets not already provided by
+ * a previous file are taken. When all sets are provided, the store becomes
+ * open (see isOpen()).
+ * @param path	Path of the merged file.
+ * @param key	Expected key.
+ * @return		Number of sets provided by the file.
+ */
+int Store::merge(const sys::Path& path, t::uint64 key) {
+	int m = map_file(path);
+	if(m < 0)
+		return 0;
+	auto mb = maps[m].base;
+	if(header(mb)->key != key) {
+		drop();
+		return 0;
+	}
+	int cnt = 0;
+	auto offs = offsets(mb);
+	for(int i = 0; i < src.count(); i++)
+		if(src[i] < 0 && doms[i] != nullptr && offs[i] < offs[i + 1]) {
+			src[i] = m;
+			cnt++;
+		}
+	if(cnt == 0) {
+		drop();
+		return 0;
+	}
+	full = true;
+	for(int i = 0; full && i < src.count(); i++)
+		full = src[i] >= 0 || doms[i] == nullptr;
+	return cnt;
+}
+
+// map a store file, check its layout and return its mapping index (-1 on error)
+int Store::map_file(const sys::Path& path) {
+	int fd = ::open(path.toString().toCString(), O_RDONLY);
+	if(fd < 0)
+		return -1;
+	struct stat st;
+	if(fstat(fd, &st) < 0 || t::size(st.st_size) < sizeof(header_t)) {
+		close(fd);
+		return -1;
+	}
+	auto p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(p == MAP_FAILED)
+		return -1;
+
+	// check the header
+	auto m = static_cast<const char *>(p);
+	auto h = reinterpret_cast<const header_t *>(m);
+	auto offs = reinterpret_cast<const t::uint64 *>(m + sizeof(header_t));
+	t::size hs = sizeof(header_t) + (2 * states.count() + 1) * sizeof(t::uint64);
+	bool ok = array::equals(h->magic, "DCRS", 4)
+		&& h->version == VERSION
+		&& int(h->sets) == states.count()
+		&& int(h->slots) == slots
+		&& t::size(st.st_size) >= hs
+		&& offs[states.count()] == t::uint64(st.st_size);
+	for(int i = 0; ok && i < states.count(); i++)
+		ok = hs <= offs[i] && offs[i] <= offs[i + 1];
+	if(!ok) {
+		munmap(p, st.st_size);
+		return -1;
+	}
+	maps.add({ m, t::size(st.st_size) });
+	return maps.length() - 1;
+}
+
+// release the last mapping (not providing any set)
+void Store::drop() {
+	auto& m = maps[maps.length() - 1];
+	munmap(const_cast<char *>(m.base), m.size);
+	maps.pop();
+}
+
+// release the mappings of the store files
+void Store::unmap() {
+	for(const auto& m: maps)
+		munmap(const_cast<char *>(m.base), m.size);
+	maps.clear();
+	full = false;
+	for(int i = 0; i < src.count(); i++)
+		src[i] = -1;
+}
+
+/**
+ * Record the states of the given set.
+ * @param set	Recorded set.
+ * @param ana	Solver containing the states of the set.
+ */
+void Store::record(int set, Solver& ana) {
+	auto& dom = *doms[set];
+	auto out = new io::BlockOutStream();
+	outs[set] = out;
+	avl::Map<ai::State *, t::uint32> done;
+	Vector<ai::State *> used;
+	int i = 0;
+
+	// states are kept used up to the end to prevent address reuse
+	auto put = [&](ai::State *s) {
+		used.add(s);
+		t::uint8 tag;
+		if(s == dom.bot())
+			tag = BOT;
+		else if(s == dom.top())
+			tag = TOP;
+		else if(s == dom.entry())
+			tag = ENTRY;
+		else if(done.hasKey(s))
+			tag = REF;
+		else
+			tag = STATE;
+		write(*out, &tag, sizeof(tag));
+		if(tag == REF) {
+			t::uint32 r = done.get(s, 0);
+			write(*out, &r, sizeof(r));
+		}
+		else if(tag == STATE) {
+			dom.save(s, out);
+			done.put(s, i);
+		}
+		i++;
+	};
+
+	// record the slots in order
+	for(auto g: cfgs)
+		for(auto v: *g) {
+			put(ana.before(v));
+			put(ana.after(v));
+			for(auto e: v->outEdges())
+				put(ana.after(e));
+		}
+	for(auto s: used)
+		ana.release(s);
+}
+
+/**
+ * Save the recorded sets, and the sets reused from a previous store
+ * (see reuse()) or merged from other files (see merge()), in the given file. The file is first written aside and
+ * then renamed so that it can replace the reused file.
+ * @param path	Path of the store file.
+ * @param key	Key of the analysis.
+ */
+void Store::save(const sys::Path& path, t::uint64 key) {
+	sys::Path tmp = path.toString() + ".tmp";
+	auto out = sys::System::createFile(tmp);
+	try {
+
+		// size of the set records
+		AllocArray<t::uint64> sizes(outs.count(), t::uint64(0));
+		for(int i = 0; i < outs.count(); i++)
+			if(outs[i] != nullptr)
+				sizes[i] = outs[i]->size();
+			else if(isLoaded(i))
+				sizes[i] = length(i);
+
+		// write the header
+		header_t h;
+		array::copy(h.magic, "DCRS", 4);
+		h.version = VERSION;
+		h.key = key;
+		h.shape = shape;
+		h.sets = outs.count();
+		h.slots = slots;
+		write(*out, &h, sizeof(h));
+
+		// write the offsets and the keys
+		t::uint64 off = sizeof(header_t) + (2 * outs.count() + 1) * sizeof(t::uint64);
+		for(int i = 0; i <= outs.count(); i++) {
+			write(*out, &off, sizeof(off));
+			if(i < outs.count())
+				off += sizes[i];
+		}
+		for(int i = 0; i < outs.count(); i++)
+			write(*out, &skeys[i], sizeof(t::uint64));
+
+		// write the sets
+		for(int i = 0; i < outs.count(); i++)
+			if(outs[i] != nullptr) {
+				write(*out, outs[i]->block(), outs[i]->size());
+				delete outs[i];
+				outs[i] = nullptr;
+			}
+			else if(sizes[i] != 0)
+				write(*out, map(i) + offset(i), sizes[i]);
+	}
+	catch(...) {
+		delete out;
+		throw;
+	}
+	delete out;
+	if(::rename(tmp.toString().toCString(), path.toString().toCString()) != 0)
+		throw io::IOException(_ << "cannot rename " << tmp << " to " << path);
+}
+
+/**
+ * @fn bool Store::isOpen() const;
+ * Test if the store provides all sets, either because it has been opened
+ * from a file or because all sets have been merged (see merge()).
+ * @return	True if the store is opened, false else.
+ */
+
+/**
+ * @fn bool Store::isLoaded(int set) const;
+ * Test if the states of the given set are provided by the store file, either
+ * because the store has been opened or because the set has been reused or
+ * merged.
+ * @param set	Tested set.
+ * @return		True if the set is provided by the store, false else.
+ */
+
+/**
+ * Get the state before the given block.
+ * @param v		Looked block.
+ * @param set	Looked set.
+ * @return		State before v.
+ */
+ai::State *Store::before(otawa::Block *v, int set) {
+	return get(set, slot(v));
+}
+
+/**
+ * Get the state after the given block.
+ * @param v		Looked block.
+ * @param set	Looked set.
+ * @return		State after v.
+ */
+ai::State *Store::after(otawa::Block *v, int set) {
+	return get(set, slot(v) + 1);
+}
+
+/**
+ * Get the state after the given edge.
+ * @param e		Looked edge.
+ * @param set	Looked set.
+ * @return		State after e.
+ */
+ai::State *Store::after(Edge *e, int set) {
+	return get(set, slot(e));
+}
+
+/**
+ * Call f on each loaded state of the given set (for garbage collection).
+ * @param set	Concerned set.
+ * @param f		Function to call.
+ */
+void Store::collect(int set, ai::state_collector_t f) {
+	auto ss = states[set];
+	if(ss != nullptr)
+		for(int i = 0; i < slots; i++)
+			if(ss[i] != nullptr)
+				f(ss[i]);
+}
+
+// get the slot of block v
+int Store::slot(otawa::Block *v) const {
+	return first[base[v->cfg()->index()] + v->index()];
+}
+
+// get the slot of edge e
+int Store::slot(Edge *e) const {
+	int i = slot(e->source()) + 2;
+	for(auto f: e->source()->outEdges()) {
+		if(f == e)
+			break;
+		i++;
+	}
+	return i;
+}
+
+// get the state of the given slot
+ai::State *Store::get(int set, int slot) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if(states[set] == nullptr)
+			load(set);
+	}
+	return states[set][slot];
+}
+
+// decode the states of the set from the mapping
+void Store::load(int set) {
+	auto ss = new ai::State *[slots];
+	array::set(ss, slots, static_cast<ai::State *>(nullptr));
+	states[set] = ss;
+	auto& dom = *doms[set];
+	io::BlockInStream in(map(set) + offset(set), t::size(length(set)));
+	for(int i = 0; i < slots; i++) {
+		t::uint8 tag;
+		read(in, &tag, sizeof(tag));
+		switch(tag) {
+		case BOT:	ss[i] = dom.bot(); break;
+		case TOP:	ss[i] = dom.top(); break;
+		case ENTRY:	ss[i] = dom.entry(); break;
+		case STATE:	ss[i] = dom.load(&in); break;
+		case REF: {
+				t::uint32 r;
+				read(in, &r, sizeof(r));
+				if(int(r) >= i)
+					throw io::IOException("corrupted result store");
+				ss[i] = ss[r];
+			}
+			break;
+		default:
+			throw io::IOException("corrupted result store");
+		}
+	}
+}
+
+} }	// otawa::dcache
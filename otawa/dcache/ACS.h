@@ -24,35 +24,48 @@
 #include <elm/alloc/ListGC.h>
 #include "Analysis.h"
 #include "features.h"
+#include "kernels.h"
 
 namespace otawa { namespace dcache {
 
-class GCState: public ai::State {
-public:
-	virtual ~GCState();
-	virtual void mark(AbstractGC& gc) = 0;
-};
-
 class ACS: public GCState {
 public:
-	typedef t::uint8 age_t;
-	static const age_t BOT = 255;
-	inline ACS(int N): age(new age_t[N]) { }
-	inline ACS(int N, age_t a): age(new age_t[N]) { for(int i = 0; i < N; i++) age[i] = a; }
-	inline ACS(int N, const ACS& a): age(new age_t[N]) { array::copy(age, a.age, N); }
-	inline ~ACS() { delete [] age; }
-	age_t *age;
+	typedef kernel::age_t age_t;
+	static const age_t BOT = kernel::BOT;
+	static inline int padded(int N) { return kernel::padded(N); }
+	static inline t::size size(int N) { return sizeof(ACS) + padded(N) * sizeof(age_t); }
+	inline ACS(int set, int N): GCState(set), n(N) { pad(N); }
+	inline ACS(int set, int N, age_t a): GCState(set), n(N) { array::set(age, N, a); pad(N); }
+	inline ACS(int N, const ACS& a): GCState(a.set()), n(N) { array::copy(age, a.age, padded(N)); }
 	void print(const dcache::SetCollection& collection, int set, io::Output& out);
 	void save(int N, io::OutStream *out);
 	void load(int N, io::InStream *out);
 	bool equals(int N, ACS *a);
 	void mark(AbstractGC& gc) override;
+	inline t::size size() const override { return size(n); }
+private:
+	inline void pad(int N) { for(int i = N; i < padded(N); i++) age[i] = BOT; }
+	t::uint32 n;
+public:
+	age_t age[];
 };
 inline ACS *acs(ai::State *s) { return static_cast<ACS *>(s); }
 
+class ACSCursor: public AgeInfo::Cursor {
+public:
+	inline ACSCursor(Analysis& analysis, otawa::Block *v): c(analysis, v) { }
+	inline ACSCursor(Analysis& analysis, Edge *e): c(analysis, e) { }
+	int age(const CacheBlock *b) override
+		{ return acs(c.state(b->set()))->age[b->id()]; }
+	void next() override { c.next(); }
+private:
+	Analysis::BlockCursor c;
+};
+
 class ACSDomain: public dcache::Domain {
 public:
-	ACSDomain(const dcache::SetCollection& coll, int set, int assoc, int top, ListGC& gc_);
+	ACSDomain(const dcache::SetCollection& coll, int set, int assoc, int top, ListGC& gc_, bool sharing = false);
+	~ACSDomain();
 
 	ai::State *bot() override;
 	ai::State *top() override;
@@ -68,6 +81,11 @@ public:
 	ai::State *load(io::InStream *in) override;
 
 	void collect(ai::state_collector_t f) override;
+	void clean(GCState *s) override;
+
+	inline bool isSharing() const { return table != nullptr; }
+	static inline bool agesAll(const Access& a)
+		{ return (a.action() == LOAD || a.action() == STORE) && (a.kind() == ANY || a.kind() == RANGE); }
 
 protected:
 	const dcache::SetCollection& coll;
@@ -75,10 +93,20 @@ protected:
 	int N;
 	ACS::age_t A, sumA;
 	ACS *BOT, *TOP, *os;
-	inline ACS *make(int i = ACS::BOT) const { return new(gc.alloc<ACS>()) ACS(N, i); }
-	inline ACS *copy(ACS *a) const { return new(gc.alloc<ACS>()) ACS(N, *a); }
-	inline int sum(ACS *a) const
-		{ int s = 0; for(int i = 0; i < N; i++) s += a->age[i]; return s; }
+	ACS *in;		// input of the current transfer (key of the memo, kept alive)
+	inline ACS *make(int i = ACS::BOT) const { return new(room()) ACS(S, N, i); }
+	inline ACS *alloc() const { return table == nullptr ? new(room()) ACS(S, N) : scratch; }
+	inline ACS *copy(ACS *a) const { return new(room()) ACS(N, *a); }
+	inline int sum(ACS *a) const { return kernel::sum(a->age, N); }
+	ACS *share(ACS *a) const;
+	ACS *memo(const Access& a, ACS *s, int k = 1) const;
+	ACS *memo(const Access& a, ACS *s, ACS *r, int k = 1) const;
+
+private:
+	class Table;
+	inline void *room() const { return table == nullptr ? gc.allocate(ACS::size(N)) : static_cast<void *>(scratch); }
+	Table *table;
+	ACS *scratch;
 };
 
 } }		// otawa::dcache
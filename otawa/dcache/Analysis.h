@@ -21,8 +21,10 @@
 #ifndef OTAWA_DCACHE_ANALYSIS_H_
 #define OTAWA_DCACHE_ANALYSIS_H_
 
+#include <mutex>
 #include <elm/alloc/ListGC.h>
 #include <elm/avl/Map.h>
+#include <elm/sys/Path.h>
 #include <otawa/ai/CFGAnalyzer.h>
 #include <otawa/cfg/features.h>
 #include <otawa/hard/Cache.h>
@@ -33,12 +35,29 @@
 namespace otawa { namespace dcache {
 
 class ACS;
+class Solver;
+class Store;
+class WTO;
+
+class GCState: public ai::State {
+	friend class WTOSolver;
+public:
+	inline GCState(int set): _set(set), _uses(0) { }
+	virtual ~GCState();
+	inline int set() const { return _set; }
+	virtual void mark(AbstractGC& gc) = 0;
+	virtual t::size size() const = 0;
+private:
+	t::int32 _set;
+	t::uint32 _uses;
+};
 
 class Domain: public ai::Domain {
 public:
 	inline Domain(int set): S(set) { }
 	virtual ai::State *update(const Access& a, ai::State *s) = 0;
 	virtual void collect(ai::state_collector_t f);
+	virtual void clean(GCState *s);
 
 	bool implementsCodePrinting() override;
 	void printCode(otawa::Block *b, io::Output& out) override;
@@ -47,11 +66,70 @@ protected:
 	int S;
 };
 
+class SetStats {
+public:
+	SetStats();
+	void add(const SetStats& s);
+	void dump(io::Output& out) const;
+	bool analyzed;
+	t::uint64 iterations, block_updates, edge_updates, joins, saved;
+	t::uint64 states, allocated_bytes, collections, reclaimed_states, reclaimed_bytes;
+	t::uint64 time;
+};
+
+class Statistics {
+public:
+	Statistics(const string& name, int set_count);
+	inline const string& name() const { return _name; }
+	inline int setCount() const { return sets.count(); }
+	inline const SetStats& at(int set) const { return sets[set]; }
+	inline SetStats& at(int set) { return sets[set]; }
+	SetStats total() const;
+	void dump(io::Output& out) const;
+private:
+	string _name;
+	AllocArray<SetStats> sets;
+};
+
 class Analysis: public Processor {
 public:
 	static p::declare reg;
 	Analysis(p::declare& reg);
 
+	class Cursor {
+	public:
+		Cursor(Analysis& analysis, otawa::Block *v, int set);
+		Cursor(Analysis& analysis, Edge *e, int set);
+		~Cursor();
+		inline bool ended() const { return i >= as.count(); }
+		inline const Access& access() const { return as[i]; }
+		inline int index() const { return i; }
+		inline ai::State *state() const { return s; }
+		void next();
+		void moveTo(int index);
+	private:
+		Analysis& ana;
+		AccessList as;
+		int S, i;
+		ai::State *s;
+	};
+
+	class BlockCursor {
+	public:
+		BlockCursor(Analysis& analysis, otawa::Block *v);
+		BlockCursor(Analysis& analysis, Edge *e);
+		~BlockCursor();
+		ai::State *state(int set);
+		inline void next() { i++; }
+		inline int index() const { return i; }
+	private:
+		Analysis& ana;
+		otawa::Block *v;
+		Edge *e;
+		int i;
+		avl::Map<int, Cursor *> curs;
+	};
+
 	void configure(const PropList& props) override;
 
 	ai::State *before(Edge *e, int set);
@@ -61,6 +139,9 @@ public:
 	ai::State *at(otawa::Block *v, const Access& a, int set);
 	ai::State *at(Edge *e, const Access& a, int set);
 	void release(ai::State *s);
+	inline const Statistics *statistics() const { return stats; }
+	inline bool isLazy() const { return lazy; }
+	void drop(int set);
 
 protected:
 
@@ -69,25 +150,72 @@ protected:
 	void processWorkSpace(WorkSpace *ws) override;
 	void dump(WorkSpace *ws, Output& out) override;
 
+	void cleanup(WorkSpace *ws) override;
+
 	virtual Domain *domainFor(const SetCollection& coll, int set) = 0;
+	virtual t::uint32 format() const;
 
 	void collect(ai::state_collector_t f);
+	void collect(int set, ai::state_collector_t f);
+	ListGC& gcFor(int set);
+	inline bool hashConsing() const { return hash_consing; }
+	void use(ai::State *s);
 
 private:
-	ai::State *at(otawa::Block *v, const Access& a, ai::State *s, int set);
+	class SetGC;
+	class StatDomain;
+	ai::State *at(Cursor& c, const Access& a, int set);
+	ai::State *stateBefore(otawa::Block *v, int set);
+	ai::State *stateBefore(Edge *e, int set);
+	ai::State *stateAfter(otawa::Block *v, int set);
+	ai::State *stateAfter(Edge *e, int set);
+	inline bool isStored(int set) const;
+	void save(const sys::Path& path, t::uint64 key, const Vector<int>& sets);
+	sys::Path shardPath(int shard, t::uint64 key);
 	void process(WorkSpace *ws, int set);
+	Solver *makeSolver(int set);
+	inline void ensure(int set);
+	void processParallel(WorkSpace *ws, const Vector<int>& sets);
 	void dump(WorkSpace *ws, int set, Output& out);
 
 	const SetCollection *coll;
 	const CFGCollection *cfgs;
 	int n;
+	int thread_count;
+	bool hash_consing;
 	AllocArray<Domain *> doms;
-	AllocArray<ai::CFGAnalyzer *> anas;
-	avl::Map<ai::State *, int> uses;
+	AllocArray<Solver *> anas;
+	AllocArray<SetGC *> gcs;
+	std::mutex *locks;
+	std::mutex log_mutex;
 	Vector<int> only_sets;
+	sys::Path store_dir;
+	Store *store;
+	bool stats_on, stats_dump;
+	Statistics *stats;
+	AllocArray<StatDomain *> sdoms;
+	bool lazy;
+	AllocArray<bool> computed;
+	bool wto_order;
+	WTO *wto;
+	bool skip_calls;
+	bool incremental;
+	int shard_count, shard;
 };
 
 extern p::id<int> ONLY_SET;
+extern p::id<int> THREAD_COUNT;
+extern p::id<bool> HASH_CONSING;
+extern p::id<sys::Path> RESULT_CACHE;
+extern p::id<bool> INCREMENTAL;
+extern p::id<int> SHARD_COUNT;
+extern p::id<int> SHARD;
+extern p::id<bool> LAZY;
+extern p::id<bool> WTO_ORDER;
+extern p::id<bool> SKIP_CALLS;
+extern p::id<bool> STATS;
+extern p::id<bool> STATS_DUMP;
+extern p::id<Vector<const Statistics *> *> STATISTICS;
 
 } }		// otawa::dcache
 
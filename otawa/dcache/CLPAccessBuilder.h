@@ -21,6 +21,7 @@
 #ifndef OTAWA_DCACHE_CLPACCESSBUILDER_H_
 #define OTAWA_DCACHE_CLPACCESSBUILDER_H_
 
+#include <mutex>
 #include <otawa/hard/Cache.h>
 #include <otawa/hard/Memory.h>
 #include <otawa/proc/BBProcessor.h>
@@ -29,7 +30,7 @@
 
 namespace otawa {
 
-namespace clp { class Manager; }	
+namespace clp { class Manager; class Value; }
 	
 namespace dcache {
 
@@ -42,18 +43,29 @@ public:
 	void *interfaceFor(const AbstractFeature &feature) override;
 
 protected:
+	void configure(const PropList& props) override;
 	void setup(WorkSpace *ws) override;
 	void processWorkSpace(WorkSpace *ws) override;
 	void processBB(WorkSpace *ws, CFG *g, otawa::Block *b) override;
 	void destroyBB (WorkSpace *ws, CFG *cfg, otawa::Block *b) override;
 	void destroy(WorkSpace *ws) override;
 	void dumpBB(otawa::Block *v, io::Output& out) override;
+	void build(BasicBlock *bb, FragTable<Access>& accs);
+	int stride(const clp::Value& addr) const;
+	action_t coalesce(const FragTable<Access>& accs, int f, action_t action, const CacheBlock *b) const;
+	void processParallel(WorkSpace *ws);
+	void number(WorkSpace *ws);
 
 	const hard::Cache *_cache;
 	const hard::Memory *_mem;
 	SetCollection *_coll;
 	FragTable<Access> accs;
 	clp::Manager *clp;
+	int thread_count;
+	bool coalescing;
+	Vector<FragTable<Access> *> waccs;
+	std::mutex log_mutex;
+	std::mutex clp_mutex;
 };
 
 } }	// otawa::dcache
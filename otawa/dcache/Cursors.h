@@ -0,0 +1,132 @@
+/*
+ *	AgeCursors class interface
+ *
+ *	This file is part of OTAWA
+ *	Copyright (c) 2020, IRIT UPS.
+ *
+ *	OTAWA is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	OTAWA is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with OTAWA; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef OTAWA_DCACHE_CURSORS_H_
+#define OTAWA_DCACHE_CURSORS_H_
+
+#include "features.h"
+
+namespace otawa { namespace dcache {
+
+/**
+ * Set of cursors walking together the accesses of a block on the available
+ * MUST, MAY, PERS and multi-level PERS analyses. If the MUST/MAY/PERS product
+ * is available, the MUST, MAY and PERS cursors are views of a single product
+ * cursor. As the analyses may be queried from several threads, each thread
+ * classifying accesses must use its own set of cursors.
+ * @ingroup dcache
+ */
+class AgeCursors {
+public:
+
+	inline AgeCursors():
+		must(nullptr), may(nullptr), pers(nullptr), mpers(nullptr), prod(nullptr),
+		must_ana(nullptr), may_ana(nullptr), pers_ana(nullptr), mpers_ana(nullptr), prod_ana(nullptr)
+		{ }
+
+	/**
+	 * Select the analyses providing the ages.
+	 * @param must	MUST analysis.
+	 * @param may	MAY analysis (may be null).
+	 * @param pers	PERS analysis (may be null).
+	 * @param mpers	Multi-level PERS analysis (may be null).
+	 * @param prod	MUST/MAY/PERS product (may be null).
+	 */
+	inline void init(AgeInfo *must, AgeInfo *may, AgeInfo *pers, MultiAgeInfo *mpers, ProductInfo *prod) {
+		must_ana = must;
+		may_ana = may;
+		pers_ana = pers;
+		mpers_ana = mpers;
+		prod_ana = prod;
+	}
+
+	/**
+	 * Open the cursors on the given edge or block.
+	 * @param p		Edge or block the accesses are walked for.
+	 */
+	template <class T>
+	void open(T p) {
+		if(prod_ana != nullptr) {
+			prod = prod_ana->cursor(p);
+			must = prod->view(ProductInfo::MUST_AGE);
+			if(may_ana != nullptr)
+				may = prod->view(ProductInfo::MAY_AGE);
+			if(pers_ana != nullptr)
+				pers = prod->view(ProductInfo::PERS_AGE);
+		}
+		else {
+			must = must_ana->cursor(p);
+			if(may_ana != nullptr)
+				may = may_ana->cursor(p);
+			if(pers_ana != nullptr)
+				pers = pers_ana->cursor(p);
+		}
+		if(mpers_ana != nullptr)
+			mpers = mpers_ana->cursor(p);
+	}
+
+	/**
+	 * Move the cursors to the next access.
+	 */
+	void next() {
+		if(prod != nullptr)
+			prod->next();
+		must->next();
+		if(may != nullptr)
+			may->next();
+		if(pers != nullptr)
+			pers->next();
+		if(mpers != nullptr)
+			mpers->next();
+	}
+
+	/**
+	 * Close the cursors opened by open().
+	 */
+	void close() {
+		if(prod != nullptr) {
+			delete prod;
+			prod = nullptr;
+		}
+		else {
+			delete must;
+			delete may;
+			delete pers;
+		}
+		must = nullptr;
+		may = nullptr;
+		pers = nullptr;
+		delete mpers;
+		mpers = nullptr;
+	}
+
+	AgeInfo::Cursor *must, *may, *pers;
+	MultiAgeInfo::Cursor *mpers;
+	ProductInfo::Cursor *prod;
+
+private:
+	AgeInfo *must_ana, *may_ana, *pers_ana;
+	MultiAgeInfo *mpers_ana;
+	ProductInfo *prod_ana;
+};
+
+} }		// otawa::dcache
+
+#endif /* OTAWA_DCACHE_CURSORS_H_ */
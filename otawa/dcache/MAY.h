@@ -29,12 +29,14 @@ namespace otawa { namespace dcache {
 class MAY: public ACSDomain {
 public:
 
-	MAY(const SetCollection& coll, int set, int assoc, ListGC& gc);
+	MAY(const SetCollection& coll, int set, int assoc, ListGC& gc, bool sharing = false);
 
 	ai::State *entry() override;
+	using ACSDomain::update;
 	ai::State *join(ai::State *s1, ai::State *s2) override;
 	ai::State *update(Block *v, ai::State *s) override;
 	ai::State *update(const Access& a, ai::State *s) override;
+	ACS *transfer(const Access& a, ACS *s);
 
 	ACS *access(ACS *s, int b);
 	ACS *purge(ACS *s, int b);
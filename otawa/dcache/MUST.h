@@ -30,16 +30,19 @@ namespace otawa { namespace dcache {
 class MUST: public ACSDomain {
 public:
 
-	MUST(const SetCollection& coll, int set, int assoc, ListGC& gc_);
+	MUST(const SetCollection& coll, int set, int assoc, ListGC& gc_, bool sharing = false);
 
+	using ACSDomain::update;
 	ai::State *join(ai::State *s1, ai::State *s2) override;
 	ai::State *update(Block *v, ai::State *s) override;
 
 	ai::State *update(const Access& a, ai::State *s) override;
+	ACS *transfer(const Access& a, ACS *s);
 	ACS *preaccess(ACS *s, int b);
 	ACS *access(ACS *s, int b);
 	ACS *purge(ACS *s, int b);
-	ACS *accessAny(ACS *s);
+	ACS *accessAny(ACS *s, int k = 1);
+	ACS *accessAny(const Access& a, ACS *s, int k);
 };
 
 } }		// otawa::dcache
@@ -28,12 +28,18 @@ namespace otawa { namespace dcache {
 
 class MultiACS: public GCState {
 public:
-	MultiACS(int D, ACS *i = nullptr);
-	MultiACS(MultiACS *a);
-	MultiACS(MultiACS *a, int D, ACS *i = nullptr);
-	MultiACS(MultiACS *a, int OD, int ND, ACS *i = nullptr);
+	MultiACS(int set, ACS *a, int count = 1, MultiACS *outer = nullptr);
+	inline int depth() const { return _depth; }
+	inline ACS *inner() const { return _acs; }
+	inline int count() const { return _count; }
+	inline MultiACS *outer() const { return _outer; }
+	ACS *level(int i) const;
 	void mark(AbstractGC& gc) override;
-	AllocArray<ACS *> as;
+	inline t::size size() const override { return sizeof(MultiACS); }
+private:
+	ACS *_acs;
+	t::int32 _count, _depth;
+	MultiACS *_outer;
 };
 
 class MultiPERS: public Domain {
@@ -60,18 +66,19 @@ public:
 	void collect(ai::state_collector_t f) override;
 
 private:
+	inline MultiACS *make(ACS *a, int n, MultiACS *o)
+		{ return new(gc.alloc<MultiACS>()) MultiACS(S, a, n, o); }
+	MultiACS *push(MultiACS *s, ACS *a, int n);
+	MultiACS *drop(MultiACS *s, int n);
+	MultiACS *resize(MultiACS *s, int D, ACS *a);
+	MultiACS *rebuild(MultiACS *s, const Vector<ACS *>& old);
+	static void expand(MultiACS *s, Vector<ACS *>& ls);
+
 	PERS pers;
 	ListGC& gc;
 	MultiACS *BOT, *TOP, *os;
 	avl::Map<Block *, int> ds;
-	inline MultiACS *make(int D, ACS *I)
-		{ return new(gc.alloc<MultiACS>()) MultiACS(D, I); }
-	inline MultiACS *copy(MultiACS *a)
-		{ return new(gc.alloc<MultiACS>()) MultiACS(a); }
-	inline MultiACS *copy(MultiACS *a, int D, ACS *i)
-		{ return new(gc.alloc<MultiACS>()) MultiACS(a, D, i); }
-	inline MultiACS *copy(MultiACS *a, int OD, int ND, ACS *i)
-		{ return new(gc.alloc<MultiACS>()) MultiACS(a, OD, ND, i); }
+	Vector<ACS *> in1, in2, levs;
 };
 
 } }		// otawa::dcache
@@ -30,18 +30,21 @@ namespace otawa { namespace dcache {
 class PERS: public ACSDomain {
 public:
 
-	PERS(const SetCollection& coll, int set, int assoc, ListGC& gc);
+	PERS(const SetCollection& coll, int set, int assoc, ListGC& gc, bool sharing = false);
 
 	ai::State *entry() override;
 	void collect(ai::state_collector_t f) override;
 
+	using ACSDomain::update;
 	ai::State *join(ai::State *s1, ai::State *s2) override;
 	ai::State *update(Block *v, ai::State *s) override;
 	ai::State *update(const Access& a, ai::State *s) override;
+	ACS *transfer(const Access& a, ACS *s);
 
 	ACS *access(ACS *s, int b) const;
 	ACS *purge(ACS *s, int b) const;
-	ACS *accessAny(ACS *s) const;
+	ACS *accessAny(ACS *s, int k = 1) const;
+	ACS *accessAny(const Access& a, ACS *s, int k);
 
 	inline ACS *empty() const { return EMPTY; }
 
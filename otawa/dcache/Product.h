@@ -0,0 +1,77 @@
+/*
+ *	Product Domain interface
+ *
+ *	This file is part of OTAWA
+ *	Copyright (c) 2020, IRIT UPS.
+ *
+ *	OTAWA is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	OTAWA is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with OTAWA; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef OTAWA_DCACHE_PRODUCT_H_
+#define OTAWA_DCACHE_PRODUCT_H_
+
+#include "MAY.h"
+#include "MUST.h"
+#include "PERS.h"
+
+namespace otawa { namespace dcache {
+
+class ProductACS: public GCState {
+public:
+	inline ProductACS(int set, ACS *must, ACS *may, ACS *pers): GCState(set)
+		{ comp[ProductInfo::MUST_AGE] = must; comp[ProductInfo::MAY_AGE] = may; comp[ProductInfo::PERS_AGE] = pers; }
+	inline ACS *get(ProductInfo::comp_t c) const { return comp[c]; }
+	void mark(AbstractGC& gc) override;
+	inline t::size size() const override { return sizeof(ProductACS); }
+	ACS *comp[ProductInfo::COMP_CNT];
+};
+inline ProductACS *product(ai::State *s) { return static_cast<ProductACS *>(s); }
+
+class Product: public Domain {
+public:
+
+	Product(const SetCollection& coll, int set, int assoc, ListGC& gc, bool sharing = false);
+
+	ai::State *bot() override;
+	ai::State *top() override;
+	ai::State *entry() override;
+	bool equals(ai::State *s1, ai::State *s2) override;
+	ai::State *join(ai::State *s1, ai::State *s2) override;
+	ai::State *update(Block *v, ai::State *s) override;
+	ai::State *update(Edge *e, ai::State *s) override;
+
+	bool implementsPrinting() override;
+	void print(ai::State *s, io::Output& out) override;
+
+	bool implementsIO() override;
+	void save(ai::State *s, io::OutStream *out) override;
+	ai::State *load(io::InStream *in) override;
+
+	ai::State *update(const Access& a, ai::State *s) override;
+	void collect(ai::state_collector_t f) override;
+	void clean(GCState *s) override;
+
+private:
+	ProductACS *make(ProductACS *s);
+	MUST must;
+	MAY may;
+	PERS pers;
+	ListGC& gc;
+	ProductACS *BOT, *TOP, *ENTRY;
+	ACS *cur[ProductInfo::COMP_CNT];
+};
+
+} }		// otawa::dcache
+
+#endif /* OTAWA_DCACHE_PRODUCT_H_ */
@@ -0,0 +1,302 @@
+/*
+ *	SmallMUST Domain interface
+ *
+ *	This file is part of OTAWA
+ *	Copyright (c) 2020, IRIT UPS.
+ *
+ *	OTAWA is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	OTAWA is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with OTAWA; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef OTAWA_DCACHE_SMALLMUST_H_
+#define OTAWA_DCACHE_SMALLMUST_H_
+
+#include <elm/alloc/ListGC.h>
+#include "ACS.h"
+
+namespace otawa { namespace dcache {
+
+class SmallACS: public GCState {
+public:
+	typedef ACS::age_t age_t;
+	typedef struct entry_t {
+		t::int32 b;
+		age_t a;
+	} entry_t;
+	static const t::int32 NONE = -1;
+
+	static inline t::size size(int W) { return sizeof(SmallACS) + W * sizeof(entry_t); }
+	inline SmallACS(int set, int W, age_t out): GCState(set), w(W), _out(out)
+		{ for(int i = 0; i < W; i++) e[i] = { NONE, 0 }; }
+
+	inline int age(int b) const {
+		for(int i = 0; i < w; i++)
+			if(e[i].b == b)
+				return e[i].a;
+		return _out;
+	}
+	inline int out() const { return _out; }
+
+	/**
+	 * Build an ACS, in the given memory, with the ages of the current state.
+	 * @param N		Cache block count.
+	 * @param mem	Memory of ACS::size(N) bytes to build the ACS in.
+	 * @return		Built ACS.
+	 */
+	inline ACS *expand(int N, void *mem) const {
+		auto a = new(mem) ACS(set(), N, _out);
+		for(int i = 0; i < w; i++)
+			if(e[i].b != NONE)
+				a->age[e[i].b] = e[i].a;
+		return a;
+	}
+	inline void mark(AbstractGC& gc) override { gc.mark(this, size(w)); }
+	inline t::size size() const override { return size(w); }
+
+private:
+	t::uint8 w;
+	age_t _out;
+public:
+	entry_t e[];
+};
+inline SmallACS *sacs(ai::State *s) { return static_cast<SmallACS *>(s); }
+
+
+template <int W>
+class SmallMUST: public Domain {
+public:
+	typedef SmallACS::age_t age_t;
+
+	/**
+	 * Build the domain.
+	 * @param collection	Set collection.
+	 * @param set			Set to work on.
+	 * @param gc			Garbage collector to allocate the states with.
+	 */
+	SmallMUST(const SetCollection& collection, int set, ListGC& gc):
+		Domain(set), coll(collection), gc(gc), os(nullptr)
+	{
+		BOT = make(ACS::BOT);
+		TOP = make(W);
+	}
+
+	ai::State *bot() override { return BOT; }
+	ai::State *top() override { return TOP; }
+	ai::State *entry() override { return TOP; }
+	ai::State *update(Edge *e, ai::State *s) override { return s; }
+
+	bool equals(ai::State *_1, ai::State *_2) override {
+		auto s1 = sacs(_1), s2 = sacs(_2);
+		if(s1 == s2)
+			return true;
+		if(s1 == BOT || s2 == BOT)
+			return false;
+		int c1 = 0, c2 = 0;
+		for(int i = 0; i < W; i++) {
+			if(s1->e[i].b != SmallACS::NONE) {
+				c1++;
+				if(s2->age(s1->e[i].b) != s1->e[i].a)
+					return false;
+			}
+			if(s2->e[i].b != SmallACS::NONE)
+				c2++;
+		}
+		return c1 == c2;
+	}
+
+	ai::State *join(ai::State *_1, ai::State *_2) override {
+		auto s1 = sacs(_1), s2 = sacs(_2);
+		if(s1 == BOT)
+			return s2;
+		else if(s2 == BOT)
+			return s1;
+		else if(s1 == TOP || s2 == TOP)
+			return TOP;
+		os = make(W);
+		int k = 0;
+		for(int i = 0; i < W; i++)
+			if(s1->e[i].b != SmallACS::NONE) {
+				int a2 = s2->age(s1->e[i].b);
+				if(a2 < W)
+					os->e[k++] = { s1->e[i].b, age_t(max(int(s1->e[i].a), a2)) };
+			}
+		return os = top(os, k);
+	}
+
+	ai::State *update(Block *v, ai::State *s) override {
+		os = sacs(s);
+		for(auto a: SetAccesses::of(v, S))
+			os = sacs(update(*a, os));
+		return os;
+	}
+
+	ai::State *update(const Access& a, ai::State *s_) override {
+		auto s = sacs(s_);
+		if(!a.access(S) || s == BOT)
+			return s;
+		switch(a.action()) {
+
+		case LOAD:
+		case STORE:
+			switch(a.kind()) {
+			case ANY:	return accessAny(s);
+			case BLOCK:	return access(s, a.block()->id());
+			case ENUM:	return access(s, a.blockIn(S)->id());
+			case RANGE:	return accessAny(s);
+			}
+			break;
+
+		case PURGE:
+			switch(a.kind()) {
+			case ANY:	return TOP;
+			case BLOCK:	return purge(s, a.block()->id());
+			case ENUM:	return purge(s, a.blockIn(S)->id());
+			case RANGE:	return TOP;
+			}
+			break;
+
+		default:
+			break;
+		}
+		return s;
+	}
+
+	/**
+	 * Compute the effect of an access to block b: the blocks younger than b
+	 * (or all blocks if b is not in the cache) get older and b becomes the
+	 * youngest block.
+	 * @param is	Input state.
+	 * @param b		Accessed block.
+	 * @return		Output state.
+	 */
+	SmallACS *access(SmallACS *is, int b) {
+		int t = min(is->age(b), W - 1);
+		os = make(W);
+		os->e[0] = { b, 0 };
+		int k = 1;
+		for(int i = 0; i < W; i++)
+			if(is->e[i].b != SmallACS::NONE && is->e[i].b != b) {
+				int a = is->e[i].a;
+				if(a <= t)
+					a++;
+				// at most W blocks are younger than W: the test is only a guard
+				if(a < W && k < W)
+					os->e[k++] = { is->e[i].b, age_t(a) };
+			}
+		return os;
+	}
+
+	/**
+	 * Compute the effect of an access to an unknown block: all blocks
+	 * get older.
+	 * @param is	Input state.
+	 * @return		Output state.
+	 */
+	SmallACS *accessAny(SmallACS *is) {
+		os = make(W);
+		int k = 0;
+		for(int i = 0; i < W; i++)
+			if(is->e[i].b != SmallACS::NONE && is->e[i].a + 1 < W)
+				os->e[k++] = { is->e[i].b, age_t(is->e[i].a + 1) };
+		return os = top(os, k);
+	}
+
+	/**
+	 * Compute the effect of the purge of block b.
+	 * @param is	Input state.
+	 * @param b		Purged block.
+	 * @return		Output state.
+	 */
+	SmallACS *purge(SmallACS *is, int b) {
+		os = make(W);
+		int k = 0;
+		for(int i = 0; i < W; i++)
+			if(is->e[i].b != SmallACS::NONE && is->e[i].b != b)
+				os->e[k++] = is->e[i];
+		return os = top(os, k);
+	}
+
+	bool implementsPrinting() override { return true; }
+
+	// printed as the expanded ACS so that the dumps compare with MUST
+	void print(ai::State *s, io::Output& out) override {
+		if(s == TOP)
+			out << "T";
+		else if(s == BOT)
+			out << "_";
+		else {
+			out << "{ ";
+			for(int i = 0; i < coll.blockCount(S); i++) {
+				if(i != 0)
+					out << ", ";
+				out << coll.address(coll.block(S, i)) << ": " << sacs(s)->age(i);
+			}
+			out << " }";
+		}
+	}
+
+	bool implementsIO() override { return true; }
+
+	void save(ai::State *s, io::OutStream *out) override {
+		// BOT and TOP are saved as a tag to retain their identity
+		t::uint8 tag = s == BOT ? 0 : s == TOP ? 1 : 2;
+		if(out->write(reinterpret_cast<const char *>(&tag), sizeof(tag)) != sizeof(tag))
+			throw io::IOException(out->lastErrorMessage());
+		// the entries are written field by field to skip their padding
+		if(tag == 2)
+			for(int i = 0; i < W; i++) {
+				const auto& e = sacs(s)->e[i];
+				if(out->write(reinterpret_cast<const char *>(&e.b), sizeof(e.b)) != sizeof(e.b)
+				|| out->write(reinterpret_cast<const char *>(&e.a), sizeof(e.a)) != sizeof(e.a))
+					throw io::IOException(out->lastErrorMessage());
+			}
+	}
+
+	ai::State *load(io::InStream *in) override {
+		t::uint8 tag;
+		if(in->read(&tag, sizeof(tag)) != sizeof(tag))
+			throw io::IOException(in->lastErrorMessage());
+		if(tag == 0)
+			return BOT;
+		else if(tag == 1)
+			return TOP;
+		auto s = make(W);
+		for(int i = 0; i < W; i++) {
+			auto& e = s->e[i];
+			if(in->read(&e.b, sizeof(e.b)) != sizeof(e.b)
+			|| in->read(&e.a, sizeof(e.a)) != sizeof(e.a))
+				throw io::IOException(in->lastErrorMessage());
+		}
+		return s;
+	}
+
+	void collect(ai::state_collector_t f) override {
+		if(os != nullptr)
+			f(os);
+		f(BOT);
+		f(TOP);
+	}
+
+private:
+	inline SmallACS *make(int out) const
+		{ return new(gc.allocate(SmallACS::size(W))) SmallACS(S, W, out); }
+	inline SmallACS *top(SmallACS *s, int k) const { return k == 0 ? TOP : s; }
+
+	const SetCollection& coll;
+	ListGC& gc;
+	SmallACS *BOT, *TOP, *os;
+};
+
+} }		// otawa::dcache
+
+#endif /* OTAWA_DCACHE_SMALLMUST_H_ */
@@ -0,0 +1,121 @@
+/*
+ *	Solver classes interface
+ *
+ *	This file is part of OTAWA
+ *	Copyright (c) 2020, IRIT UPS.
+ *
+ *	OTAWA is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	OTAWA is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with OTAWA; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef OTAWA_DCACHE_SOLVER_H_
+#define OTAWA_DCACHE_SOLVER_H_
+
+#include <otawa/ai/CFGAnalyzer.h>
+#include <otawa/cfg/features.h>
+
+namespace otawa { namespace dcache {
+
+class SetStats;
+
+class Solver {
+public:
+	virtual ~Solver();
+	virtual void process() = 0;
+	virtual ai::State *before(Edge *e) = 0;
+	virtual ai::State *after(Edge *e) = 0;
+	virtual ai::State *before(otawa::Block *v) = 0;
+	virtual ai::State *after(otawa::Block *v) = 0;
+	virtual void use(ai::State *s) = 0;
+	virtual void release(ai::State *s) = 0;
+	virtual void collect(ai::state_collector_t f) = 0;
+};
+
+class CFGSolver: public Solver {
+public:
+	CFGSolver(Monitor& mon, ai::Domain& dom);
+	void process() override;
+	ai::State *before(Edge *e) override;
+	ai::State *after(Edge *e) override;
+	ai::State *before(otawa::Block *v) override;
+	ai::State *after(otawa::Block *v) override;
+	void use(ai::State *s) override;
+	void release(ai::State *s) override;
+	void collect(ai::state_collector_t f) override;
+private:
+	ai::CFGAnalyzer ana;
+};
+
+class WTO {
+public:
+	WTO(const CFGCollection& cfgs);
+	inline const CFGCollection& cfgs() const { return _cfgs; }
+	inline int count() const { return blocks.count(); }
+	inline int index(otawa::Block *v) const { return base[v->cfg()->index()] + v->index(); }
+	inline otawa::Block *block(int i) const { return blocks[i]; }
+	inline int length() const { return seq.length(); }
+	inline int at(int p) const { return seq[p]; }
+	inline int endOf(int p) const { return ends[p]; }
+	inline bool isHead(int p) const { return ends[p] >= 0; }
+	inline int predCount(int i) const { return pfirst[i + 1] - pfirst[i]; }
+	inline int pred(int i, int j) const { return preds[pfirst[i] + j]; }
+	inline int firstEdge(int i) const { return efirst[i]; }
+	inline int edgeCount() const { return efirst[count()]; }
+	int edgeIndex(Edge *e) const;
+	inline int componentCount() const { return comp_cnt; }
+private:
+	class Builder;
+	const CFGCollection& _cfgs;
+	AllocArray<int> base;
+	AllocArray<otawa::Block *> blocks;
+	AllocArray<int> pfirst, efirst;
+	Vector<int> preds;
+	Vector<int> seq, ends;
+	int comp_cnt;
+};
+
+class WTOSolver: public Solver {
+public:
+	WTOSolver(const WTO& wto, ai::Domain& dom, SetStats *stats = nullptr, int skip_set = -1);
+	~WTOSolver();
+	void process() override;
+	ai::State *before(Edge *e) override;
+	ai::State *after(Edge *e) override;
+	ai::State *before(otawa::Block *v) override;
+	ai::State *after(otawa::Block *v) override;
+	void use(ai::State *s) override;
+	void release(ai::State *s) override;
+	void collect(ai::state_collector_t f) override;
+private:
+	void run(int f, int l);
+	void stabilize(int p);
+	bool eval(int v);
+	ai::State *input(int v);
+	ai::State *give(ai::State *s);
+	void compact();
+
+	const WTO& wto;
+	ai::Domain& dom;
+	SetStats *st;
+	int skip_set;
+	AllocArray<ai::State *> ins, outs, calls, eouts;
+	AllocArray<t::uint32> changes, evals;
+	t::uint32 clock;
+	ai::State *tmp;
+	Vector<ai::State *> used;
+	int live;
+};
+
+} }		// otawa::dcache
+
+#endif /* OTAWA_DCACHE_SOLVER_H_ */
@@ -0,0 +1,110 @@
+/*
+ *	Store class interface
+ *
+ *	This file is part of OTAWA
+ *	Copyright (c) 2020, IRIT UPS.
+ *
+ *	OTAWA is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	OTAWA is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with OTAWA; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef OTAWA_DCACHE_STORE_H_
+#define OTAWA_DCACHE_STORE_H_
+
+#include <mutex>
+#include <elm/io/BlockOutStream.h>
+#include <elm/sys/Path.h>
+#include <otawa/ai/CFGAnalyzer.h>
+#include <otawa/cfg/features.h>
+
+#include "features.h"
+
+namespace otawa { namespace dcache {
+
+class Domain;
+class Solver;
+
+class Store {
+public:
+	Store(const CFGCollection& cfgs, const AllocArray<Domain *>& doms);
+	~Store();
+
+	static t::uint64 key(const string& name, const CFGCollection& cfgs, const SetCollection& coll, t::uint64 config = 0);
+	void computeKeys(const string& name, const SetCollection& coll, t::uint64 config = 0);
+	bool open(const sys::Path& path, t::uint64 key);
+	int reuse(const sys::Path& path);
+	int merge(const sys::Path& path, t::uint64 key);
+	void record(int set, Solver& ana);
+	void save(const sys::Path& path, t::uint64 key);
+
+	inline bool isOpen() const { return full; }
+	inline bool isLoaded(int set) const { return src[set] >= 0; }
+	ai::State *before(otawa::Block *v, int set);
+	ai::State *after(otawa::Block *v, int set);
+	ai::State *after(Edge *e, int set);
+	void collect(int set, ai::state_collector_t f);
+
+private:
+	typedef enum tag_t: t::uint8 {
+		BOT = 0,
+		TOP = 1,
+		ENTRY = 2,
+		STATE = 3,
+		REF = 4
+	} tag_t;
+
+	typedef struct header_t {
+		char magic[4];
+		t::uint32 version;
+		t::uint64 key;
+		t::uint64 shape;
+		t::uint32 sets;
+		t::uint32 slots;
+	} header_t;
+
+	int slot(otawa::Block *v) const;
+	int slot(Edge *e) const;
+	ai::State *get(int set, int slot);
+	void load(int set);
+	int map_file(const sys::Path& path);
+	void unmap();
+	void drop();
+	inline const char *map(int set) const { return maps[src[set]].base; }
+	inline t::uint64 offset(int set) const { return offsets(map(set))[set]; }
+	inline t::uint64 length(int set) const { return offsets(map(set))[set + 1] - offset(set); }
+	static inline const header_t *header(const char *m) { return reinterpret_cast<const header_t *>(m); }
+	static inline const t::uint64 *offsets(const char *m) { return reinterpret_cast<const t::uint64 *>(m + sizeof(header_t)); }
+	inline const t::uint64 *keys(const char *m) const { return offsets(m) + states.count() + 1; }
+
+	typedef struct mapping_t {
+		const char *base;
+		t::size size;
+	} mapping_t;
+
+	const CFGCollection& cfgs;
+	const AllocArray<Domain *>& doms;
+	AllocArray<int> base, first;
+	int slots;
+	AllocArray<ai::State **> states;
+	AllocArray<io::BlockOutStream *> outs;
+	Vector<mapping_t> maps;
+	bool full;
+	AllocArray<int> src;
+	t::uint64 shape;
+	AllocArray<t::uint64> skeys;
+	std::mutex mutex;
+};
+
+} }		// otawa::dcache
+
+#endif /* OTAWA_DCACHE_STORE_H_ */
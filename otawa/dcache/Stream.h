@@ -0,0 +1,115 @@
+/*
+ *	StreamMemo class interface
+ *
+ *	This file is part of OTAWA
+ *	Copyright (c) 2020, IRIT UPS.
+ *
+ *	OTAWA is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	OTAWA is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with OTAWA; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef OTAWA_DCACHE_STREAM_H_
+#define OTAWA_DCACHE_STREAM_H_
+
+#include <tuple>
+#include <unordered_map>
+#include "features.h"
+
+namespace otawa { namespace dcache {
+
+/**
+ * Memory of the classifications of the cache blocks computed in streaming
+ * mode (see @ref STREAM): the classifications are computed set group by set
+ * group, recorded in this memory, and then replayed when the categories
+ * or the events are built.
+ * @param T		Type of classification.
+ * @ingroup dcache
+ */
+template <class T>
+class StreamMemo {
+public:
+
+	/**
+	 * Record a classification.
+	 * @param e		Edge the classification is computed along.
+	 * @param a		Classified access.
+	 * @param cb	Classified cache block.
+	 * @param r		Classification.
+	 * @param tag	Tag to distinguish classifications of a same access
+	 * 				along a same edge (optional).
+	 */
+	inline void put(Edge *e, const Access& a, const CacheBlock *cb, const T& r, int tag = 0)
+		{ map[key_t(e, &a, cb, tag)] = r; }
+
+	/**
+	 * Get a recorded classification.
+	 * @param e		Edge the classification is computed along.
+	 * @param a		Classified access.
+	 * @param cb	Classified cache block.
+	 * @param tag	Tag of the classification (optional).
+	 * @return		Recorded classification.
+	 */
+	inline const T& get(Edge *e, const Access& a, const CacheBlock *cb, int tag = 0) const {
+		auto i = map.find(key_t(e, &a, cb, tag));
+		ASSERTP(i != map.end(), "no classification recorded for " << a);
+		return i->second;
+	}
+
+	/**
+	 * Add the classifications recorded in another memory, typically the
+	 * memory of a thread. Both memories are expected to record different
+	 * classifications so that the result does not depend on the merge order.
+	 * @param m		Merged memory.
+	 */
+	inline void merge(const StreamMemo<T>& m)
+		{ map.insert(m.map.begin(), m.map.end()); }
+
+	/**
+	 * Remove all recorded classifications.
+	 */
+	inline void clear() { map.clear(); }
+
+	/**
+	 * Get the number of recorded classifications.
+	 * @return	Number of classifications.
+	 */
+	inline int count() const { return map.size(); }
+
+	/**
+	 * Test if the sets of the given block intersects the given set range.
+	 * @param b		Tested block.
+	 * @param f		First set.
+	 * @param l		Set after the last one.
+	 * @return		True if one access of b touches a set in [f, l[.
+	 */
+	static bool touches(Block *b, int f, int l) {
+		auto sa = SET_ACCESSES(b);
+		return sa != nullptr && sa->touches(f, l);
+	}
+
+private:
+	typedef std::tuple<Edge *, const Access *, const CacheBlock *, int> key_t;
+	struct hash_t {
+		inline size_t operator()(const key_t& k) const {
+			size_t h = std::hash<const void *>()(std::get<0>(k));
+			h = h * 31 + std::hash<const void *>()(std::get<1>(k));
+			h = h * 31 + std::hash<const void *>()(std::get<2>(k));
+			return h * 31 + std::get<3>(k);
+		}
+	};
+	std::unordered_map<key_t, T, hash_t> map;
+};
+
+} }		// otawa::dcache
+
+#endif /* OTAWA_DCACHE_STREAM_H_ */
@@ -21,11 +21,15 @@
 #ifndef OTAWA_DCACHE_FEATURES_H_
 #define OTAWA_DCACHE_FEATURES_H_
 
+#include <functional>
+#include <elm/data/Array.h>
 #include <elm/data/Slice.h>
+#include <elm/data/Vector.h>
+#include <elm/util/BitVector.h>
 #include <otawa/cache/features.h>
-#include <otawa/prop/PropList.h>
 #include <otawa/dfa/BitSet.h>
 #include <otawa/hard/Cache.h>
+#include <otawa/prop/PropList.h>
 #include <otawa/util/Bag.h>
 #include <otawa/ai/CFGAnalyzer.h>
 
@@ -43,7 +47,9 @@ typedef enum action_t: t::uint8 {
 	STORE = 2,
 	PURGE = 3,
 	DIRECT_LOAD = 4,
-	DIRECT_STORE = 5
+	DIRECT_STORE = 5,
+	HIT_LOAD = 6,
+	HIT_STORE = 7
 } action_t;
 
 typedef enum kind_t: t::uint8 {
@@ -63,6 +69,7 @@ public:
 	inline int id() const { return _id; }
 	inline const hard::Bank *bank() const { return _bank; }
 private:
+	friend class BlockCollection;
 	int _tag, _set, _id;
 	const hard::Bank *_bank;
 };
@@ -70,7 +77,8 @@ io::Output& operator<<(io::Output& out, const CacheBlock& b);
 
 
 // Access
-class Access: public PropList {
+class SetCollection;
+class Access {
 public:
 	
 	Access();
@@ -81,53 +89,56 @@ public:
 	Access(Inst *instruction, action_t action, int fst, int lst,
 		sem::type_t type = sem::NO_TYPE, int index = -1);
 	Access(Inst *instruction, action_t action,
-		const Vector<const CacheBlock *>& blocks,
+		SetCollection& coll, Address base, int stride, int count,
 		sem::type_t type = sem::NO_TYPE, int index = -1);
-	Access(const Access& b);
-	~Access();
-	Access& operator=(const Access& a);
 
 	inline Inst *inst() const { return _inst; }
 	inline kind_t kind() const { return _kind; }
 	inline bool isAny() const { return _kind == ANY; }
+	inline bool isHit() const { return _action == HIT_LOAD || _action == HIT_STORE; }
 	inline action_t action() const { return _action; }
 	inline const CacheBlock *block() const { ASSERT(_kind == BLOCK); return data.blk; }
 	inline int first() const
-		{ ASSERT(_kind == RANGE || _kind == ENUM); return data.range->fst; }
+		{ ASSERT(_kind == RANGE || _kind == ENUM); return _fst; }
 	inline int last() const
-		{ ASSERT(_kind == RANGE || _kind == ENUM); return data.range->lst; }
-	bool access(int set) const;
+		{ ASSERT(_kind == RANGE || _kind == ENUM); return _lst; }
+	inline bool access(int set) const {
+		switch(_kind) {
+		case ANY:	return true;
+		case ENUM:	return offsetOf(set) >= 0;
+		default:	return _fst <= _lst ? _fst <= set && set <= _lst : _fst <= set || set <= _lst;
+		}
+	}
 	bool access(const CacheBlock *block) const;
 	sem::type_t type() const { return sem::type_t(_type); }
 	int index() const { return _index; }
+	inline int id() const { return _id; }
+	inline void setID(int id) { _id = id; }
 	
 	void print(io::Output& out) const;
 
-	inline const Vector<const CacheBlock *>& blocks(void) const
-		{ ASSERT(_kind == ENUM); return data.enm->bs; }
+	inline Address base() const { ASSERT(_kind == ENUM); return _base; }
+	inline int stride() const { ASSERT(_kind == ENUM); return _stride; }
+	inline int blockCount() const { ASSERT(_kind == ENUM); return _cnt; }
+	const CacheBlock *blockAt(int i) const;
 	const CacheBlock *blockIn(int set) const;
 
 private:
-	void clear();
-	void set(const Access& a);
+	int offsetOf(int set) const;
 
 	Inst *_inst;
+	union {
+		const CacheBlock *blk;
+		SetCollection *coll;
+	} data;
+	Address _base;
+	t::uint16 _fst, _lst;
+	t::uint16 _stride, _cnt;
 	kind_t _kind;
 	action_t _action;
 	t::uint8 _type;
 	t::uint8 _index;
-
-	typedef struct range_t {
-		int fst, lst;
-	} range_t;
-	typedef struct enum_t: range_t {
-		Vector<const CacheBlock *> bs;		
-	} enum_t;
-	union {
-		const CacheBlock *blk;
-		range_t *range;
-		enum_t *enm;
-	} data;
+	t::int32 _id;
 };
 inline io::Output& operator<<(io::Output& out, const Access& acc)
 	{ acc.print(out); return out; }
@@ -145,12 +156,19 @@ public:
 	int blockCount(int set) const;
 	const CacheBlock *block(int set, int id) const;
 	Address address(const CacheBlock *block) const;
+	void freeze();
+	inline bool isFrozen() const { return _frozen; }
+	void renumber();
+	inline int accessCount() const { return _acc_cnt; }
+	inline void setAccessCount(int count) { _acc_cnt = count; }
 	
 	inline const hard::Cache& cache() const { return _cache; }
 private:
 	const hard::Cache& _cache;
 	const hard::Memory& _mem;
 	BlockCollection **_sets;
+	bool _frozen;
+	int _acc_cnt;
 };
 
 int actualAssoc(const hard::Cache& cache);
@@ -158,16 +176,99 @@ int actualAssoc(const hard::Cache& cache);
 
 typedef Slice<FragTable<Access> > AccessList;
 extern p::id<AccessList> ACCESSES;
+
+class SetAccesses {
+public:
+
+	class Accesses {
+	public:
+		class Iter {
+		public:
+			inline Iter(const Accesses& as, int i, int j): _as(as), _i(i), _j(j) { skip(); }
+			inline const Access *operator*() const { return &(*_as._accs)[isWide() ? _as._widx[_j] : _as._idx[_i]]; }
+			inline Iter& operator++() { if(isWide()) { _j++; skip(); } else _i++; return *this; }
+			inline bool operator!=(const Iter& it) const { return _i != it._i || _j != it._j; }
+		private:
+			inline bool isWide() const
+				{ return _j < _as._m && (_i >= _as._n || _as._widx[_j] < _as._idx[_i]); }
+			inline void skip()
+				{ while(_j < _as._m && !(*_as._accs)[_as._widx[_j]].access(_as._set)) _j++; }
+			const Accesses& _as;
+			int _i, _j;
+		};
+
+		inline Accesses(): _accs(nullptr), _set(-1), _idx(nullptr), _n(0), _widx(nullptr), _m(0), _cnt(0) { }
+		Accesses(const AccessList& accs, int set, const int *idx, int n, const int *widx, int m);
+		inline int count() const { return _cnt; }
+		inline Iter begin() const { return Iter(*this, 0, 0); }
+		inline Iter end() const { return Iter(*this, _n, _m); }
+	private:
+		const AccessList *_accs;
+		int _set;
+		const int *_idx;
+		int _n;
+		const int *_widx;
+		int _m, _cnt;
+	};
+
+	SetAccesses(const AccessList& accesses, int set_count);
+	~SetAccesses();
+	inline int count() const { return _n; }
+	inline int set(int i) const { return _sets[i]; }
+	inline int wideCount() const { return _m; }
+	inline const Access& wide(int i) const { return _accs[_widx[i]]; }
+	int find(int set) const;
+	bool touches(int set) const;
+	bool touches(int f, int l) const;
+	Accesses accesses(int set) const;
+	static Accesses of(otawa::Block *v, int set);
+private:
+	AccessList _accs;
+	int _n, _m;
+	int *_sets, *_offs, *_idx, *_widx;
+};
+extern p::id<SetAccesses *> SET_ACCESSES;
 extern p::interfaced_feature<const SetCollection> ACCESS_FEATURE;
 extern p::interfaced_feature<const SetCollection> CLP_ACCESS_FEATURE;
+extern p::id<bool> COALESCE;
+
+
+// function footprints
+class Footprint {
+public:
+	Footprint(int set_count);
+	inline bool touches(int set) const { return _any || _sets.bit(set); }
+	inline bool accessesAny() const { return _any; }
+	inline const BitVector& sets() const { return _sets; }
+	inline void add(int set) { _sets.set(set); }
+	inline void setAny() { _any = true; }
+	bool add(const Footprint& f);
+private:
+	BitVector _sets;
+	bool _any;
+};
+extern p::id<Footprint *> FOOTPRINT;
+extern p::feature FOOTPRINT_FEATURE;
 
 
 // Age information
 class ACS;
 class AgeInfo {
 public:
+	class Cursor {
+	public:
+		virtual ~Cursor();
+		virtual int age(const CacheBlock *b) = 0;
+		virtual void next() = 0;
+	};
+	typedef std::function<void(const Access& a, const CacheBlock *b, int age)> age_fun_t;
+
 	virtual ~AgeInfo();
 	virtual int wayCount() = 0;
+	virtual Cursor *cursor(otawa::Block *v) = 0;
+	virtual Cursor *cursor(Edge *e) = 0;
+	void ages(otawa::Block *v, age_fun_t f);
+	void ages(Edge *e, age_fun_t f);
 	virtual int age(otawa::Block *v, const Access& a, const CacheBlock *b) = 0;
 	virtual int age(Edge *e, const Access& a, const CacheBlock *b) = 0;
 	virtual ACS *acsAfter(Block *b, int S) = 0;
@@ -175,18 +276,55 @@ public:
 	virtual ACS *acsBefore(Block *b, int S) = 0;
 	virtual ACS *acsAfter(Edge *e, int S) = 0;
 	virtual void release(ACS *a) = 0;
+	virtual void drop(int set);
+	static inline int ageFor(int age, int ways) { return age < ways ? age : ways; }
 };
 extern p::interfaced_feature<AgeInfo> MUST_FEATURE;
+extern p::id<bool> SMALL_MUST;
 extern p::interfaced_feature<AgeInfo> MAY_FEATURE;
 extern p::interfaced_feature<AgeInfo> PERS_FEATURE;
 
 
+// product of MUST, MAY and PERS
+class ProductInfo {
+public:
+	typedef enum comp_t {
+		MUST_AGE = 0,
+		MAY_AGE = 1,
+		PERS_AGE = 2,
+		COMP_CNT = 3
+	} comp_t;
+
+	class Cursor {
+	public:
+		virtual ~Cursor();
+		virtual AgeInfo::Cursor *view(comp_t c) = 0;
+		virtual void next() = 0;
+	};
+
+	virtual ~ProductInfo();
+	virtual Cursor *cursor(otawa::Block *v) = 0;
+	virtual Cursor *cursor(Edge *e) = 0;
+	virtual void drop(int set);
+};
+extern p::interfaced_feature<ProductInfo> PRODUCT_FEATURE;
+
+
 // MultiAgeInfo information
 class MultiACS;
 class MultiAgeInfo {
 public:
+	class Cursor {
+	public:
+		virtual ~Cursor();
+		virtual int level(const CacheBlock *b) = 0;
+		virtual void next() = 0;
+	};
+
 	virtual ~MultiAgeInfo();
 	virtual int wayCount() = 0;
+	virtual Cursor *cursor(otawa::Block *v) = 0;
+	virtual Cursor *cursor(Edge *e) = 0;
 	virtual int level(Block *b, const Access& a, const CacheBlock *cb) = 0;
 	virtual int level(Edge *e, const Access& a, const CacheBlock *cb) = 0;
 	virtual MultiACS *acsAfter(Block *b,int s) = 0;
@@ -194,6 +332,7 @@ public:
 	virtual MultiACS *acsBefore(Block *b, int s) = 0;
 	virtual MultiACS *acsAfter(Edge *e, int s) = 0;
 	virtual void release(MultiACS *a) = 0;
+	virtual void drop(int set);
 };
 
 extern p::interfaced_feature<MultiAgeInfo> MULTI_PERS_FEATURE;
@@ -210,13 +349,38 @@ typedef enum {
 } category_t;
 io::Output& operator<<(io::Output& out, category_t c);
 
-extern p::id<category_t> CATEGORY;
-extern p::id<Block *> RELATIVE_TO;
-extern p::feature CATEGORY_FEATURE;
+class Categories {
+public:
+	Categories(int count, const Vector<int>& ways);
+	inline int layerCount() const { return ways.count(); }
+	inline int wayCount(int l = 0) const { return ways[l]; }
+	inline category_t category(const Access& a, int l = 0) const
+		{ return category_t(cats[index(a, l)]); }
+	inline Block *relativeTo(const Access& a, int l = 0) const
+		{ return rels[index(a, l)]; }
+	inline void set(const Access& a, category_t c, Block *h = nullptr, int l = 0)
+		{ int i = index(a, l); cats[i] = c; rels[i] = h; }
+private:
+	inline int index(const Access& a, int l) const
+		{ ASSERT(a.id() >= 0); ASSERT(0 <= l && l < ways.count()); return l * count + a.id(); }
+	int count;
+	Vector<int> ways;
+	AllocArray<t::uint8> cats;
+	AllocArray<Block *> rels;
+};
+extern p::interfaced_feature<const Categories> CATEGORY_FEATURE;
+
+
+// streaming
+extern p::id<int> STREAM;
+
+// design-space exploration
+extern p::id<int> ASSOCIATIVITY;
 
 
 // events
 extern p::feature EVENTS_FEATURE;
+extern p::id<bool> AGGREGATE_EVENTS;
 extern p::feature PREFIX_EVENTS_FEATURE;
 
 } }		// otawa::dcache
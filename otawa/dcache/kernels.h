@@ -0,0 +1,307 @@
+/*
+ *	ACS kernels
+ *
+ *	This file is part of OTAWA
+ *	Copyright (c) 2020, IRIT UPS.
+ *
+ *	OTAWA is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	OTAWA is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with OTAWA; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef OTAWA_DCACHE_KERNELS_H_
+#define OTAWA_DCACHE_KERNELS_H_
+
+#include <cstring>
+#include <elm/int.h>
+
+#if defined(__AVX2__)
+#	include <immintrin.h>
+#	define OTAWA_DCACHE_AVX2
+#elif defined(__SSE2__)
+#	include <emmintrin.h>
+#	define OTAWA_DCACHE_SSE2
+#elif defined(__ARM_NEON)
+#	include <arm_neon.h>
+#	define OTAWA_DCACHE_NEON
+#endif
+
+namespace otawa { namespace dcache { namespace kernel {
+
+// Kernels working on age vectors. The vectors are padded up to a multiple of
+// WIDTH with BOT ages that are left unchanged by all kernels: the kernels
+// work on the padded length and hide the padding in their result.
+
+typedef t::uint8 age_t;
+const age_t BOT = 255;
+const int WIDTH = 32;
+
+inline int padded(int n) { return (n + WIDTH - 1) & ~(WIDTH - 1); }
+
+
+// d[i] = s[i] + 1 if s[i] <= t, s[i] else
+inline void age(age_t *d, const age_t *s, int n, age_t t) {
+	int p = padded(n);
+#	if defined(OTAWA_DCACHE_AVX2)
+		auto vt = _mm256_set1_epi8(char(t));
+		for(int i = 0; i < p; i += 32) {
+			auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+			auto m = _mm256_cmpeq_epi8(_mm256_min_epu8(x, vt), x);
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(d + i), _mm256_sub_epi8(x, m));
+		}
+#	elif defined(OTAWA_DCACHE_SSE2)
+		auto vt = _mm_set1_epi8(char(t));
+		for(int i = 0; i < p; i += 16) {
+			auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+			auto m = _mm_cmpeq_epi8(_mm_min_epu8(x, vt), x);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(d + i), _mm_sub_epi8(x, m));
+		}
+#	elif defined(OTAWA_DCACHE_NEON)
+		auto vt = vdupq_n_u8(t);
+		for(int i = 0; i < p; i += 16) {
+			auto x = vld1q_u8(s + i);
+			vst1q_u8(d + i, vsubq_u8(x, vcleq_u8(x, vt)));
+		}
+#	else
+		for(int i = 0; i < p; i++)
+			d[i] = s[i] <= t ? s[i] + 1 : s[i];
+#	endif
+}
+
+
+// d[i] = BOT if s[i] = BOT, min(s[i] + k, a) else
+inline void ageAll(age_t *d, const age_t *s, int n, age_t a, age_t k = 1) {
+	int p = padded(n);
+#	if defined(OTAWA_DCACHE_AVX2)
+		auto va = _mm256_set1_epi8(char(a)), vk = _mm256_set1_epi8(char(k)), bot = _mm256_set1_epi8(char(BOT));
+		for(int i = 0; i < p; i += 32) {
+			auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+			auto y = _mm256_min_epu8(_mm256_adds_epu8(x, vk), va);
+			auto m = _mm256_cmpeq_epi8(x, bot);
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(d + i), _mm256_max_epu8(y, m));
+		}
+#	elif defined(OTAWA_DCACHE_SSE2)
+		auto va = _mm_set1_epi8(char(a)), vk = _mm_set1_epi8(char(k)), bot = _mm_set1_epi8(char(BOT));
+		for(int i = 0; i < p; i += 16) {
+			auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+			auto y = _mm_min_epu8(_mm_adds_epu8(x, vk), va);
+			auto m = _mm_cmpeq_epi8(x, bot);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(d + i), _mm_max_epu8(y, m));
+		}
+#	elif defined(OTAWA_DCACHE_NEON)
+		auto va = vdupq_n_u8(a), vk = vdupq_n_u8(k), bot = vdupq_n_u8(BOT);
+		for(int i = 0; i < p; i += 16) {
+			auto x = vld1q_u8(s + i);
+			auto y = vminq_u8(vqaddq_u8(x, vk), va);
+			vst1q_u8(d + i, vmaxq_u8(y, vceqq_u8(x, bot)));
+		}
+#	else
+		for(int i = 0; i < p; i++)
+			d[i] = s[i] == BOT ? BOT : (s[i] + k < a ? s[i] + k : a);
+#	endif
+}
+
+
+// d[i] = max(s1[i], s2[i])
+inline void max(age_t *d, const age_t *s1, const age_t *s2, int n) {
+	int p = padded(n);
+#	if defined(OTAWA_DCACHE_AVX2)
+		for(int i = 0; i < p; i += 32)
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(d + i), _mm256_max_epu8(
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s1 + i)),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s2 + i))));
+#	elif defined(OTAWA_DCACHE_SSE2)
+		for(int i = 0; i < p; i += 16)
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(d + i), _mm_max_epu8(
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(s1 + i)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(s2 + i))));
+#	elif defined(OTAWA_DCACHE_NEON)
+		for(int i = 0; i < p; i += 16)
+			vst1q_u8(d + i, vmaxq_u8(vld1q_u8(s1 + i), vld1q_u8(s2 + i)));
+#	else
+		for(int i = 0; i < p; i++)
+			d[i] = s1[i] > s2[i] ? s1[i] : s2[i];
+#	endif
+}
+
+
+// d[i] = min(s1[i], s2[i])
+inline void min(age_t *d, const age_t *s1, const age_t *s2, int n) {
+	int p = padded(n);
+#	if defined(OTAWA_DCACHE_AVX2)
+		for(int i = 0; i < p; i += 32)
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(d + i), _mm256_min_epu8(
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s1 + i)),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s2 + i))));
+#	elif defined(OTAWA_DCACHE_SSE2)
+		for(int i = 0; i < p; i += 16)
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(d + i), _mm_min_epu8(
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(s1 + i)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(s2 + i))));
+#	elif defined(OTAWA_DCACHE_NEON)
+		for(int i = 0; i < p; i += 16)
+			vst1q_u8(d + i, vminq_u8(vld1q_u8(s1 + i), vld1q_u8(s2 + i)));
+#	else
+		for(int i = 0; i < p; i++)
+			d[i] = s1[i] < s2[i] ? s1[i] : s2[i];
+#	endif
+}
+
+
+// d[i] = max(s1[i], s2[i]) where BOT is the lowest age
+// (computed as max(s1[i] + 1, s2[i] + 1) - 1 with wrapping arithmetic)
+inline void maxBot(age_t *d, const age_t *s1, const age_t *s2, int n) {
+	int p = padded(n);
+#	if defined(OTAWA_DCACHE_AVX2)
+		auto one = _mm256_set1_epi8(1);
+		for(int i = 0; i < p; i += 32) {
+			auto x = _mm256_add_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s1 + i)), one);
+			auto y = _mm256_add_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s2 + i)), one);
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(d + i), _mm256_sub_epi8(_mm256_max_epu8(x, y), one));
+		}
+#	elif defined(OTAWA_DCACHE_SSE2)
+		auto one = _mm_set1_epi8(1);
+		for(int i = 0; i < p; i += 16) {
+			auto x = _mm_add_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s1 + i)), one);
+			auto y = _mm_add_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s2 + i)), one);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(d + i), _mm_sub_epi8(_mm_max_epu8(x, y), one));
+		}
+#	elif defined(OTAWA_DCACHE_NEON)
+		auto one = vdupq_n_u8(1);
+		for(int i = 0; i < p; i += 16) {
+			auto x = vaddq_u8(vld1q_u8(s1 + i), one), y = vaddq_u8(vld1q_u8(s2 + i), one);
+			vst1q_u8(d + i, vsubq_u8(vmaxq_u8(x, y), one));
+		}
+#	else
+		for(int i = 0; i < p; i++)
+			if(s1[i] == BOT)
+				d[i] = s2[i];
+			else if(s2[i] == BOT)
+				d[i] = s1[i];
+			else
+				d[i] = s1[i] > s2[i] ? s1[i] : s2[i];
+#	endif
+}
+
+
+// test if s1 and s2 are equal
+inline bool equals(const age_t *s1, const age_t *s2, int n) {
+	int p = padded(n);
+#	if defined(OTAWA_DCACHE_AVX2)
+		for(int i = 0; i < p; i += 32) {
+			auto m = _mm256_cmpeq_epi8(
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s1 + i)),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s2 + i)));
+			if(_mm256_movemask_epi8(m) != -1)
+				return false;
+		}
+		return true;
+#	elif defined(OTAWA_DCACHE_SSE2)
+		for(int i = 0; i < p; i += 16) {
+			auto m = _mm_cmpeq_epi8(
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(s1 + i)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i *>(s2 + i)));
+			if(_mm_movemask_epi8(m) != 0xffff)
+				return false;
+		}
+		return true;
+#	elif defined(OTAWA_DCACHE_NEON)
+		for(int i = 0; i < p; i += 16) {
+			auto m = vreinterpretq_u64_u8(vceqq_u8(vld1q_u8(s1 + i), vld1q_u8(s2 + i)));
+			if((vgetq_lane_u64(m, 0) & vgetq_lane_u64(m, 1)) != ~t::uint64(0))
+				return false;
+		}
+		return true;
+#	else
+		for(int i = 0; i < n; i++)
+			if(s1[i] != s2[i])
+				return false;
+		return true;
+#	endif
+}
+
+
+// sum of the n first ages of s
+inline int sum(const age_t *s, int n) {
+	int p = padded(n);
+#	if defined(OTAWA_DCACHE_AVX2)
+		auto z = _mm256_setzero_si256(), a = z;
+		for(int i = 0; i < p; i += 32)
+			a = _mm256_add_epi64(a, _mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i)), z));
+		t::int64 r = _mm256_extract_epi64(a, 0) + _mm256_extract_epi64(a, 1)
+			+ _mm256_extract_epi64(a, 2) + _mm256_extract_epi64(a, 3);
+#	elif defined(OTAWA_DCACHE_SSE2)
+		auto z = _mm_setzero_si128(), a = z;
+		for(int i = 0; i < p; i += 16)
+			a = _mm_add_epi64(a, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i)), z));
+		t::int64 r = _mm_cvtsi128_si32(a) + _mm_cvtsi128_si32(_mm_srli_si128(a, 8));
+#	elif defined(OTAWA_DCACHE_NEON)
+		auto a = vdupq_n_u64(0);
+		for(int i = 0; i < p; i += 16)
+			a = vaddq_u64(a, vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vld1q_u8(s + i)))));
+		t::int64 r = vgetq_lane_u64(a, 0) + vgetq_lane_u64(a, 1);
+#	else
+		t::int64 r = 0;
+		for(int i = 0; i < p; i++)
+			r += s[i];
+#	endif
+	return int(r - (p - n) * BOT);
+}
+
+
+// count of the n first ages of s that are less than a
+inline int countBelow(const age_t *s, int n, age_t a) {
+	int p = padded(n), r = 0;
+	if(a == 0)
+		return 0;
+#	if defined(OTAWA_DCACHE_AVX2)
+		auto vt = _mm256_set1_epi8(char(a - 1));
+		for(int i = 0; i < p; i += 32) {
+			auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+			r += __builtin_popcount(t::uint32(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(x, vt), x))));
+		}
+#	elif defined(OTAWA_DCACHE_SSE2)
+		auto vt = _mm_set1_epi8(char(a - 1));
+		for(int i = 0; i < p; i += 16) {
+			auto x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+			r += __builtin_popcount(t::uint32(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(x, vt), x))));
+		}
+#	elif defined(OTAWA_DCACHE_NEON)
+		auto va = vdupq_n_u8(a);
+		auto c = vdupq_n_u64(0);
+		for(int i = 0; i < p; i += 16)
+			c = vaddq_u64(c, vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vshrq_n_u8(vcltq_u8(vld1q_u8(s + i), va), 7)))));
+		r = int(vgetq_lane_u64(c, 0) + vgetq_lane_u64(c, 1));
+#	else
+		for(int i = 0; i < p; i++)
+			if(s[i] < a)
+				r++;
+#	endif
+	return r;
+}
+
+// hash of the n first ages of s
+inline t::uint32 hash(const age_t *s, int n) {
+	int p = padded(n);
+	t::uint64 h = 0xcbf29ce484222325ULL;
+	for(int i = 0; i < p; i += sizeof(t::uint64)) {
+		t::uint64 w;
+		std::memcpy(&w, s + i, sizeof(w));
+		h = (h ^ w) * 0x100000001b3ULL;
+		h ^= h >> 29;
+	}
+	return t::uint32(h ^ (h >> 32));
+}
+
+} } }	// otawa::dcache::kernel
+
+#endif /* OTAWA_DCACHE_KERNELS_H_ */
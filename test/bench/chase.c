@@ -0,0 +1,66 @@
+/*
+ * Pointer-chasing code: walk of a linked list and search in a binary tree
+ * stored in static arrays.
+ */
+
+#define L	1024
+#define T	511
+
+struct node {
+	struct node *next;
+	int val;
+};
+
+struct tree {
+	struct tree *left, *right;
+	int key;
+};
+
+struct node nodes[L];
+struct tree trees[T];
+
+void _exit(int c) {
+	for(;;);
+}
+
+static void build(void) {
+	int i;
+	for(i = 0; i < L - 1; i++) {
+		nodes[i].next = &nodes[(i * 37 + 1) % L];
+		nodes[i].val = i;
+	}
+	nodes[L - 1].next = 0;
+	for(i = 0; i < T; i++) {
+		trees[i].left = 2 * i + 1 < T ? &trees[2 * i + 1] : 0;
+		trees[i].right = 2 * i + 2 < T ? &trees[2 * i + 2] : 0;
+		trees[i].key = i;
+	}
+}
+
+static int walk(struct node *p) {
+	int s = 0, i;
+	for(i = 0; p != 0 && i < L; i++) {
+		s += p->val;
+		p = p->next;
+	}
+	return s;
+}
+
+static int search(struct tree *t, int k) {
+	int i;
+	for(i = 0; t != 0 && i < 9; i++) {
+		if(t->key == k)
+			return 1;
+		t = k & (1 << i) ? t->right : t->left;
+	}
+	return 0;
+}
+
+int main(void) {
+	int s, i;
+	build();
+	s = walk(&nodes[0]);
+	for(i = 0; i < 64; i++)
+		s += search(&trees[0], i * 7);
+	return s;
+}
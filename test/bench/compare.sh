@@ -0,0 +1,33 @@
+#!/bin/sh
+# Compare two benchmark reports produced by run.sh.
+#
+# usage: compare.sh OLD NEW
+#
+# For each run found in both reports, prints the wall time and the peak RSS
+# of the old and new report and their ratio (new / old).
+
+if [ $# -ne 2 ]; then
+	echo "usage: $0 OLD NEW" >&2
+	exit 1
+fi
+
+extract() {
+	sed -n 's/.*"program": "\([^"]*\)", "cache": "\([^"]*\)", "case": "\([^"]*\)".*"time": \([^,]*\), "self_time": [^,]*, "rss": \([^ ]*\) }.*/\1\/\2\/\3 \4 \5/p' "$1"
+}
+
+extract "$1" > "$1.tmp"
+extract "$2" | awk -v old="$1.tmp" '
+	BEGIN {
+		while((getline l < old) > 0) {
+			split(l, f, " ")
+			ot[f[1]] = f[2]
+			or[f[1]] = f[3]
+		}
+		printf("%-40s %10s %10s %7s %10s %10s %7s\n", "run", "old time", "new time", "ratio", "old rss", "new rss", "ratio")
+	}
+	($1 in ot) {
+		tr = ot[$1] > 0 ? $2 / ot[$1] : 0
+		rr = or[$1] > 0 ? $3 / or[$1] : 0
+		printf("%-40s %10.2f %10.2f %7.2f %10d %10d %7.2f\n", $1, ot[$1], $2, tr, or[$1], $3, rr)
+	}'
+rm -f "$1.tmp"
@@ -0,0 +1,40 @@
+/*
+ * Many functions (256), each one accessing its own part of a global
+ * array and a shared table.
+ */
+
+#define F	256
+#define S	16
+
+int data[F][S];
+int shared[S];
+
+void _exit(int c) {
+	for(;;);
+}
+
+#define FUN(n) \
+	static int f##n(void) { \
+		int i, s = 0, *d = data[__COUNTER__]; \
+		for(i = 0; i < S; i++) { \
+			d[i] += shared[i]; \
+			s += d[i]; \
+		} \
+		return s; \
+	}
+#define FUN4(n)		FUN(n##0) FUN(n##1) FUN(n##2) FUN(n##3)
+#define FUN16(n)	FUN4(n##0) FUN4(n##1) FUN4(n##2) FUN4(n##3)
+#define FUN64(n)	FUN16(n##0) FUN16(n##1) FUN16(n##2) FUN16(n##3)
+
+#define CALL(n)		s += f##n();
+#define CALL4(n)	CALL(n##0) CALL(n##1) CALL(n##2) CALL(n##3)
+#define CALL16(n)	CALL4(n##0) CALL4(n##1) CALL4(n##2) CALL4(n##3)
+#define CALL64(n)	CALL16(n##0) CALL16(n##1) CALL16(n##2) CALL16(n##3)
+
+FUN64(1) FUN64(2) FUN64(3) FUN64(4)
+
+int main(void) {
+	int s = 0;
+	CALL64(1) CALL64(2) CALL64(3) CALL64(4)
+	return s;
+}
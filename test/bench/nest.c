@@ -0,0 +1,29 @@
+/*
+ * Deep loop nest (6 levels) walking small multi-dimensional arrays,
+ * typical of filter code.
+ */
+
+#define D	4
+
+int in[D][D][D][D];
+int coef[D][D];
+int out[D][D][D][D];
+
+void _exit(int c) {
+	for(;;);
+}
+
+int main(void) {
+	int i, j, k, l, m, n;
+	for(i = 0; i < D; i++)
+		for(j = 0; j < D; j++)
+			for(k = 0; k < D; k++)
+				for(l = 0; l < D; l++) {
+					int s = 0;
+					for(m = 0; m < D; m++)
+						for(n = 0; n < D; n++)
+							s += in[i][j][m][n] * coef[m][n] + in[k][l][n][m];
+					out[i][j][k][l] = s;
+				}
+	return 0;
+}
@@ -0,0 +1,112 @@
+#!/bin/sh
+# Run the dcache benchmarks and produce a JSON report.
+#
+# usage: run.sh -o REPORT -p PROGRAMS -c CACHES
+#	PROGRAMS and CACHES are lists of paths separated by ';'.
+#
+# Each program is analyzed with each cache configuration and each case
+# (one per dcache processor). The wall time (s) and the peak RSS (KiB) of
+# the run are recorded. As each case includes the access building,
+# "self_time" gives the time of the case minus the time of the "access" case.
+#
+# Environment: OPERFORM (default operform), TIME (GNU time, default /usr/bin/time).
+
+OPERFORM=${OPERFORM:-operform}
+TIME=${TIME:-/usr/bin/time}
+REPORT=bench-report.json
+PROGRAMS=
+CACHES=
+
+while getopts "o:p:c:" opt; do
+	case $opt in
+	o)	REPORT=$OPTARG ;;
+	p)	PROGRAMS=$OPTARG ;;
+	c)	CACHES=$OPTARG ;;
+	*)	echo "usage: $0 -o REPORT -p PROGRAMS -c CACHES" >&2; exit 1 ;;
+	esac
+done
+if [ -z "$PROGRAMS" ] || [ -z "$CACHES" ]; then
+	echo "usage: $0 -o REPORT -p PROGRAMS -c CACHES" >&2
+	exit 1
+fi
+if ! "$TIME" -f "%e" true > /dev/null 2>&1; then
+	echo "ERROR: GNU time is required (set TIME)." >&2
+	exit 1
+fi
+
+BASE="require:otawa::clp::FILTER_FEATURE require:otawa::dcache::CLP_ACCESS_FEATURE"
+CASES="access must pers may multi event"
+
+processor() {
+	case $1 in
+	access)	echo "CLPAccessBuilder" ;;
+	must)	echo "MUSTAnalysis" ;;
+	pers)	echo "PERSAnalysis" ;;
+	may)	echo "MAYAnalysis" ;;
+	multi)	echo "MultiPERSAnalysis" ;;
+	event)	echo "EventBuilder" ;;
+	esac
+}
+
+flags() {
+	case $1 in
+	access)	echo "" ;;
+	must)	echo "require:otawa::dcache::MUST_FEATURE" ;;
+	pers)	echo "require:otawa::dcache::PERS_FEATURE" ;;
+	may)	echo "require:otawa::dcache::MAY_FEATURE" ;;
+	multi)	echo "require:otawa::dcache::MULTI_PERS_FEATURE" ;;
+	event)	echo "require:otawa::dcache::MULTI_PERS_FEATURE require:otawa::dcache::MAY_FEATURE require:otawa::dcache::EVENTS_FEATURE" ;;
+	esac
+}
+
+COMMIT=$(git -C "$(dirname "$0")" rev-parse --short HEAD 2> /dev/null || echo unknown)
+TMP=$(mktemp)
+LOG="$REPORT.log"
+: > "$LOG"
+
+{
+	echo "{"
+	echo "	\"commit\": \"$COMMIT\","
+	echo "	\"date\": \"$(date -u +%Y-%m-%dT%H:%M:%SZ)\","
+	echo "	\"results\": ["
+} > "$REPORT"
+
+SEP=""
+IFS=';'
+for prog in $PROGRAMS; do
+	for cache in $CACHES; do
+		IFS=' '
+		name=$(basename "$prog" .elf)
+		conf=$(basename "$cache" .xml)
+		base_time=0
+		for c in $CASES; do
+			echo "$name / $conf / $c" >&2
+			echo "== $name / $conf / $c" >> "$LOG"
+			"$TIME" -f "%e %M" -o "$TMP" "$OPERFORM" "$prog" $BASE $(flags $c) \
+				--add-prop "otawa::CACHE_CONFIG_PATH=$cache" > /dev/null 2>> "$LOG"
+			status=$?
+			# on failure, GNU time writes first "Command exited with non-zero status N"
+			read time rss <<-EOF
+			$(tail -n 1 "$TMP")
+			EOF
+			if [ $c = access ]; then
+				base_time=$time
+			fi
+			self=$(echo "$time $base_time" | awk '{ printf("%.2f", $1 - $2) }')
+			printf '%s\t\t{ "program": "%s", "cache": "%s", "case": "%s", "processor": "%s", "status": %d, "time": %s, "self_time": %s, "rss": %s }' \
+				"$SEP" "$name" "$conf" "$c" "$(processor $c)" "$status" "$time" "$self" "$rss" >> "$REPORT"
+			SEP=",
+"
+		done
+		IFS=';'
+	done
+done
+unset IFS
+
+{
+	echo ""
+	echo "	]"
+	echo "}"
+} >> "$REPORT"
+rm -f "$TMP"
+echo "report written to $REPORT" >&2
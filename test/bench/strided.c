@@ -0,0 +1,48 @@
+/*
+ * Strided accesses to large arrays: sequential, strided and column-wise
+ * walks, and a matrix product.
+ */
+
+#define N	16384
+#define M	64
+
+int a[N], b[N];
+int x[M][M], y[M][M], z[M][M];
+
+void _exit(int c) {
+	for(;;);
+}
+
+static void stride(int s) {
+	int i;
+	for(i = 0; i < N; i += s)
+		a[i] = b[i] + 1;
+}
+
+static void columns(void) {
+	int i, j;
+	for(j = 0; j < M; j++)
+		for(i = 0; i < M; i++)
+			x[i][j] = y[i][j] + z[j][i];
+}
+
+static void product(void) {
+	int i, j, k;
+	for(i = 0; i < M; i++)
+		for(j = 0; j < M; j++) {
+			int s = 0;
+			for(k = 0; k < M; k++)
+				s += y[i][k] * z[k][j];
+			x[i][j] = s;
+		}
+}
+
+int main(void) {
+	stride(1);
+	stride(4);
+	stride(16);
+	stride(64);
+	columns();
+	product();
+	return 0;
+}
@@ -0,0 +1,46 @@
+#!/bin/sh
+# Check that two configurations of the analyses produce the same dump.
+#
+# usage: diff.sh PROGRAM FLAGS... -- FLAGS_A... -- FLAGS_B...
+#	FLAGS are passed to both runs, FLAGS_A to the first one and FLAGS_B
+#	to the second one.
+#
+# Environment: OPERFORM (default operform).
+
+OPERFORM=${OPERFORM:-operform}
+if [ $# -lt 1 ]; then
+	echo "usage: $0 PROGRAM FLAGS... -- FLAGS_A... -- FLAGS_B..." >&2
+	exit 1
+fi
+prog=$1
+shift
+
+# split the arguments
+common=
+a=
+b=
+part=common
+for arg in "$@"; do
+	if [ "$arg" = "--" ]; then
+		case $part in
+		common)	part=a ;;
+		*)		part=b ;;
+		esac
+	else
+		case $part in
+		common)	common="$common $arg" ;;
+		a)		a="$a $arg" ;;
+		b)		b="$b $arg" ;;
+		esac
+	fi
+done
+
+name=$(basename "$prog" .elf)
+"$OPERFORM" "$prog" $common $a > "$name-a.dump" 2> "$name-a.log" || { echo "ERROR: first run failed (see $name-a.log)" >&2; exit 1; }
+"$OPERFORM" "$prog" $common $b > "$name-b.dump" 2> "$name-b.log" || { echo "ERROR: second run failed (see $name-b.log)" >&2; exit 1; }
+if diff "$name-a.dump" "$name-b.dump"; then
+	echo "$name: same results with$a and with$b"
+else
+	echo "ERROR: $name: results differ with$a and with$b" >&2
+	exit 1
+fi
@@ -0,0 +1,300 @@
+/*
+ *	ACS kernel microbenchmarks
+ *
+ *	This file is part of OTAWA
+ *	Copyright (c) 2020, IRIT UPS.
+ *
+ *	OTAWA is free software; you can redistribute it and/or modify
+ *	it under the terms of the GNU General Public License as published by
+ *	the Free Software Foundation; either version 2 of the License, or
+ *	(at your option) any later version.
+ *
+ *	OTAWA is distributed in the hope that it will be useful,
+ *	but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *	GNU General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License
+ *	along with OTAWA; if not, write to the Free Software
+ *	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * usage: kernels [-c CACHE] [-n BLOCKS]* [-a ASSOC]* [-p POOL] [-i ITERATIONS] [-o REPORT]
+ *
+ * Times the transfer and join functions of the domains on synthetic states,
+ * without any program: a set collection is built from the cache configuration
+ * with BLOCKS blocks in set 0 and a pool of POOL states is obtained by applying
+ * random accesses from the entry state. Each kernel is then called ITERATIONS
+ * times on the states of the pool. For each domain, kernel, block count and
+ * associativity, the JSON report gives the time (s), the throughput
+ * (result states per second) and the allocations done by the kernel.
+ */
+
+#include <chrono>
+#include <random>
+#include <elm/alloc/ListGC.h>
+#include <elm/io.h>
+#include <elm/sys/System.h>
+#include <otawa/hard/CacheConfiguration.h>
+#include <otawa/hard/Memory.h>
+
+#include "otawa/dcache/MAY.h"
+#include "otawa/dcache/MultiPERS.h"
+#include "otawa/dcache/MUST.h"
+#include "otawa/dcache/PERS.h"
+
+using namespace elm;
+using namespace otawa;
+using namespace otawa::dcache;
+
+// GC manager keeping alive the pool of states of the measured domain
+class BenchGC: public GCManager {
+public:
+	BenchGC(): dom(nullptr), cur(nullptr), allocs(0), bytes(0), collections(0), gc(*this) { }
+
+	void collect(AbstractGC& agc) override {
+		collections++;
+		auto f = [&](ai::State *s) { static_cast<GCState *>(s)->mark(agc); };
+		if(dom != nullptr)
+			dom->collect(f);
+		for(auto s: pool)
+			f(s);
+		if(cur != nullptr)
+			f(cur);
+	}
+
+	void clean(void *p) override {
+		auto s = static_cast<GCState *>(p);
+		if(dom != nullptr)
+			dom->clean(s);
+		s->~GCState();
+	}
+
+	Domain *dom;
+	Vector<ai::State *> pool;
+	ai::State *cur;
+	t::uint64 allocs, bytes, collections;
+
+	// collector counting the allocations
+	class GC: public ListGC {
+	public:
+		GC(BenchGC& manager): ListGC(manager), m(manager) { }
+		void *allocate(t::size size) override {
+			m.allocs++;
+			m.bytes += size;
+			return ListGC::allocate(size);
+		}
+	private:
+		BenchGC& m;
+	};
+	GC gc;
+};
+
+class Bench {
+public:
+	Bench(io::Output& output, t::uint64 iterations, int pool):
+		out(output), I(iterations), P(pool), N(0), A(0), first(true) { }
+
+	// build the pool of states of the domain from random accesses
+	void fill(BenchGC& m, Domain& d, const Vector<Access>& accs) {
+		m.dom = &d;
+		m.cur = d.entry();
+		for(int i = 0; m.pool.length() < P; i++) {
+			m.cur = d.update(accs[rnd() % accs.length()], m.cur);
+			if(i % 4 == 3)
+				m.pool.add(m.cur);
+		}
+	}
+
+	// call the kernel I times and report its time and allocations
+	template <class F>
+	void measure(BenchGC& m, cstring domain, cstring kernel, F f) {
+		auto a0 = m.allocs, b0 = m.bytes, c0 = m.collections;
+		auto start = std::chrono::steady_clock::now();
+		for(t::uint64 i = 0; i < I; i++)
+			m.cur = f(i);
+		double t = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count() * 1e-9;
+		out << (first ? "\n" : ",\n")
+			<< "\t\t{ \"domain\": \"" << domain << "\", \"kernel\": \"" << kernel
+			<< "\", \"blocks\": " << N << ", \"assoc\": " << A
+			<< ", \"ops\": " << I << ", \"time\": " << t
+			<< ", \"states_per_s\": " << (t > 0 ? I / t : 0.)
+			<< ", \"allocs\": " << (m.allocs - a0)
+			<< ", \"allocated_bytes\": " << (m.bytes - b0)
+			<< ", \"collections\": " << (m.collections - c0) << " }";
+		first = false;
+	}
+
+	// measure an access kernel (no state is produced, the results are only counted)
+	template <class F>
+	void measureAccess(BenchGC& m, cstring kernel, F f) {
+		t::uint64 cnt = 0;
+		measure(m, "Access", kernel, [&](t::uint64 i) { cnt += f(i); return m.cur; });
+		sink = cnt;
+	}
+
+	void run(SetCollection& coll, const Vector<Access>& accs, const Access& en, int assoc) {
+		N = coll.blockCount(0);
+		A = assoc;
+		auto s = [&](BenchGC& m, t::uint64 i) { return m.pool[i % P]; };
+		auto t = [&](BenchGC& m, t::uint64 i) { return m.pool[(i * 7 + 1) % P]; };
+
+		{
+			BenchGC m;
+			MUST d(coll, 0, A, m.gc);
+			fill(m, d, accs);
+			measure(m, "MUST", "access", [&](t::uint64 i) { return d.access(acs(s(m, i)), int(i % N)); });
+			measure(m, "MUST", "join", [&](t::uint64 i) { return d.join(s(m, i), t(m, i)); });
+			measure(m, "MUST", "accessAny", [&](t::uint64 i) { return d.accessAny(acs(s(m, i))); });
+			m.dom = nullptr;
+		}
+
+		{
+			BenchGC m;
+			PERS d(coll, 0, A, m.gc);
+			fill(m, d, accs);
+			measure(m, "PERS", "access", [&](t::uint64 i) { return d.access(acs(s(m, i)), int(i % N)); });
+			measure(m, "PERS", "join", [&](t::uint64 i) { return d.join(s(m, i), t(m, i)); });
+			m.dom = nullptr;
+		}
+
+		{
+			BenchGC m;
+			MAY d(coll, 0, A, m.gc);
+			fill(m, d, accs);
+			measure(m, "MAY", "join", [&](t::uint64 i) { return d.join(s(m, i), t(m, i)); });
+			m.dom = nullptr;
+		}
+
+		{
+			BenchGC m;
+			MultiPERS d(coll, 0, A, m.gc);
+			fill(m, d, accs);
+			measure(m, "MultiPERS", "join", [&](t::uint64 i) { return d.join(s(m, i), t(m, i)); });
+			measure(m, "MultiPERS", "update", [&](t::uint64 i) { return d.update(accs[i % N], s(m, i)); });
+			m.dom = nullptr;
+		}
+
+		{
+			BenchGC m;
+			int S = coll.setCount();
+			measureAccess(m, "access", [&](t::uint64 i) { return en.access(int(i % S)) ? 1 : 0; });
+			measureAccess(m, "blockIn", [&](t::uint64 i) { return en.blockIn(int(i % S)) != nullptr ? 1 : 0; });
+		}
+	}
+
+private:
+	io::Output& out;
+	t::uint64 I;
+	int P, N, A;
+	bool first;
+	std::mt19937 rnd;
+	static volatile t::uint64 sink;
+};
+volatile t::uint64 Bench::sink = 0;
+
+static void usage() {
+	cerr << "usage: kernels [-c CACHE] [-n BLOCKS]* [-a ASSOC]* [-p POOL] [-i ITERATIONS] [-o REPORT]\n";
+}
+
+int main(int argc, char **argv) {
+	sys::Path cache_path = "cache.xml";
+	sys::Path report;
+	Vector<int> ns, as;
+	int pool = 64;
+	t::uint64 iters = 100000;
+
+	// parse the arguments
+	for(int i = 1; i < argc; i++) {
+		cstring a = argv[i];
+		if(i + 1 >= argc || a.length() != 2 || argv[i][0] != '-') {
+			usage();
+			return 1;
+		}
+		string v = argv[++i];
+		switch(argv[i - 1][1]) {
+		case 'c':	cache_path = v; break;
+		case 'n':	ns.add(atoi(v.toCString())); break;
+		case 'a':	as.add(atoi(v.toCString())); break;
+		case 'p':	pool = atoi(v.toCString()); break;
+		case 'i':	iters = atoll(v.toCString()); break;
+		case 'o':	report = v; break;
+		default:	usage(); return 1;
+		}
+	}
+	if(ns.isEmpty())
+		for(int n: { 16, 64, 256 })
+			ns.add(n);
+	if(as.isEmpty())
+		for(int a: { 1, 2, 4, 8, 16 })
+			as.add(a);
+	bool ok = pool > 0 && iters > 0;
+	for(auto n: ns)
+		ok = ok && n > 0;
+	for(auto a: as)
+		ok = ok && a > 0;
+	if(!ok) {
+		usage();
+		return 1;
+	}
+
+	try {
+
+		// load the cache
+		auto conf = hard::CacheConfiguration::load(cache_path);
+		auto cache = conf->dataCache();
+		if(cache == nullptr) {
+			cerr << "ERROR: no data cache in " << cache_path << io::endl;
+			return 1;
+		}
+
+		// open the report
+		io::OutStream *stream = nullptr;
+		io::Output *fout = nullptr;
+		if(!report.isEmpty()) {
+			stream = sys::System::createFile(report);
+			fout = new io::Output(*stream);
+		}
+		io::Output& out = fout != nullptr ? *fout : cout;
+		out << "{\n\t\"cache\": \"" << cache_path << "\",\n\t\"iterations\": " << iters
+			<< ",\n\t\"pool\": " << pool << ",\n\t\"results\": [";
+
+		Bench bench(out, iters, pool);
+		for(auto n: ns) {
+
+			// N blocks in set 0 and a strided access covering the first sets
+			SetCollection coll(*cache, hard::Memory::full);
+			Address::offset_t step = cache->setCount() * cache->blockSize();
+			for(int i = 0; i < n; i++)
+				coll.add(Address(i * step));
+			int cnt = min(cache->setCount(), 16);
+			for(int i = 0; i < cnt; i++)
+				coll.add(Address(i * cache->blockSize()));
+			coll.freeze();
+			Vector<Access> accs;
+			for(int i = 0; i < n; i++)
+				accs.add(Access(nullptr, LOAD, coll.block(0, i)));
+			Access en(nullptr, LOAD, coll, Address(0), 1, cnt);
+
+			for(auto a: as) {
+				cerr << "blocks " << n << " / assoc " << a << io::endl;
+				bench.run(coll, accs, en, a);
+			}
+		}
+
+		out << "\n\t]\n}\n";
+		out.flush();
+		if(fout != nullptr) {
+			delete fout;
+			delete stream;
+		}
+		delete conf;
+	}
+	catch(elm::Exception& e) {
+		cerr << "ERROR: " << e.message() << io::endl;
+		return 1;
+	}
+	return 0;
+}
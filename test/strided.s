@@ -0,0 +1,24 @@
+	.global main
+	.global _exit
+
+_exit:
+	b	_exit
+
+main:
+	stmfd sp!, {r0-r2}
+	mov	r0, #0
+	ldr	r1, =t
+loop:
+	cmp	r0, #8
+	bhs	end
+	ldr	r2, [r1, r0, lsl #6]
+	add	r0, r0, #1
+	b	loop
+end:
+	ldmfd sp!, {r0-r2}
+	mov	pc, lr
+
+	.data
+	.balign 16
+t:
+	.fill 128, 4